@@ -5,49 +5,64 @@
 
 void Animation::updatePositionsFromUVs(std::vector<Vec3>& positions, size_t frameNum)
 {
-    if (frames_.size() == 1)
-        updatePositionsFromBSplinePatch(positions, UVs_, frames_[0].second);
-    else if (frames_.size() > 1)
+    if (frames_.empty())
+        return;
+
+    size_t frameIdx = 0;
+    float t = 0.f;
+    if (frames_.size() > 1)
     {
         if (frameNum > frames_.back().first)
             frameNum = frames_.back().first;
 
         // Find frame before and after frameNum (frame0 and frame1)
-        size_t frameIdx = 0;
-        for (; frameIdx < frames_.size() - 1; ++frameNum)
+        for (; frameIdx < frames_.size() - 1; ++frameIdx)
             if (frames_[frameIdx + 1].first >= frameNum)
                 break;
 
-        const auto& frame0 = frames_[frameIdx];
-        const auto& frame1 = frames_[frameIdx + 1];
-
         // Calculate percentage between frame0 and frame1
-        size_t span = frame1.first - frame0.first;
-        size_t dist = frameNum - frame0.first;
-        float t = 0.f;
+        size_t span = frames_[frameIdx + 1].first - frames_[frameIdx].first;
+        size_t dist = frameNum - frames_[frameIdx].first;
         if (span != 0)
             t = static_cast<float>(dist) / static_cast<float>(span);
+    }
+
+    const BSplinePatch& patch0 = frames_[frameIdx].second;
+    const BSplinePatch& patch1 = frames_[std::min(frameIdx + 1, frames_.size() - 1)].second;
+
+    // The UVs don't move, so their basis weights are only recomputed when the patch layout or vertex count changes
+    if (!weights_.matches(patch0, UVs_.size()))
+        weights_.build(UVs_, patch0);
+
+    // Lerp the control points from each frame to create an inbetween patch
+    controlPoints_.clear();
+    for (size_t splineIdx = 0; splineIdx < patch0.size(); ++splineIdx)
+    {
+        const auto& spline0 = patch0[splineIdx];
+        const auto& spline1 = patch1[splineIdx];
+        for (size_t controlpt = 0; controlpt < spline0.controlPoints().size(); ++controlpt)
+            controlPoints_.push_back(lerp(
+                t,
+                spline0.getControlPoint(controlpt),
+                spline1.getControlPoint(controlpt)));
+    }
+
+    // Update positions using the inbetween patch
+    weights_.apply(positions, controlPoints_);
+}
+
+void Animation::updatePositionsFromPatch(std::vector<Vec3>& positions, const BSplinePatch& patch)
+{
+    if (!weights_.matches(patch, UVs_.size()))
+        weights_.build(UVs_, patch);
 
-        // Lerp the control points from each frame to create an inbetween patch
-        BSplinePatch patch;
-        for (size_t splineIdx = 0; splineIdx < frame0.second.size(); ++splineIdx)
-        {
-            const auto& spline0 = frame0.second[splineIdx];
-            const auto& spline1 = frame1.second[splineIdx];
-
-            std::vector<Vec3> controlPoints(spline0.controlPoints().size(), Vec3{ 0.f, 0.f, 0.f });
-            for (size_t controlpt = 0; controlpt < spline0.controlPoints().size(); ++controlpt)
-                controlPoints[controlpt] = lerp(
-                    t,
-                    spline0.getControlPoint(controlpt),
-                    spline1.getControlPoint(controlpt));
-
-            patch.push_back(BSpline(controlPoints));
-        }
-
-        // Update positions using the inbetween patch
-        updatePositionsFromBSplinePatch(positions, UVs_, patch);
+    controlPoints_.clear();
+    for (const BSpline& spline : patch)
+    {
+        std::vector<Vec3> points = spline.controlPoints();
+        controlPoints_.insert(controlPoints_.end(), points.begin(), points.end());
     }
+    weights_.apply(positions, controlPoints_);
 }
 
 void Animation::addKeyframe(size_t frameNum, const BSplinePatch& patch)
@@ -64,6 +79,13 @@ void Animation::addVertex(size_t index, size_t neighbourIndex0, size_t neighbour
         UVs_.resize(index + 1);
 
     UVs_[index] = (UVs_[neighbourIndex0] + UVs_[neighbourIndex1]) / 2.f;
+    if (!weights_.empty())
+    {
+        if (index <= weights_.size())
+            weights_.update(index, UVs_[index]);
+        else
+            weights_.clear();
+    }
 
 }
 
@@ -75,9 +97,15 @@ void Animation::clearFrames()
 void Animation::setUVs(const std::vector<Vec3>& newUVs)
 {
     UVs_ = newUVs;
+    weights_.clear();
 }
 
 const std::vector<Vec3>& Animation::UVs() const
 {
     return UVs_;
+}
+
+void Animation::invalidateWeights()
+{
+    weights_.clear();
 }
\ No newline at end of file
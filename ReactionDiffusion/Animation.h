@@ -13,16 +13,20 @@ class Animation
     };
 
     std::vector<Keyframe> frames_;
+    BSplinePatchWeights weights_;
+    std::vector<Vec3> controlPoints_;
 
 public:
     Animation() = default;
 
     void updatePositionsFromUVs(std::vector<Vec3>& positions, size_t frameNum);
+    void updatePositionsFromPatch(std::vector<Vec3>& positions, const BSplinePatch& patch);
     void addKeyframe(size_t frameNum, const BSplinePatch& patch);
     void addVertex(size_t index, size_t neighbourIndex1, size_t neighbourIndex2);
     void clearFrames();
     void setUVs(const std::vector<Vec3>& newUVs);
     const std::vector<Vec3>& UVs() const;
+    void invalidateWeights(); // call after editing UVs_ directly
    
     std::vector<Vec3> UVs_;
 };
\ No newline at end of file
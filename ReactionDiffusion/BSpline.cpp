@@ -2,6 +2,7 @@
 #include "ColorShader.h"
 #include "Triangle.h"
 
+#include <algorithm>
 #include <cassert>
 
 
@@ -22,6 +23,16 @@ void BSpline::setControlPoints(const std::vector<Vec3>& points)
 	knots_ = createKnots(degree_, controlPoints_.size(), clamped_);
 }
 
+size_t BSpline::degree() const
+{
+	return degree_;
+}
+
+bool BSpline::clamped() const
+{
+	return clamped_;
+}
+
 Vec3 bSpline(float u, const std::vector<Vec3>& controlPoints, const std::vector<float>& knots, bool clamped)
 {
 	size_t degree = knots.size() - controlPoints.size() - 1;
@@ -85,6 +96,56 @@ float basis(size_t i, size_t degree, float u, const std::vector<float>& knots)
 	return value;
 }
 
+// Writes the degree + 1 basis values that can be non-zero at u and returns the index of the
+// control point the first one belongs to. Uses the same end conditions as bSpline().
+size_t basisWeights(float u, size_t degree, size_t numControlPoints, const std::vector<float>& knots, bool clamped, float* weights)
+{
+	size_t span = degree + 1;
+	for (size_t k = 0; k < span; ++k)
+		weights[k] = 0.f;
+
+	if (numControlPoints < span)
+		return 0;
+
+	if (clamped)
+	{
+		if (u <= 0.f)
+		{
+			weights[0] = 1.f;
+			return 0;
+		}
+		else if (u >= 1.f)
+		{
+			weights[span - 1] = 1.f;
+			return numControlPoints - span;
+		}
+	}
+	else
+	{
+		float offset = 0.00001f;
+		if (u < knots[degree])
+			u = knots[degree] + offset;
+		else if (u > knots[numControlPoints])
+			u = knots[numControlPoints] - offset;
+	}
+
+	std::vector<float> values(numControlPoints);
+	size_t first = numControlPoints;
+	for (size_t i = 0; i < numControlPoints; ++i)
+	{
+		values[i] = basis(i, degree, u, knots);
+		if (values[i] != 0.f && first == numControlPoints)
+			first = i;
+	}
+
+	// At most degree + 1 neighbouring bases overlap any u
+	first = std::min(first, numControlPoints - span);
+	for (size_t k = 0; k < span; ++k)
+		weights[k] = values[first + k];
+
+	return first;
+}
+
 std::vector<float> createKnots(size_t degree, size_t numControlPoints, bool clamped)
 {
 	size_t numKnots = numControlPoints + degree + 1;
@@ -42,8 +42,11 @@ public:
 
     Vec3 sample(float u) const override;
     void setControlPoints(const std::vector<Vec3>& points) override;
+    size_t degree() const;
+    bool clamped() const;
 };
 
 Vec3 bSpline(float u, const std::vector<Vec3>& controlPoints, const std::vector<float>& knots, bool clamped);
 float basis(size_t i, size_t degree, float u, const std::vector<float>& knots);
+size_t basisWeights(float u, size_t degree, size_t numControlPoints, const std::vector<float>& knots, bool clamped, float* weights);
 std::vector<float> createKnots(size_t degree, size_t numControlPoints, bool clamped);
\ No newline at end of file
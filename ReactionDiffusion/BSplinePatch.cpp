@@ -1,40 +1,246 @@
 #include "BSplinePatch.h"
+#include "ThreadPool.h"
 #include "Utils.h"
 
-#include <functional>
+#include <algorithm>
+#include <cmath>
 
 
-std::vector<Vec3> calculateUVs(const std::vector<Vec3>& positions, Curve& xCurve, Curve& yCurve)
+namespace
 {
-    std::vector<Vec3> UVs;
-    auto xLookup = [&](float u) { return xCurve.sample(u).x; }; // Takes a normalized value and returns a Vec3 on a curve 
-    auto yLookup = [&](float u) { return yCurve.sample(u).y; };
+    // The samples of every spline are joined by a quadratic clamped spline across the patch
+    constexpr size_t AcrossDegree = 2;
+    constexpr size_t MinVerticesPerThread = 8192;
+
+    constexpr size_t InverseTableSize = 4096;
+    constexpr float InverseTolerance = 0.000001f; // about what 20 bisection steps used to resolve
+    constexpr int MaxNewtonSteps = 4;
 
-    for (Vec3 pos : positions)
+    // Runs func(start, end) on contiguous slices of [0, count), one per thread of the shared pool
+    template<typename Func>
+    void parallelRanges(size_t count, size_t minPerThread, Func func)
     {
-        UVs.push_back(Vec3{
-            Utils::intervalBisect<float>(xLookup, pos.x),
-            Utils::intervalBisect<float>(yLookup, pos.y),
-            pos.z });
+        ThreadPool& pool = ThreadPool::shared();
+        size_t numSlices = std::min(pool.getNumThreads(), count / minPerThread + 1);
+        size_t perSlice = (count + numSlices - 1) / numSlices;
+        pool.parallelFor(numSlices, [&](size_t slice) {
+            size_t start = slice * perSlice;
+            if (start < count)
+                func(start, std::min(start + perSlice, count));
+            });
     }
 
+    // Inverse of one component of an increasing curve. The curve is tabulated once and a target
+    // is bracketed with a binary search, then interpolated. Newton steps on the real curve are
+    // only taken where the table is too coarse for the interpolation to be trusted.
+    class InverseCurve
+    {
+    public:
+        InverseCurve(const Curve& curve, int axis) :
+            curve_(curve), axis_(axis), values_(InverseTableSize + 1)
+        {
+            parallelRanges(values_.size(), 256, [&](size_t start, size_t end)
+                {
+                    for (size_t i = start; i < end; ++i)
+                        values_[i] = sample(static_cast<float>(i) / InverseTableSize);
+                });
+
+            // Keep the table sorted even if the curve doubles back on itself
+            for (size_t i = 1; i < values_.size(); ++i)
+                values_[i] = std::max(values_[i], values_[i - 1]);
+        }
+
+        float operator()(float target) const
+        {
+            if (target <= values_.front())
+                return 0.f;
+            if (target >= values_.back())
+                return 1.f;
+
+            size_t i = static_cast<size_t>(std::upper_bound(values_.begin(), values_.end(), target) - values_.begin()) - 1;
+            const float h = 1.f / InverseTableSize;
+            float x0 = values_[i], x1 = values_[i + 1];
+            float slope = (x1 - x0) / h;
+            float u = (static_cast<float>(i) + (target - x0) / (x1 - x0)) * h;
+
+            // The chord misses the curve by about an eighth of the second difference
+            size_t j = std::min(std::max<size_t>(i, 1), values_.size() - 2);
+            float bend = std::abs(values_[j - 1] - 2.f * values_[j] + values_[j + 1]) / 8.f;
+            if (bend / slope <= InverseTolerance)
+                return u;
+
+            for (int step = 0; step < MaxNewtonSteps; ++step)
+            {
+                float du = (sample(u) - target) / slope;
+                u = std::min(std::max(u - du, i * h), (i + 1) * h);
+                if (std::abs(du) <= InverseTolerance)
+                    break;
+            }
+            return u;
+        }
+
+    private:
+        float sample(float u) const
+        {
+            return curve_.sample(u).data[axis_];
+        }
+
+        const Curve& curve_;
+        int axis_;
+        std::vector<float> values_;
+    };
+}
+
+
+std::vector<Vec3> calculateUVs(const std::vector<Vec3>& positions, Curve& xCurve, Curve& yCurve)
+{
+    InverseCurve xLookup(xCurve, 0);
+    InverseCurve yLookup(yCurve, 1);
+
+    std::vector<Vec3> UVs(positions.size());
+    parallelRanges(positions.size(), MinVerticesPerThread, [&](size_t start, size_t end)
+        {
+            for (size_t i = start; i < end; ++i)
+                UVs[i] = Vec3(xLookup(positions[i].x), yLookup(positions[i].y), positions[i].z);
+        });
+
     return UVs;
 }
 
-void updatePositionsFromBSplinePatch(std::vector<Vec3>& positions, const std::vector<Vec3>& UVs, const std::vector<BSpline>& splines)
+void BSplinePatchWeights::build(const std::vector<Vec3>& UVs, const BSplinePatch& patch)
 {
-    for (size_t i = 0; i < positions.size(); i++)
+    clear();
+    size_t offset = 0;
+    for (const BSpline& spline : patch)
     {
-        Vec3& pos = positions[i];
-        const Vec3& uv = UVs[i];
+        Spline layout;
+        layout.offset = offset;
+        layout.numControlPoints = spline.controlPoints().size();
+        layout.degree = spline.degree();
+        layout.clamped = spline.clamped();
+        if (layout.numControlPoints < layout.degree + 1)
+        {
+            clear(); // too few control points to define the spline
+            return;
+        }
 
-        std::vector<Vec3> newCtrlPts;
-        for (const BSpline& spline : splines)
-            newCtrlPts.push_back(spline.sample(uv.y));
+        layout.knots = createKnots(layout.degree, layout.numControlPoints, layout.clamped);
+        uniform_ = uniform_ && (splines_.empty() || (layout.numControlPoints == splines_[0].numControlPoints &&
+            layout.degree == splines_[0].degree && layout.clamped == splines_[0].clamped));
+        spanV_ = std::max(spanV_, layout.degree + 1);
+        offset += layout.numControlPoints;
+        splines_.push_back(std::move(layout));
+    }
 
-        float z = pos.z;
-        BSpline spline(newCtrlPts);
-        pos = spline.sample(uv.x);
-        pos.z = z;
+    spanU_ = AcrossDegree + 1;
+    if (splines_.size() < spanU_)
+    {
+        clear(); // too few splines to define the patch
+        return;
     }
+
+    knotsU_ = createKnots(AcrossDegree, splines_.size(), true);
+    setsV_ = uniform_ ? 1 : spanU_;
+    firstU_.resize(UVs.size());
+    firstV_.resize(UVs.size() * setsV_);
+    weightsU_.resize(UVs.size() * spanU_);
+    weightsV_.resize(UVs.size() * setsV_ * spanV_);
+    for (size_t i = 0; i < UVs.size(); ++i)
+        update(i, UVs[i]);
+}
+
+void BSplinePatchWeights::update(size_t index, const Vec3& uv)
+{
+    if (index >= firstU_.size())
+    {
+        firstU_.resize(index + 1);
+        firstV_.resize((index + 1) * setsV_);
+        weightsU_.resize((index + 1) * spanU_);
+        weightsV_.resize((index + 1) * setsV_ * spanV_);
+    }
+
+    // u picks the position across the splines, v the position along each of them
+    firstU_[index] = static_cast<unsigned>(basisWeights(uv.x, AcrossDegree, splines_.size(), knotsU_, true, &weightsU_[index * spanU_]));
+    for (size_t j = 0; j < setsV_; ++j)
+    {
+        const Spline& spline = splines_[firstU_[index] + j];
+        const size_t set = index * setsV_ + j;
+        std::fill_n(&weightsV_[set * spanV_], spanV_, 0.f); // lower degree splines leave the tail unused
+        firstV_[set] = static_cast<unsigned>(basisWeights(uv.y, spline.degree, spline.numControlPoints, spline.knots, spline.clamped, &weightsV_[set * spanV_]));
+    }
+}
+
+void BSplinePatchWeights::clear()
+{
+    splines_.clear();
+    uniform_ = true;
+    knotsU_.clear();
+    spanU_ = 0;
+    spanV_ = 0;
+    setsV_ = 1;
+    firstU_.clear();
+    firstV_.clear();
+    weightsU_.clear();
+    weightsV_.clear();
+}
+
+bool BSplinePatchWeights::empty() const
+{
+    return firstU_.empty();
+}
+
+size_t BSplinePatchWeights::size() const
+{
+    return firstU_.size();
+}
+
+bool BSplinePatchWeights::matches(const BSplinePatch& patch, size_t numVertices) const
+{
+    if (patch.size() != splines_.size() || firstU_.size() != numVertices || splines_.empty())
+        return false;
+
+    for (size_t j = 0; j < patch.size(); ++j)
+    {
+        const Spline& layout = splines_[j];
+        if (patch[j].controlPoints().size() != layout.numControlPoints || patch[j].degree() != layout.degree || patch[j].clamped() != layout.clamped)
+            return false;
+    }
+    return true;
+}
+
+void BSplinePatchWeights::apply(std::vector<Vec3>& positions, const std::vector<Vec3>& controlPoints) const
+{
+    if (splines_.empty() || controlPoints.size() < splines_.back().offset + splines_.back().numControlPoints)
+        return;
+
+    const size_t count = std::min(positions.size(), firstU_.size());
+    parallelRanges(count, MinVerticesPerThread, [&](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            const float* wu = &weightsU_[i * spanU_];
+
+            // Plain floats so the sums inline, the Vec3 operators live in another translation unit
+            float x = 0.f, y = 0.f;
+            for (size_t j = 0; j < spanU_; ++j)
+            {
+                const Spline& spline = splines_[firstU_[i] + j];
+                const size_t set = i * setsV_ + (uniform_ ? 0 : j);
+                const float* wv = &weightsV_[set * spanV_];
+                const Vec3* row = &controlPoints[spline.offset + firstV_[set]];
+
+                float sx = 0.f, sy = 0.f;
+                for (size_t k = 0; k <= spline.degree; ++k)
+                {
+                    sx += row[k].x * wv[k];
+                    sy += row[k].y * wv[k];
+                }
+                x += sx * wu[j];
+                y += sy * wu[j];
+            }
+
+            positions[i].x = x;
+            positions[i].y = y;
+        }
+    });
 }
@@ -7,5 +7,41 @@
 
 using BSplinePatch = std::vector<BSpline>;
 
-void updatePositionsFromBSplinePatch(std::vector<Vec3>& positions, const std::vector<Vec3>& UVs, const std::vector<BSpline>& splines);
+// Basis weights of each vertex's UV on a patch. They only depend on the UVs and the layout of
+// the patch, so moving the vertices to a new set of control points is a weighted sum.
+class BSplinePatchWeights
+{
+public:
+    void build(const std::vector<Vec3>& UVs, const BSplinePatch& patch);
+    void update(size_t index, const Vec3& uv);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    bool matches(const BSplinePatch& patch, size_t numVertices) const;
+
+    // controlPoints holds the control points of every spline, one spline after the other
+    void apply(std::vector<Vec3>& positions, const std::vector<Vec3>& controlPoints) const;
+
+private:
+    struct Spline
+    {
+        size_t offset = 0; // of its first control point in controlPoints
+        size_t numControlPoints = 0;
+        size_t degree = 0;
+        bool clamped = true;
+        std::vector<float> knots;
+    };
+
+    std::vector<Spline> splines_;
+    bool uniform_ = true; // all splines share one layout, so one set of weights along them serves all
+    std::vector<float> knotsU_;
+
+    // degree + 1 weights per vertex across the splines, starting at firstU_. Along the splines a
+    // vertex has one set of spanV_ weights, or one per spline in reach when the layouts differ,
+    // each starting at firstV_.
+    size_t spanU_ = 0, spanV_ = 0, setsV_ = 1;
+    std::vector<unsigned> firstU_, firstV_;
+    std::vector<float> weightsU_, weightsV_;
+};
+
 std::vector<Vec3> calculateUVs(const std::vector<Vec3>& positions, Curve& xCurve, Curve& yCurve);
\ No newline at end of file
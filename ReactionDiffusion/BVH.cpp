@@ -1,9 +1,43 @@
 #include "BVH.h"
+#include "ThreadPool.h"
 
-#include <memory>
-#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <utility>
 
 
+namespace
+{
+    constexpr int NumBins = 12;
+    constexpr unsigned MaxLeafSize = 4;
+    constexpr unsigned ParallelThreshold = 4096; // smallest subtree worth its own task
+
+    struct Bin
+    {
+        Vec3 min_ = Vec3(std::numeric_limits<float>::max());
+        Vec3 max_ = Vec3(-std::numeric_limits<float>::max());
+        unsigned count_ = 0;
+    };
+
+    inline void grow(Vec3& min, Vec3& max, const Vec3& p)
+    {
+        min.x = std::min(min.x, p.x);
+        min.y = std::min(min.y, p.y);
+        min.z = std::min(min.z, p.z);
+        max.x = std::max(max.x, p.x);
+        max.y = std::max(max.y, p.y);
+        max.z = std::max(max.z, p.z);
+    }
+
+    inline float halfArea(const Vec3& min, const Vec3& max)
+    {
+        Vec3 d = max - min;
+        if (d.x < 0.f || d.y < 0.f || d.z < 0.f)
+            return 0.f;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+}
+
 BVH::BVH(const Drawable& mesh)
 {
     build(mesh);
@@ -11,168 +45,337 @@ BVH::BVH(const Drawable& mesh)
 
 void BVH::build(const Drawable& mesh)
 {
-    tree_.clear();
+    nodes_.clear();
     triangles_.clear();
+    triVertices_.clear();
+
+    const unsigned numTris = static_cast<unsigned>(mesh.indices_.size() / 3);
+    if (numTris == 0)
+        return;
 
     // Find all triangles
-    std::vector<BVHTriangle> triangles;
+    std::vector<BVHTriangle> triangles(numTris);
+    BuildData data;
+    data.order.resize(numTris);
+    data.boxes.resize(numTris);
+    data.centroids.resize(numTris);
+    for (unsigned i = 0; i < numTris; ++i)
     {
-        int triIndex = 0;
-        for (size_t i = 0; i < mesh.indices_.size(); i+=3)
-        {
-            unsigned i0 = mesh.indices_[i];
-            unsigned i1 = mesh.indices_[i+1];
-            unsigned i2 = mesh.indices_[i+2];
+        loadTriangle(mesh, &mesh.indices_[3 * i], triangles[i]);
+        triangles[i].triIndex_ = static_cast<int>(i);
+        data.order[i] = i;
+        data.boxes[i] = AABB(triangles[i]);
+        data.centroids[i] = barycentre(triangles[i]);
+    }
 
-            triangles.emplace_back(mesh.positions_[i0],
-                                   mesh.positions_[i1],
-                                   mesh.positions_[i2]);
-            triangles.back().triIndex_ = triIndex;
+    // A binary tree with at least one triangle per leaf never needs more than 2n - 1 nodes
+    nodes_.resize(2 * static_cast<size_t>(numTris) - 1);
+    data.nodesUsed = 1;
 
-            if (mesh.textureCoords_.size() > 0)
-            {
-                triangles.back().uv0_ = mesh.textureCoords_[i0];
-                triangles.back().uv1_ = mesh.textureCoords_[i1];
-                triangles.back().uv2_ = mesh.textureCoords_[i2];
-
-                triangles.back().t_ = calculateTangent(
-                    triangles.back().p0_,
-                    triangles.back().p1_,
-                    triangles.back().p2_,
-                    triangles.back().uv0_,
-                    triangles.back().uv1_,
-                    triangles.back().uv2_
-                );
-            }
+    int spawnDepth = 0;
+    for (size_t threads = ThreadPool::shared().getNumThreads(); threads > 1; threads >>= 1)
+        spawnDepth++;
 
-            if (mesh.normals_.size() > 0)
-            {
-                triangles.back().n0_ = mesh.normals_[i0];
-                triangles.back().n1_ = mesh.normals_[i1];
-                triangles.back().n2_ = mesh.normals_[i2];
-            }
+    buildNode(data, 0, 0, numTris, spawnDepth);
+    nodes_.resize(data.nodesUsed);
+    nodes_.shrink_to_fit();
 
-            triIndex++;
-        }
-        triangles.shrink_to_fit();
+    // Store triangles in leaf order so each leaf reads one contiguous run
+    triangles_.resize(numTris);
+    triVertices_.resize(3 * static_cast<size_t>(numTris));
+    for (unsigned i = 0; i < numTris; ++i)
+    {
+        unsigned t = data.order[i];
+        triangles_[i] = triangles[t];
+        triVertices_[3 * i + 0] = mesh.indices_[3 * t + 0];
+        triVertices_[3 * i + 1] = mesh.indices_[3 * t + 1];
+        triVertices_[3 * i + 2] = mesh.indices_[3 * t + 2];
     }
-
-    // Create root and childern
-    tree_.emplace_back(AABB(triangles));
-    buildChildern(triangles);
-    tree_.shrink_to_fit();
-    triangles_.shrink_to_fit();
 }
 
-// create childern in depth first order
-void BVH::buildChildern(std::vector<BVHTriangle>& triangles, int parentIndex, int axis)
+void BVH::refit(const Drawable& mesh)
 {
-    if (triangles.size() == 1)
+    if (nodes_.empty() || mesh.indices_.size() != triVertices_.size())
     {
-        triangles_.push_back(triangles[0]);
-        tree_[parentIndex].triangleIndex_ = static_cast<int>(triangles_.size() - 1);
+        build(mesh);
+        return;
     }
-    else if (triangles.size() > 1)
+
+    for (size_t i = 0; i < triangles_.size(); ++i)
     {
-        Pair pair = split(triangles, axis);
-        axis = (axis + 1) % 3;
+        int triIndex = triangles_[i].triIndex_;
+        const unsigned* v = &triVertices_[3 * i];
+        const unsigned* m = &mesh.indices_[3 * static_cast<size_t>(triIndex)];
+        if (v[0] != m[0] || v[1] != m[1] || v[2] != m[2])
+        {
+            // The connectivity changed under us, the tree no longer matches the mesh
+            build(mesh);
+            return;
+        }
 
-        // Insert left
-        tree_.emplace_back(AABB(pair.first_));
-        buildChildern(pair.first_, static_cast<int>(tree_.size() - 1), axis);
+        loadTriangle(mesh, v, triangles_[i]);
+        triangles_[i].triIndex_ = triIndex;
+    }
 
-        // Insert right
-        tree_.emplace_back(AABB(pair.second_));
-        tree_[parentIndex].rightChildOffset_ = static_cast<int>(tree_.size() - 1);
-        buildChildern(pair.second_, static_cast<int>(tree_.size() - 1), axis);
+    // Children are always allocated after their parent, so a reverse sweep sees both children first
+    for (size_t n = nodes_.size(); n-- > 0;)
+    {
+        Node& node = nodes_[n];
+        node.min_ = Vec3(std::numeric_limits<float>::max());
+        node.max_ = Vec3(-std::numeric_limits<float>::max());
+        if (node.isLeaf())
+        {
+            for (int t = node.leftFirst_; t < node.leftFirst_ + node.count_; ++t)
+            {
+                grow(node.min_, node.max_, triangles_[t].p0_);
+                grow(node.min_, node.max_, triangles_[t].p1_);
+                grow(node.min_, node.max_, triangles_[t].p2_);
+            }
+        }
+        else
+        {
+            const Node& left = nodes_[node.leftFirst_];
+            const Node& right = nodes_[node.leftFirst_ + 1];
+            grow(node.min_, node.max_, left.min_);
+            grow(node.min_, node.max_, left.max_);
+            grow(node.min_, node.max_, right.min_);
+            grow(node.min_, node.max_, right.max_);
+        }
     }
 }
 
-BVH::Pair BVH::split(const std::vector<BVHTriangle> & triangles, int axis) const
+void BVH::loadTriangle(const Drawable& mesh, const unsigned* v, BVHTriangle& triangle) const
 {
-    Pair pair;
-    if (triangles.size() == 0)
-        return pair;
+    triangle = BVHTriangle(mesh.positions_[v[0]], mesh.positions_[v[1]], mesh.positions_[v[2]]);
 
-    // TODO: find better splitting metric
-    float divider = 0.f;
+    if (mesh.textureCoords_.size() > 0)
+    {
+        triangle.uv0_ = mesh.textureCoords_[v[0]];
+        triangle.uv1_ = mesh.textureCoords_[v[1]];
+        triangle.uv2_ = mesh.textureCoords_[v[2]];
 
-    for (auto& t : triangles)
-        divider += barycentre(t)[axis];
+        triangle.t_ = calculateTangent(
+            triangle.p0_,
+            triangle.p1_,
+            triangle.p2_,
+            triangle.uv0_,
+            triangle.uv1_,
+            triangle.uv2_
+        );
+    }
 
-    divider /= static_cast<float>(triangles.size());
+    if (mesh.normals_.size() > 0)
+    {
+        triangle.n0_ = mesh.normals_[v[0]];
+        triangle.n1_ = mesh.normals_[v[1]];
+        triangle.n2_ = mesh.normals_[v[2]];
+    }
+}
 
-    for (auto& t : triangles)
+// Binned surface area heuristic: centroids are dropped into NumBins slabs per axis
+// and the cheapest slab boundary becomes the split plane
+void BVH::buildNode(BuildData& data, unsigned nodeIndex, unsigned first, unsigned count, int spawnDepth)
+{
+    Node& node = nodes_[nodeIndex];
+    node.min_ = Vec3(std::numeric_limits<float>::max());
+    node.max_ = Vec3(-std::numeric_limits<float>::max());
+    Vec3 cMin(std::numeric_limits<float>::max());
+    Vec3 cMax(-std::numeric_limits<float>::max());
+    for (unsigned i = first; i < first + count; ++i)
     {
-        if (barycentre(t)[axis] <= divider)
-            pair.first_.push_back(t);
-        else
-            pair.second_.push_back(t);
+        unsigned t = data.order[i];
+        grow(node.min_, node.max_, data.boxes[t].min_);
+        grow(node.min_, node.max_, data.boxes[t].max_);
+        grow(cMin, cMax, data.centroids[t]);
     }
 
-    if (pair.first_.size() == 0 && pair.second_.size() > 1)
+    node.leftFirst_ = static_cast<int>(first);
+    node.count_ = static_cast<int>(count);
+    if (count == 1)
+        return;
+
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; ++axis)
     {
-        pair.first_.push_back(pair.second_.back());
-        pair.second_.erase(pair.second_.end() - 1);
+        float extent = cMax.data[axis] - cMin.data[axis];
+        if (extent <= 0.f)
+            continue;
+
+        Bin bins[NumBins];
+        float scale = NumBins / extent;
+        for (unsigned i = first; i < first + count; ++i)
+        {
+            unsigned t = data.order[i];
+            int b = std::min(NumBins - 1, static_cast<int>((data.centroids[t].data[axis] - cMin.data[axis]) * scale));
+            bins[b].count_++;
+            grow(bins[b].min_, bins[b].max_, data.boxes[t].min_);
+            grow(bins[b].min_, bins[b].max_, data.boxes[t].max_);
+        }
+
+        // Sweep from both ends to get the cost of every boundary
+        float leftCost[NumBins - 1];
+        Bin left, right;
+        for (int b = 0; b < NumBins - 1; ++b)
+        {
+            if (bins[b].count_ > 0)
+            {
+                left.count_ += bins[b].count_;
+                grow(left.min_, left.max_, bins[b].min_);
+                grow(left.min_, left.max_, bins[b].max_);
+            }
+            leftCost[b] = left.count_ * halfArea(left.min_, left.max_);
+        }
+        for (int b = NumBins - 1; b > 0; --b)
+        {
+            if (bins[b].count_ > 0)
+            {
+                right.count_ += bins[b].count_;
+                grow(right.min_, right.max_, bins[b].min_);
+                grow(right.min_, right.max_, bins[b].max_);
+            }
+
+            unsigned leftCount = count - right.count_;
+            if (leftCount == 0 || right.count_ == 0)
+                continue;
+
+            float cost = leftCost[b - 1] + right.count_ * halfArea(right.min_, right.max_);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
     }
-    else if (pair.second_.size() == 0 && pair.first_.size() > 1)
+
+    unsigned mid = first + count / 2;
+    if (bestAxis != -1)
     {
-        pair.second_.push_back(pair.first_.back());
-        pair.first_.erase(pair.first_.end() - 1);
+        if (count <= MaxLeafSize && bestCost >= count * halfArea(node.min_, node.max_))
+            return; // cheaper to test the triangles directly
+
+        float extent = cMax.data[bestAxis] - cMin.data[bestAxis];
+        float scale = NumBins / extent;
+        auto it = std::partition(data.order.begin() + first, data.order.begin() + first + count,
+            [&](unsigned t)
+            {
+                int b = std::min(NumBins - 1, static_cast<int>((data.centroids[t].data[bestAxis] - cMin.data[bestAxis]) * scale));
+                return b < bestSplit;
+            });
+        mid = static_cast<unsigned>(it - data.order.begin());
     }
+    else if (count <= MaxLeafSize)
+        return; // all centroids coincide, nothing to split on
+
+    unsigned leftIndex = data.nodesUsed.fetch_add(2);
+    node.leftFirst_ = static_cast<int>(leftIndex);
+    node.count_ = 0;
 
-    return pair;
+    unsigned leftCount = mid - first;
+    if (spawnDepth > 0 && count >= ParallelThreshold)
+    {
+        ThreadPool::shared().parallelFor(2, [&](size_t child) {
+            if (child == 0)
+                buildNode(data, leftIndex, first, leftCount, spawnDepth - 1);
+            else
+                buildNode(data, leftIndex + 1, mid, count - leftCount, spawnDepth - 1);
+            });
+    }
+    else
+    {
+        buildNode(data, leftIndex, first, leftCount, 0);
+        buildNode(data, leftIndex + 1, mid, count - leftCount, 0);
+    }
 }
 
 bool BVH::raycast(Ray& ray) const
 {
-    return search(ray);
-}
+    if (nodes_.empty())
+        return false;
 
-bool BVH::search(Ray& ray, int parentIndex) const
-{
-    Ray parentRay = ray;
-    const Node& node = tree_[parentIndex];
-    if (node.isLeaf())
-    {
-        if (triangles_[node.triangleIndex_].raycast(parentRay))
-        {
-            ray = parentRay;
-            return true;
-        }
+    Vec3 invDir(1.f / ray.dir_.x, 1.f / ray.dir_.y, 1.f / ray.dir_.z);
+    float tBest = std::numeric_limits<float>::max();
+    float tEntry = 0.f;
+    if (!intersectBox(nodes_[0], ray, invDir, tBest, tEntry))
         return false;
-    }
-    else if (node.boundingBox_.raycast(parentRay))
-    {
-        Ray leftRay = ray, rightRay = ray;
-        bool hitLeft = false, hitRight = false;
 
-        bool hasLeft = !node.isLeaf() && node.rightChildOffset_ != parentIndex + 1;
-        if (hasLeft)
-            hitLeft = search(leftRay, parentIndex + 1); // search left
-        if (node.rightChildOffset_ != -1) // has right child
-            hitRight = search(rightRay, node.rightChildOffset_); // search right
+    // Depth first with the nearer child on top, boxes entered past the closest hit are skipped
+    std::vector<std::pair<unsigned, float>> stack;
+    stack.reserve(64);
+    stack.emplace_back(0u, tEntry);
 
-        if (hitLeft && hitRight)
+    Ray best = ray;
+    bool hit = false;
+    while (!stack.empty())
+    {
+        std::pair<unsigned, float> entry = stack.back();
+        stack.pop_back();
+        if (entry.second > tBest)
+            continue;
+
+        const Node& node = nodes_[entry.first];
+        if (node.isLeaf())
         {
-            if (leftRay.t_ < rightRay.t_)
-                ray = leftRay;
-            else
-                ray = rightRay;
-            return true;
+            for (int t = node.leftFirst_; t < node.leftFirst_ + node.count_; ++t)
+            {
+                Ray triRay = ray;
+                if (triangles_[t].raycast(triRay) && triRay.t_ < tBest)
+                {
+                    tBest = triRay.t_;
+                    best = triRay;
+                    hit = true;
+                }
+            }
+            continue;
         }
-        else if (hitLeft)
+
+        unsigned nearChild = static_cast<unsigned>(node.leftFirst_), farChild = nearChild + 1;
+        float tNear = 0.f, tFar = 0.f;
+        bool hitNear = intersectBox(nodes_[nearChild], ray, invDir, tBest, tNear);
+        bool hitFar = intersectBox(nodes_[farChild], ray, invDir, tBest, tFar);
+        if (hitNear && hitFar && tFar < tNear)
         {
-            ray = leftRay;
-            return true;
+            std::swap(nearChild, farChild);
+            std::swap(tNear, tFar);
         }
-        else if (hitRight)
+
+        if (hitFar)
+            stack.emplace_back(farChild, tFar);
+        if (hitNear)
+            stack.emplace_back(nearChild, tNear);
+    }
+
+    if (hit)
+        ray = best;
+    return hit;
+}
+
+// Slab test against the part of the ray in [0, tMax]
+bool BVH::intersectBox(const Node& node, const Ray& ray, const Vec3& invDir, float tMax, float& tEntry) const
+{
+    float tNear = 0.f, tFar = tMax;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float origin = ray.origin_.data[axis];
+        if (ray.dir_.data[axis] == 0.f)
         {
-            ray = rightRay;
-            return true;
+            if (origin < node.min_.data[axis] || origin > node.max_.data[axis])
+                return false;
+            continue;
         }
-        else
+
+        float t0 = (node.min_.data[axis] - origin) * invDir.data[axis];
+        float t1 = (node.max_.data[axis] - origin) * invDir.data[axis];
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+        if (tNear > tFar)
             return false;
     }
-    return false;
+
+    tEntry = tNear;
+    return true;
 }
@@ -3,6 +3,7 @@
 #include "AABB.h"
 #include "Drawable.h"
 
+#include <atomic>
 #include <vector>
 
 
@@ -13,37 +14,40 @@ public:
     BVH(const Drawable& obj);
 
     void build(const Drawable& obj);
+    // Moves the triangles to the mesh's current positions and recomputes the boxes bottom up.
+    // Falls back to a full build if the triangle count changed.
+    void refit(const Drawable& obj);
     bool raycast(Ray& ray) const;
 
 private:
-    struct Pair
-    {
-        std::vector<BVHTriangle> first_;
-        std::vector<BVHTriangle> second_;
-    };
-
+    // 32 bytes so two siblings share one cache line
     struct Node
     {
-        AABB boundingBox_;
-        int triangleIndex_ = -1;
-        int rightChildOffset_ = -1;
-
-        Node() = default;
-
-        Node(AABB boundingBox, int triangleIndex = -1, int rightChildOffset = -1) :
-            boundingBox_(boundingBox), triangleIndex_(triangleIndex), rightChildOffset_(rightChildOffset)
-        {}
+        Vec3 min_;
+        int leftFirst_ = 0; // left child index for inner nodes, first triangle for leaves
+        Vec3 max_;
+        int count_ = 0;     // number of triangles, 0 for inner nodes
 
         inline bool isLeaf() const
         {
-            return triangleIndex_ != -1;
+            return count_ > 0;
         }
     };
+    static_assert(sizeof(Node) == 32, "BVH nodes should stay 32 bytes");
+
+    struct BuildData
+    {
+        std::vector<unsigned> order;
+        std::vector<AABB> boxes;
+        std::vector<Vec3> centroids;
+        std::atomic<unsigned> nodesUsed{ 0 };
+    };
 
-    void buildChildern(std::vector<BVHTriangle>& triangles, int parentIndex = 0, int axis = 0);
-    BVH::Pair split(const std::vector<BVHTriangle>& triangles, int axis) const;
-    bool search(Ray& ray, int parentIndex = 0) const;
+    void loadTriangle(const Drawable& mesh, const unsigned* v, BVHTriangle& triangle) const;
+    void buildNode(BuildData& data, unsigned nodeIndex, unsigned first, unsigned count, int spawnDepth);
+    bool intersectBox(const Node& node, const Ray& ray, const Vec3& invDir, float tMax, float& tEntry) const;
 
-    std::vector<Node> tree_;
-    std::vector<BVHTriangle> triangles_;
+    std::vector<Node> nodes_;
+    std::vector<BVHTriangle> triangles_; // in leaf order
+    std::vector<unsigned> triVertices_;  // mesh indices of each stored triangle, used by refit
 };
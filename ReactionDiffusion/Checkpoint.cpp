@@ -0,0 +1,255 @@
+#include "Checkpoint.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+
+namespace
+{
+    const char Magic[8] = { 'R', 'D', 'P', 'G', 'C', 'K', 'P', 'T' };
+    const size_t Alignment = 64; // sections start on a cache line so their floats can be read in place
+
+    size_t alignUp(size_t offset)
+    {
+        return (offset + Alignment - 1) / Alignment * Alignment;
+    }
+}
+
+Checkpoint::~Checkpoint()
+{
+    close();
+}
+
+// FNV-1a over 8 byte words with an extra shift to fold the high bits down, fast enough to stay
+// well below the cost of the disk
+uint64_t Checkpoint::checksum(const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+void Checkpoint::add(Section section, const void* data, size_t size)
+{
+    buffers_.push_back({ section, data, size });
+}
+
+bool Checkpoint::write(const std::string& fileName)
+{
+    // Lay the sections out after the header and the table
+    std::vector<char> head(sizeof(Header) + buffers_.size() * sizeof(Entry));
+    std::vector<Entry> entries(buffers_.size());
+    size_t offset = alignUp(head.size());
+    for (size_t i = 0; i < buffers_.size(); ++i)
+    {
+        entries[i].section = static_cast<uint32_t>(buffers_[i].section);
+        entries[i].reserved = 0;
+        entries[i].offset = offset;
+        entries[i].size = buffers_[i].size;
+        entries[i].checksum = checksum(buffers_[i].data, buffers_[i].size);
+        offset = alignUp(offset + buffers_[i].size);
+    }
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.sectionCount = static_cast<uint32_t>(entries.size());
+    header.fileSize = offset;
+    header.tableChecksum = checksum(entries.data(), entries.size() * sizeof(Entry));
+    std::memcpy(head.data(), &header, sizeof(Header));
+    if (!entries.empty())
+        std::memcpy(head.data() + sizeof(Header), entries.data(), entries.size() * sizeof(Entry));
+
+    // Header, sections and the padding between them go out in one gathered write
+    static const char padding[Alignment] = {};
+    std::vector<std::pair<const char*, size_t>> pieces;
+    pieces.emplace_back(head.data(), head.size());
+    size_t position = head.size();
+    for (size_t i = 0; i < buffers_.size(); ++i)
+    {
+        if (entries[i].offset > position)
+            pieces.emplace_back(padding, static_cast<size_t>(entries[i].offset - position));
+        if (buffers_[i].size > 0)
+            pieces.emplace_back(static_cast<const char*>(buffers_[i].data), buffers_[i].size);
+        position = static_cast<size_t>(entries[i].offset + entries[i].size);
+    }
+    if (offset > position)
+        pieces.emplace_back(padding, offset - position);
+    buffers_.clear();
+
+    // Written next to the target and renamed over it once complete, so a crash mid write
+    // leaves the previous checkpoint intact
+    const std::string tempName = fileName + ".tmp";
+#ifdef _WIN32
+    HANDLE file = CreateFileA(tempName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return fail("Cannot create " + tempName);
+
+    bool written = true;
+    for (auto& piece : pieces)
+    {
+        const char* data = piece.first;
+        size_t left = piece.second;
+        while (written && left > 0)
+        {
+            DWORD count = 0;
+            DWORD chunk = static_cast<DWORD>(std::min<size_t>(left, 1u << 30));
+            written = WriteFile(file, data, chunk, &count, nullptr) && count > 0;
+            data += count;
+            left -= count;
+        }
+    }
+    written = FlushFileBuffers(file) && written;
+    CloseHandle(file);
+    written = written && MoveFileExA(tempName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    int file = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+        return fail("Cannot create " + tempName);
+
+    std::vector<iovec> vecs(pieces.size());
+    for (size_t i = 0; i < pieces.size(); ++i)
+        vecs[i] = { const_cast<char*>(pieces[i].first), pieces[i].second };
+
+    // writev may stop early on large files, carry on from wherever it got to
+    bool written = true;
+    size_t first = 0;
+    while (written && first < vecs.size())
+    {
+        int count = static_cast<int>(std::min<size_t>(vecs.size() - first, IOV_MAX));
+        ssize_t result = ::writev(file, vecs.data() + first, count);
+        written = result > 0;
+        size_t done = written ? static_cast<size_t>(result) : 0;
+        while (first < vecs.size() && done >= vecs[first].iov_len)
+            done -= vecs[first++].iov_len;
+        if (first < vecs.size() && done > 0)
+        {
+            vecs[first].iov_base = static_cast<char*>(vecs[first].iov_base) + done;
+            vecs[first].iov_len -= done;
+        }
+        while (first < vecs.size() && vecs[first].iov_len == 0)
+            first++;
+    }
+    written = ::fsync(file) == 0 && written;
+    written = ::close(file) == 0 && written;
+    written = written && ::rename(tempName.c_str(), fileName.c_str()) == 0;
+#endif
+
+    if (!written)
+    {
+        std::remove(tempName.c_str());
+        return fail("Failed writing " + fileName);
+    }
+    return true;
+}
+
+bool Checkpoint::isCheckpoint(const std::string& fileName)
+{
+    char magic[sizeof(Magic)] = {};
+    std::ifstream file(fileName, std::ios::binary);
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+bool Checkpoint::open(const std::string& fileName)
+{
+    close();
+
+    if (!file_.open(fileName))
+        return fail(file_.error());
+    if (file_.size() < sizeof(Header))
+        return fail(fileName + " is too small to be a checkpoint");
+    mapped_ = file_.data();
+    mappedSize_ = file_.size();
+
+    Header header;
+    std::memcpy(&header, mapped_, sizeof(Header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        return fail(fileName + " is not a checkpoint");
+    if (header.version == 0 || header.version > Version)
+        return fail(fileName + " is checkpoint version " + std::to_string(header.version) + ", this build reads up to " + std::to_string(Version));
+    if (header.fileSize != mappedSize_)
+        return fail(fileName + " is truncated");
+
+    const size_t tableSize = static_cast<size_t>(header.sectionCount) * sizeof(Entry);
+    if (sizeof(Header) + tableSize > mappedSize_)
+        return fail(fileName + " has a damaged section table");
+    entries_.resize(header.sectionCount);
+    if (tableSize > 0)
+        std::memcpy(entries_.data(), mapped_ + sizeof(Header), tableSize);
+    if (checksum(entries_.data(), tableSize) != header.tableChecksum)
+        return fail(fileName + " has a damaged section table");
+
+    for (auto& entry : entries_)
+    {
+        if (entry.offset > mappedSize_ || entry.size > mappedSize_ - entry.offset)
+            return fail(fileName + " has a section outside the file");
+        if (checksum(mapped_ + entry.offset, static_cast<size_t>(entry.size)) != entry.checksum)
+            return fail(fileName + " fails the checksum of section " + std::to_string(entry.section));
+    }
+    return true;
+}
+
+void Checkpoint::close()
+{
+    file_.close();
+    mapped_ = nullptr;
+    mappedSize_ = 0;
+    entries_.clear();
+}
+
+const Checkpoint::Entry* Checkpoint::find(Section section) const
+{
+    for (auto& entry : entries_)
+        if (entry.section == static_cast<uint32_t>(section))
+            return &entry;
+    return nullptr;
+}
+
+bool Checkpoint::has(Section section) const
+{
+    return find(section) != nullptr;
+}
+
+const void* Checkpoint::data(Section section) const
+{
+    const Entry* entry = find(section);
+    return entry ? mapped_ + entry->offset : nullptr;
+}
+
+size_t Checkpoint::size(Section section) const
+{
+    const Entry* entry = find(section);
+    return entry ? static_cast<size_t>(entry->size) : 0;
+}
+
+const std::string& Checkpoint::error() const
+{
+    return error_;
+}
+
+bool Checkpoint::fail(const std::string& error)
+{
+    error_ = error;
+    close();
+    return false;
+}
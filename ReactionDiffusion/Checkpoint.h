@@ -0,0 +1,95 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Binary, versioned simulation checkpoint. A header and a section table are followed by the
+// sections' raw bytes, each with its own checksum. It is saved with one gathered write to a
+// temporary file that is renamed over the target, and read through a read only memory mapping
+// so sections are used in place instead of parsed. Values are stored in the machine's byte order.
+class Checkpoint
+{
+public:
+    enum class Section : uint32_t
+    {
+        State = 1,     // Checkpoint::State
+        Morphogens,    // cellCount * morphCount floats, cell major
+        Tangents,      // morphCount * tangentCount * 3 floats, morphogen major
+        Tensors,       // morphCount * tangentCount * 2 floats, t0 then t1 of each entry
+        Params,        // parameter regions, see Simulation::writeCheckpoint
+        Positions,     // vertex positions of a mesh domain, 3 floats each
+        Indices,       // triangle indices of a mesh domain
+        TextureCoords, // texture coordinates of a mesh domain, 2 floats each
+    };
+
+    struct State
+    {
+        uint64_t cellCount = 0;
+        uint64_t tangentCount = 0;
+        uint32_t morphCount = 0;
+        int32_t stepCount = 0;
+        uint64_t growthCount = 0;
+        uint64_t rngSeed = 0;
+    };
+
+    static constexpr uint32_t Version = 1;
+
+    Checkpoint() = default;
+    ~Checkpoint();
+
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    // The added memory has to stay alive until write returns
+    void add(Section section, const void* data, size_t size);
+    bool write(const std::string& fileName);
+
+    static bool isCheckpoint(const std::string& fileName);
+    // Maps the file and verifies the header, the section table and every checksum
+    bool open(const std::string& fileName);
+    void close();
+    bool has(Section section) const;
+    const void* data(Section section) const;
+    size_t size(Section section) const;
+    const std::string& error() const;
+    static uint64_t checksum(const void* data, size_t size);
+
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t fileSize;
+        uint64_t tableChecksum;
+    };
+
+    struct Entry
+    {
+        uint32_t section;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    struct Buffer
+    {
+        Section section;
+        const void* data;
+        size_t size;
+    };
+
+    const Entry* find(Section section) const;
+    bool fail(const std::string& error);
+
+    std::vector<Buffer> buffers_;
+    std::vector<Entry> entries_;
+    MappedFile file_;
+    const char* mapped_ = nullptr;
+    size_t mappedSize_ = 0;
+    std::string error_;
+};
@@ -60,6 +60,7 @@ void CmdArgsParser::addDefaultArgs()
     addArg("ShadersPath", "path to where shaders are stored", "./");
     addArg("ColorMap", "", "color map file which translates concentrations to colors");
     addArg("SimFile", "starting morphogen concentration from file", "");
+    addArg("Resume", "continue from a checkpoint, the config's auto checkpoint when no file is given", "");
     addArg("rdModel", "reaction-diffusion PDEs", "");
     addArg("SaveOnExit", "save model on exit", "false");
     addArg("Steps", "sim Steps until exit", "0");
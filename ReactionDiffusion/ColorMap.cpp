@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <fstream>
+#include <algorithm>
 
 
 ColorMap::ColorMap(const std::string& filename, const std::string& path)
@@ -44,6 +45,7 @@ void ColorMap::setFilenameAndPath(const std::string& filename, const std::string
 {
     colorMarks_.clear();
     data_.clear();
+    lookupTable_ = LookupTable();
 
     // parse path, name, and exts
     path_    = path;
@@ -201,6 +203,7 @@ bool ColorMap::loadTexture()
         data_.clear();
         for (char c : bytes)
             data_.push_back((unsigned char)c);
+        lookupTable_ = LookupTable(data_);
 
         texture_ = Textures::create1DTexture(bytes);
     }
@@ -272,12 +275,18 @@ void ColorMap::update(bool fromcolorMarks_)
         }
     }
 
+    lookupTable_ = LookupTable(data_);
     texture_ = Textures::create1DTexture(data_);
 }
 
 void ColorMap::sample(float t, unsigned char& r, unsigned char& g, unsigned char& b, bool linearBlend)
 {
-    if (data_.size() == 0)
+    sample(data_, t, r, g, b, linearBlend);
+}
+
+void ColorMap::sample(const std::vector<unsigned char>& data, float t, unsigned char& r, unsigned char& g, unsigned char& b, bool linearBlend)
+{
+    if (data.size() == 0)
         return;
 
     //clamp from 0 to 1
@@ -286,21 +295,21 @@ void ColorMap::sample(float t, unsigned char& r, unsigned char& g, unsigned char
     // Handle edge cases
     if (t == 1.f)
     {
-        r = data_[data_.size() - 3];
-        g = data_[data_.size() - 2];
-        b = data_[data_.size() - 1];
+        r = data[data.size() - 3];
+        g = data[data.size() - 2];
+        b = data[data.size() - 1];
         return;
     }
     else if (t == 0.f)
     {
-        r = data_[0];
-        g = data_[1];
-        b = data_[2];
+        r = data[0];
+        g = data[1];
+        b = data[2];
         return;
     }
 
     // Get samples
-    unsigned numColors = static_cast<unsigned>(data_.size()) / 3;
+    unsigned numColors = static_cast<unsigned>(data.size()) / 3;
     unsigned lastIndex = numColors - 1;
     float c0 = lastIndex * t;
     unsigned s0 = (unsigned)c0;
@@ -312,15 +321,77 @@ void ColorMap::sample(float t, unsigned char& r, unsigned char& g, unsigned char
         float sRange = (float(s1) / (float(lastIndex)) - v0);
         t = (t - v0) / sRange;
 
-        r = (unsigned char)(t * data_[s1 * 3] + (1.f - t) * data_[s0 * 3]);
-        g = (unsigned char)(t * data_[s1 * 3 + 1] + (1.f - t) * data_[s0 * 3 + 1]);
-        b = (unsigned char)(t * data_[s1 * 3 + 2] + (1.f - t) * data_[s0 * 3 + 2]);
+        r = (unsigned char)(t * data[s1 * 3] + (1.f - t) * data[s0 * 3]);
+        g = (unsigned char)(t * data[s1 * 3 + 1] + (1.f - t) * data[s0 * 3 + 1]);
+        b = (unsigned char)(t * data[s1 * 3 + 2] + (1.f - t) * data[s0 * 3 + 2]);
     }
     else
     {
-        r = data_[s0];
-        g = data_[s0 + 1];
-        b = data_[s0 + 2];
+        r = data[s0];
+        g = data[s0 + 1];
+        b = data[s0 + 2];
+    }
+}
+
+const ColorMap::LookupTable& ColorMap::lookupTable() const
+{
+    return lookupTable_;
+}
+
+ColorMap::LookupTable::LookupTable(const std::vector<unsigned char>& data)
+{
+    if (data.size() == 0)
+        return;
+
+    rgb_.resize(Size * 3);
+    for (unsigned i = 0; i < Size; ++i)
+        ColorMap::sample(data, float(i) / float(Size - 1), rgb_[i * 3], rgb_[i * 3 + 1], rgb_[i * 3 + 2]);
+}
+
+bool ColorMap::LookupTable::empty() const
+{
+    return rgb_.size() == 0;
+}
+
+void ColorMap::LookupTable::sample(float t, unsigned char& r, unsigned char& g, unsigned char& b) const
+{
+    unsigned char rgb[3] = { r, g, b };
+    map(&t, 1, 1.f, rgb);
+    r = rgb[0];
+    g = rgb[1];
+    b = rgb[2];
+}
+
+void ColorMap::LookupTable::map(const float* values, size_t count, float normCoef, unsigned char* rgb) const
+{
+    if (rgb_.size() == 0)
+        return;
+
+    // The entries are found a block at a time in a branch free loop the compiler vectorizes,
+    // then copied out of the table. NaNs take the first entry.
+    const float scale = float(Size - 1) / normCoef;
+    const float last = float(Size - 1);
+    const size_t blockSize = 256;
+    unsigned entries[blockSize];
+    for (size_t start = 0; start < count; start += blockSize)
+    {
+        const size_t end = std::min(start + blockSize, count);
+        for (size_t i = start; i < end; ++i)
+        {
+            float t = values[i] * scale + 0.5f;
+            t = t > 0.f ? t : 0.f;
+            t = t < last ? t : last;
+            entries[i - start] = static_cast<unsigned>(t);
+        }
+
+        unsigned char* out = rgb + start * 3;
+        for (size_t i = 0; i < end - start; ++i)
+        {
+            const unsigned char* entry = &rgb_[entries[i] * 3];
+            out[i * 3] = entry[0];
+            out[i * 3 + 1] = entry[1];
+            out[i * 3 + 2] = entry[2];
+        }
     }
 }
 
@@ -2,11 +2,31 @@
 #include "Textures.h"
 
 #include <string>
+#include <vector>
 
 
 class ColorMap
 {
 public:
+    // sample() tabulated at Size evenly spaced values for colouring many values at once. Values
+    // go to the nearest entry, so colours are within a step of 1 / (Size - 1) of sample()'s.
+    class LookupTable
+    {
+    public:
+        static constexpr unsigned Size = 4096;
+
+        LookupTable() = default;
+        explicit LookupTable(const std::vector<unsigned char>& data);
+
+        bool empty() const;
+        void sample(float t, unsigned char& r, unsigned char& g, unsigned char& b) const;
+        // Writes 3 bytes to rgb for each of values[i] / normCoef
+        void map(const float* values, size_t count, float normCoef, unsigned char* rgb) const;
+
+    private:
+        std::vector<unsigned char> rgb_;
+    };
+
     ColorMap() = default;
     ColorMap(const std::string& filename, const std::string& path);
 
@@ -25,6 +45,8 @@ public:
     void setExtToColors();
     void setExtToMap();
     void sample(float t, unsigned char& r, unsigned char& g, unsigned char& b, bool linearBlending = true);
+    static void sample(const std::vector<unsigned char>& data, float t, unsigned char& r, unsigned char& g, unsigned char& b, bool linearBlending = true);
+    const LookupTable& lookupTable() const;
     void update(bool fromColorMarks = false);
     bool loadTexture();
 
@@ -36,6 +58,7 @@ private:
     std::string filename_;
     std::string path_;
     std::string ext_;
+    LookupTable lookupTable_;   // rebuilt whenever data_ is
     Textures::Texture1D texture_;
     bool initialized_ = false;
     bool tracking_ = false;
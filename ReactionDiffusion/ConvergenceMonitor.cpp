@@ -0,0 +1,109 @@
+#include "ConvergenceMonitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+
+bool ConvergenceMonitor::begin(int stepCount)
+{
+    measuring_ = info.enabled && info.interval > 0 && stepCount % info.interval == 0;
+    return measuring_;
+}
+
+bool ConvergenceMonitor::measuring() const
+{
+    return measuring_;
+}
+
+bool ConvergenceMonitor::finish(int stepCount, const FieldStats& stats)
+{
+    if (!measuring_)
+        return false;
+    measuring_ = false;
+
+    bool converged = true, homogeneous = true, blownUp = stats.nonFinite();
+    float maxChange = 0.f;
+    for (auto& morphogen : stats.morphogens())
+    {
+        if (!(morphogen.rmsChange <= maxChange))
+            maxChange = static_cast<float>(morphogen.rmsChange); // lets a NaN through to the report
+
+        converged &= morphogen.rmsChange <= info.absTolerance + info.relTolerance * morphogen.rms;
+        homogeneous &= morphogen.max - morphogen.min <= info.homogeneousTolerance;
+        blownUp |= std::max(std::abs(morphogen.min), std::abs(morphogen.max)) > info.blowUpLimit;
+    }
+    maxChange_ = maxChange;
+
+    convergedChecks_ = converged ? convergedChecks_ + 1 : 0;
+    homogeneousChecks_ = homogeneous ? homogeneousChecks_ + 1 : 0;
+
+    // A flat field is also converged, so it is checked first to tell the two apart
+    State state = State::Running;
+    if (blownUp)
+        state = State::BlownUp;
+    else if (homogeneousChecks_ >= info.patience)
+        state = State::Homogeneous;
+    else if (convergedChecks_ >= info.patience)
+        state = State::Converged;
+
+    if (state == state_)
+        return false;
+
+    state_ = state;
+    std::stringstream ss;
+    ss << stateName(state_) << " at step " << stepCount << " (max rms change " << maxChange_ << ")";
+    report_ = ss.str();
+    return true;
+}
+
+void ConvergenceMonitor::reset()
+{
+    measuring_ = false;
+    convergedChecks_ = 0;
+    homogeneousChecks_ = 0;
+    maxChange_ = 0.f;
+    state_ = State::Running;
+    report_.clear();
+}
+
+ConvergenceMonitor::State ConvergenceMonitor::state() const
+{
+    return state_;
+}
+
+bool ConvergenceMonitor::finished() const
+{
+    return state_ != State::Running;
+}
+
+const std::string& ConvergenceMonitor::report() const
+{
+    return report_;
+}
+
+float ConvergenceMonitor::maxChange() const
+{
+    return maxChange_;
+}
+
+const char* ConvergenceMonitor::stateName(State state)
+{
+    switch (state)
+    {
+    case State::Converged:   return "converged";
+    case State::Homogeneous: return "homogeneous";
+    case State::BlownUp:     return "blown up";
+    default:                 return "running";
+    }
+}
+
+const char* ConvergenceMonitor::actionName(Action action)
+{
+    switch (action)
+    {
+    case Action::Report:     return "report";
+    case Action::Checkpoint: return "checkpoint";
+    default:                 return "stop";
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "FieldStats.h"
+
+#include <string>
+
+
+// Looks at how much the morphogens change over a step every few steps and decides when a run
+// has settled, gone flat or blown up. The numbers come from the step's FieldStats.
+class ConvergenceMonitor
+{
+public:
+    enum class Action { Report, Checkpoint, Stop };
+    enum class State { Running, Converged, Homogeneous, BlownUp };
+
+    struct Info
+    {
+        bool enabled = false;
+        int interval = 100;                 // steps between checks
+        float absTolerance = 1e-7f;         // converged once every morphogen's rms change per step is
+        float relTolerance = 1e-6f;         // below absTolerance + relTolerance * its rms value
+        int patience = 5;                   // consecutive checks a state has to hold before it counts
+        float homogeneousTolerance = 1e-4f; // max - min below which a morphogen counts as flat
+        float blowUpLimit = 1e6f;           // any magnitude above this, or a NaN/Inf, is a blow up
+        Action action = Action::Stop;
+    };
+
+    ConvergenceMonitor() = default;
+
+    // Decides if the coming step is measured
+    bool begin(int stepCount);
+    bool measuring() const;
+    // Returns true when the state changed
+    bool finish(int stepCount, const FieldStats& stats);
+    void reset();
+
+    State state() const;
+    bool finished() const;
+    const std::string& report() const;
+    float maxChange() const;
+    static const char* stateName(State state);
+    static const char* actionName(Action action);
+
+    Info info;
+
+private:
+    bool measuring_ = false;
+    int convergedChecks_ = 0;
+    int homogeneousChecks_ = 0;
+    float maxChange_ = 0.f;
+    State state_ = State::Running;
+    std::string report_;
+};
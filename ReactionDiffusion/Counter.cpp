@@ -16,6 +16,11 @@ void Counter::reset()
 	counts_ = 0;
 }
 
+void Counter::setCount(unsigned long long count)
+{
+	counts_ = count;
+}
+
 void Counter::count()
 {
 	counts_++;
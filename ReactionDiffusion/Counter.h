@@ -10,6 +10,7 @@ public:
 	void count();
 	void setDuration(unsigned long long duration);
 	void reset();
+	void setCount(unsigned long long count);
 	bool elapsed() const;
 	bool elapsedAndReset();
 	bool countElapsedAndReset();
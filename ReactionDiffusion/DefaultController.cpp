@@ -170,6 +170,7 @@ void DefaultController::notifyMouseMoveEvent(double x, double y)
                 if (rightMouseButton_)
                 {
                     domain->paint(v_i, pos, window_->getGUI()->paintRadius_);
+                    sim_->requestFullSweep();
                     sim_->updateColorsFromRam = true;
                     sim_->updateColors();
                     painted_ = true;
@@ -101,6 +101,7 @@ void Drawable::initVBOs(GLsizei newIndexCount)
         this->indexCount_ = static_cast<GLsizei>(indices_.size());
     else
         this->indexCount_ = newIndexCount;
+    vertexCount_ = static_cast<unsigned>(positions_.size());
 
     posID_ = createVBO(GL_ARRAY_BUFFER, positions_);
     norID_ = createVBO(GL_ARRAY_BUFFER, normals_);
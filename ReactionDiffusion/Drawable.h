@@ -11,6 +11,7 @@
 #include <glad/glad.h>
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 
 class Shader;
@@ -50,6 +51,7 @@ public:
     std::unique_ptr<Shader> shader_;
     bool visible_ = true;
     unsigned indexCount_ = 0;
+    unsigned vertexCount_ = 0; // vertices the attribute buffers were created with
 
     GLuint posID_ = 0;
     GLuint norID_ = 0;
@@ -86,6 +88,11 @@ public:
         if (count == 0)
             count = data.size();
 
+        // Data that grew since the buffers were created is cut off until they are rebuilt
+        if (offset >= vertexCount_)
+            return;
+        count = std::min<size_t>(count, vertexCount_ - offset);
+
         glBindBuffer(GL_ARRAY_BUFFER, targetID);
         glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(T), count * sizeof(T), &data[offset]);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
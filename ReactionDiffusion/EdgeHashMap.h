@@ -0,0 +1,145 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Open addressing hash map from a 64 bit edge key to an edge index.
+// Slots live in one flat array and collisions are resolved with linear probing,
+// so a lookup touches a handful of adjacent cache lines instead of chasing node pointers.
+class EdgeHashMap
+{
+public:
+    using Key = uint64_t;
+    static constexpr Key EmptyKey = ~Key(0);
+
+    EdgeHashMap() = default;
+
+    void reserve(size_t count)
+    {
+        size_t capacity = 16;
+        while (capacity * 3 < count * 4) // keep the load factor under 0.75
+            capacity <<= 1;
+
+        if (capacity > slots_.size())
+            rehash(capacity);
+    }
+
+    void clear()
+    {
+        slots_.clear();
+        size_ = 0;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    size_t count(Key key) const
+    {
+        return find(key) != -1 ? 1 : 0;
+    }
+
+    // Returns the stored value or -1 if the key is missing
+    int find(Key key) const
+    {
+        if (slots_.empty())
+            return -1;
+
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash(key) & mask; ; i = (i + 1) & mask)
+        {
+            const Slot& slot = slots_[i];
+            if (slot.key == key)
+                return slot.value;
+            if (slot.key == EmptyKey)
+                return -1;
+        }
+    }
+
+    // Inserts the key or overwrites its value
+    void insert(Key key, int value)
+    {
+        if ((size_ + 1) * 4 > slots_.size() * 3)
+            rehash(slots_.empty() ? 16 : slots_.size() * 2);
+
+        size_t mask = slots_.size() - 1;
+        size_t i = hash(key) & mask;
+        while (slots_[i].key != EmptyKey && slots_[i].key != key)
+            i = (i + 1) & mask;
+
+        if (slots_[i].key == EmptyKey)
+            size_++;
+        slots_[i].key = key;
+        slots_[i].value = value;
+    }
+
+    // Removes the key and shifts the rest of its probe run back so lookups need no tombstones
+    void erase(Key key)
+    {
+        if (slots_.empty())
+            return;
+
+        size_t mask = slots_.size() - 1;
+        size_t i = hash(key) & mask;
+        while (slots_[i].key != key)
+        {
+            if (slots_[i].key == EmptyKey)
+                return;
+            i = (i + 1) & mask;
+        }
+
+        for (size_t j = (i + 1) & mask; slots_[j].key != EmptyKey; j = (j + 1) & mask)
+        {
+            // Move j into the hole at i unless its home slot lies cyclically in (i, j]
+            size_t home = hash(slots_[j].key) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask))
+            {
+                slots_[i] = slots_[j];
+                i = j;
+            }
+        }
+        slots_[i].key = EmptyKey;
+        size_--;
+    }
+
+private:
+    struct Slot
+    {
+        Key key = EmptyKey;
+        int value = -1;
+    };
+
+    static size_t hash(Key key)
+    {
+        // splitmix64 finalizer, vertex indices are sequential so the raw key clusters badly
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ull;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebull;
+        key ^= key >> 31;
+        return static_cast<size_t>(key);
+    }
+
+    void rehash(size_t capacity)
+    {
+        std::vector<Slot> old(capacity);
+        old.swap(slots_);
+
+        size_t mask = slots_.size() - 1;
+        for (const Slot& slot : old)
+        {
+            if (slot.key == EmptyKey)
+                continue;
+
+            size_t i = hash(slot.key) & mask;
+            while (slots_[i].key != EmptyKey)
+                i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+};
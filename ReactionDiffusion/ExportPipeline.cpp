@@ -0,0 +1,319 @@
+#include "ExportPipeline.h"
+#include "Checkpoint.h"
+#include "Grid.h"
+#include "Utils.h"
+#include "LOG.h"
+
+#include <algorithm>
+#include <filesystem>
+
+
+namespace
+{
+    double msBetween(ExportPipeline::Clock::time_point from, ExportPipeline::Clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+}
+
+ExportPipeline::~ExportPipeline()
+{
+    stop();
+}
+
+void ExportPipeline::start(const ExportInfo& info)
+{
+    stop();
+
+    info_ = info;
+    info_.writers = std::max(info_.writers, 1);
+    info_.queueSize = std::max(info_.queueSize, 1);
+    stopping_ = false;
+    submitted_ = written_ = dropped_ = degraded_ = 0;
+    bytes_ = 0;
+    stallMs_ = latencyMs_ = maxLatencyMs_ = 0.0;
+    seriesHash_ = 0;
+    seriesFile_.clear();
+    seriesSubmitted_ = seriesAppended_ = 0;
+
+    for (int i = 0; i < info_.writers; ++i)
+        writers_.emplace_back(&ExportPipeline::writerLoop, this);
+}
+
+void ExportPipeline::stop()
+{
+    finish();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queueVar_.notify_all();
+
+    for (auto& writer : writers_)
+        writer.join();
+    writers_.clear();
+
+    if (series_.isOpen() && !series_.close())
+        LOG(series_.error());
+}
+
+bool ExportPipeline::running() const
+{
+    return !writers_.empty();
+}
+
+ExportPipeline::Frame* ExportPipeline::acquire()
+{
+    const Clock::time_point start = Clock::now();
+    const size_t queueSize = static_cast<size_t>(info_.queueSize);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.size() >= queueSize && info_.backpressure == ExportInfo::Backpressure::Drop)
+    {
+        dropped_++;
+        return nullptr;
+    }
+    spaceVar_.wait(lock, [&] { return queue_.size() < queueSize; });
+
+    // Frames keep their buffers between uses, so a steady recording stops allocating
+    Frame* frame = nullptr;
+    if (free_.empty())
+    {
+        frames_.push_back(std::make_unique<Frame>());
+        frame = frames_.back().get();
+    }
+    else
+    {
+        frame = free_.back();
+        free_.pop_back();
+    }
+
+    frame->screenshot = false;
+    frame->texture = false;
+    frame->ply = false;
+    frame->series = false;
+    frame->seriesTopologyChanged = false;
+    frame->degraded = info_.backpressure == ExportInfo::Backpressure::Degrade && queue_.size() * 2 >= queueSize;
+    frame->acquired = start;
+    return frame;
+}
+
+void ExportPipeline::submit(Frame* frame)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        frame->queued = Clock::now();
+        stallMs_ += msBetween(frame->acquired, frame->queued);
+        if (submitted_++ == 0)
+            firstQueued_ = frame->queued;
+        if (frame->degraded)
+            degraded_++;
+        if (frame->series)
+            frame->sequence = seriesSubmitted_++;
+        queue_.push_back(frame);
+    }
+    queueVar_.notify_one();
+}
+
+void ExportPipeline::finish()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneVar_.wait(lock, [&] { return queue_.empty() && active_ == 0; });
+}
+
+void ExportPipeline::snapshotSeries(Frame& frame, SimulationDomain& domain, size_t morphCount, int stepCount, const std::string& fileName)
+{
+    const std::vector<Cell>& cells = domain.getReadFromCells();
+    const size_t cellCount = cells.size();
+
+    // A changed mesh or grid resolution starts a new topology record
+    uint64_t hash = cellCount;
+    Grid* grid = dynamic_cast<Grid*>(&domain);
+    if (grid)
+        hash ^= (static_cast<uint64_t>(grid->getXRes()) << 32 | static_cast<uint32_t>(grid->getYRes())) * 0x9e3779b97f4a7c15ull;
+    else
+    {
+        static_assert(sizeof(Vec3) == 3 * sizeof(float), "positions are written as packed floats");
+        hash ^= Checkpoint::checksum(domain.positions_.data(), domain.positions_.size() * sizeof(Vec3));
+        hash = hash * 31 + Checkpoint::checksum(domain.indices_.data(), domain.indices_.size() * sizeof(unsigned));
+    }
+
+    frame.series = true;
+    frame.seriesFile = fileName;
+    frame.seriesStep = stepCount;
+    frame.seriesMorphCount = static_cast<uint32_t>(morphCount);
+    frame.seriesTopologyChanged = hash != seriesHash_ || fileName != seriesFile_;
+    if (frame.seriesTopologyChanged)
+    {
+        TimeSeries::Topology& topology = frame.seriesTopology;
+        topology.xRes = grid ? grid->getXRes() : 0;
+        topology.yRes = grid ? grid->getYRes() : 0;
+        topology.positions.clear();
+        topology.indices.clear();
+        topology.textureCoords.clear();
+        if (!grid)
+        {
+            const float* positions = reinterpret_cast<const float*>(domain.positions_.data());
+            topology.positions.assign(positions, positions + domain.positions_.size() * 3);
+            topology.indices.assign(domain.indices_.begin(), domain.indices_.end());
+            if (domain.textureCoords_.size() == domain.positions_.size())
+            {
+                const float* textureCoords = reinterpret_cast<const float*>(domain.textureCoords_.data());
+                topology.textureCoords.assign(textureCoords, textureCoords + domain.textureCoords_.size() * 2);
+            }
+        }
+        seriesHash_ = hash;
+        seriesFile_ = fileName;
+    }
+
+    frame.seriesValues.resize(cellCount * morphCount);
+    for (size_t m = 0; m < morphCount; ++m)
+    {
+        float* values = frame.seriesValues.data() + m * cellCount;
+        for (size_t i = 0; i < cellCount; ++i)
+            values[i] = cells[i].vals[m];
+    }
+}
+
+void ExportPipeline::writerLoop()
+{
+    for (;;)
+    {
+        Frame* frame = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queueVar_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+
+            frame = queue_.front();
+            queue_.pop_front();
+            active_++;
+        }
+        spaceVar_.notify_one();
+
+        const uintmax_t bytes = write(*frame);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            lastWritten_ = Clock::now();
+            const double latency = msBetween(frame->queued, lastWritten_);
+            latencyMs_ += latency;
+            maxLatencyMs_ = std::max(maxLatencyMs_, latency);
+            bytes_ += bytes;
+            written_++;
+            active_--;
+            free_.push_back(frame);
+        }
+        doneVar_.notify_all();
+    }
+}
+
+uintmax_t ExportPipeline::write(Frame& frame)
+{
+    uintmax_t bytes = 0;
+    auto countBytes = [&bytes](const std::string& fileName)
+    {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(fileName, error);
+        if (!error)
+            bytes += size;
+    };
+
+    if (frame.series)
+        bytes += writeSeries(frame);
+
+    // The texture goes to the same file as the screenshot and replaces it, as it always has
+    if (frame.screenshot)
+    {
+        Utils::flipImage(frame.screenPixels.data(), frame.screenWidth, frame.screenHeight);
+        Utils::saveImage(frame.fileName + ".png", frame.screenWidth, frame.screenHeight, frame.screenPixels.data());
+        countBytes(frame.fileName + ".png");
+    }
+
+    if (frame.texture)
+    {
+        const int width = frame.degraded ? std::max(frame.textureWidth / 2, 2) : frame.textureWidth;
+        const int height = frame.degraded ? std::max(frame.textureHeight / 2, 2) : frame.textureHeight;
+        frame.texturePixels.assign(static_cast<size_t>(width) * height * 3, 0);
+        if (frame.textureSnapshot.domainType == SimulationDomain::DomainType::MESH)
+            HalfEdgeMesh::rasterizeTexture(frame.textureSnapshot, frame.texturePixels.data(), width, height);
+        else
+            Grid::rasterizeTexture(frame.textureSnapshot, frame.texturePixels.data(), width, height);
+        Utils::saveImage(frame.fileName + ".png", width, height, frame.texturePixels.data());
+        countBytes(frame.fileName + ".png");
+    }
+
+    if (frame.ply)
+    {
+        if (HalfEdgeMesh::writePly(frame.fileName + ".ply", frame.plySnapshot, info_.binaryPly))
+            countBytes(frame.fileName + ".ply");
+        else
+            LOG("Unable to save ply: " + frame.fileName + ".ply");
+    }
+    return bytes;
+}
+
+// Waits for the series frames submitted before this one, each encodes against the previous
+uintmax_t ExportPipeline::writeSeries(Frame& frame)
+{
+    std::unique_lock<std::mutex> lock(seriesMutex_);
+    seriesVar_.wait(lock, [&] { return seriesAppended_ == frame.sequence; });
+
+    if (!series_.isOpen() || series_.fileName() != frame.seriesFile)
+    {
+        if (series_.isOpen() && !series_.close())
+            LOG(series_.error());
+        if (!series_.open(frame.seriesFile, frame.seriesMorphCount, info_.series, frame.seriesStep))
+            LOG(series_.error());
+    }
+
+    const uint64_t before = series_.bytesWritten();
+    const uint64_t cellCount = frame.seriesMorphCount > 0 ? frame.seriesValues.size() / frame.seriesMorphCount : 0;
+    if (series_.isOpen() && frame.seriesTopologyChanged && !series_.appendTopology(frame.seriesTopology))
+        LOG(series_.error());
+    if (series_.isOpen() && !series_.appendFrame(frame.seriesStep, frame.seriesValues.data(), cellCount))
+        LOG(series_.error());
+    const uintmax_t bytes = series_.isOpen() ? series_.bytesWritten() - before : 0;
+
+    seriesAppended_++;
+    lock.unlock();
+    seriesVar_.notify_all();
+    return bytes;
+}
+
+ExportPipeline::Stats ExportPipeline::stats() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.written = written_;
+    stats.dropped = dropped_;
+    stats.degraded = degraded_;
+    stats.pending = queue_.size() + active_;
+    stats.stallMs = submitted_ > 0 ? stallMs_ / submitted_ : 0.0;
+    stats.latencyMs = written_ > 0 ? latencyMs_ / written_ : 0.0;
+    stats.maxLatencyMs = maxLatencyMs_;
+
+    const double seconds = written_ > 0 ? msBetween(firstQueued_, lastWritten_) / 1000.0 : 0.0;
+    if (seconds > 0.0)
+    {
+        stats.framesPerSecond = written_ / seconds;
+        stats.megabytesPerSecond = bytes_ / (1024.0 * 1024.0) / seconds;
+    }
+    return stats;
+}
+
+const ExportInfo& ExportPipeline::info() const
+{
+    return info_;
+}
+
+const char* ExportPipeline::backpressureName(ExportInfo::Backpressure backpressure)
+{
+    switch (backpressure)
+    {
+    case ExportInfo::Backpressure::Drop:    return "drop";
+    case ExportInfo::Backpressure::Degrade: return "degrade";
+    default:                                return "block";
+    }
+}
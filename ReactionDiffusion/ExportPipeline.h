@@ -0,0 +1,123 @@
+#pragma once
+#include "HalfEdgeMesh.h"
+#include "Simulation.h"
+#include "TimeSeries.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Writes recorded frames on background threads. The main thread only copies what a frame needs
+// into a pooled Frame and queues it, the writers rasterize, encode and save it while the
+// simulation carries on. When the queue is full the next frame waits (Block) or is skipped
+// (Drop). Degrade halves the texture size once the queue is half full and waits when it is full.
+// Series frames are appended to their TimeSeries file in the order they were submitted.
+class ExportPipeline
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // One recorded step, filled in on the main thread between acquire and submit
+    struct Frame
+    {
+        std::string fileName;                           // path without the extension
+        bool screenshot = false;
+        int screenWidth = 0, screenHeight = 0;
+        std::vector<unsigned char> screenPixels;        // bottom row first, as OpenGL returns them
+        bool texture = false;
+        int textureWidth = 0, textureHeight = 0;
+        SimulationDomain::TextureSnapshot textureSnapshot;
+        std::vector<unsigned char> texturePixels;
+        bool ply = false;
+        HalfEdgeMesh::PlySnapshot plySnapshot;
+        bool series = false;
+        std::string seriesFile;
+        uint32_t seriesMorphCount = 0;
+        int seriesStep = 0;
+        bool seriesTopologyChanged = false;             // seriesTopology has to be appended first
+        TimeSeries::Topology seriesTopology;
+        std::vector<float> seriesValues;                // every cell's value of one morphogen after the other
+        uint64_t sequence = 0;                          // order of the series frames, set by submit
+        bool degraded = false;                          // set by acquire, halves the texture size
+        Clock::time_point acquired, queued;
+    };
+
+    struct Stats
+    {
+        size_t written = 0;
+        size_t dropped = 0;
+        size_t degraded = 0;
+        size_t pending = 0;             // frames queued or being written
+        double stallMs = 0.0;           // average main thread time per frame, waiting included
+        double latencyMs = 0.0;         // average time from queued to written
+        double maxLatencyMs = 0.0;
+        double framesPerSecond = 0.0;   // since the first frame was queued
+        double megabytesPerSecond = 0.0;
+    };
+
+    ExportPipeline() = default;
+    ~ExportPipeline();
+
+    ExportPipeline(const ExportPipeline&) = delete;
+    ExportPipeline& operator=(const ExportPipeline&) = delete;
+
+    // Finishes the frames of a previous start before the writers are restarted
+    void start(const ExportInfo& info);
+    void stop();
+    bool running() const;
+    // Returns a frame to fill, or nullptr when the frame is dropped
+    Frame* acquire();
+    void submit(Frame* frame);
+    // Waits until every submitted frame is written
+    void finish();
+    // Copies the domain's morphogens into the frame, and its topology when it changed since
+    // the last series frame
+    void snapshotSeries(Frame& frame, SimulationDomain& domain, size_t morphCount, int stepCount, const std::string& fileName);
+
+    Stats stats() const;
+    const ExportInfo& info() const;
+    static const char* backpressureName(ExportInfo::Backpressure backpressure);
+
+private:
+    void writerLoop();
+    uintmax_t write(Frame& frame);
+    uintmax_t writeSeries(Frame& frame);
+
+    ExportInfo info_;
+    std::vector<std::thread> writers_;
+    std::vector<std::unique_ptr<Frame>> frames_;
+    std::vector<Frame*> free_;
+    std::deque<Frame*> queue_;
+    mutable std::mutex mutex_;
+    std::condition_variable queueVar_;  // a frame was queued or the writers stop
+    std::condition_variable spaceVar_;  // a writer took a frame off the queue
+    std::condition_variable doneVar_;   // a writer finished a frame
+    size_t active_ = 0;
+    bool stopping_ = false;
+
+    size_t submitted_ = 0;
+    size_t written_ = 0;
+    size_t dropped_ = 0;
+    size_t degraded_ = 0;
+    uintmax_t bytes_ = 0;
+    double stallMs_ = 0.0;
+    double latencyMs_ = 0.0;
+    double maxLatencyMs_ = 0.0;
+    Clock::time_point firstQueued_, lastWritten_;
+
+    // Only touched by the main thread
+    uint64_t seriesHash_ = 0;
+    std::string seriesFile_;
+    // Guarded by seriesMutex_
+    TimeSeriesWriter series_;
+    std::mutex seriesMutex_;
+    std::condition_variable seriesVar_; // a series frame was appended
+    uint64_t seriesSubmitted_ = 0;      // guarded by mutex_
+    uint64_t seriesAppended_ = 0;
+};
@@ -0,0 +1,180 @@
+#include "FieldStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+void FieldStats::CompensatedSum::add(double value)
+{
+    double t = sum + value;
+    if (std::abs(sum) >= std::abs(value))
+        compensation += (sum - t) + value;
+    else
+        compensation += (value - t) + sum;
+    sum = t;
+}
+
+double FieldStats::CompensatedSum::value() const
+{
+    return sum + compensation;
+}
+
+void FieldStats::begin(size_t numThreads, size_t morphCount)
+{
+    gathering_ = true;
+    if (morphogens_.size() != morphCount)
+        morphogens_.assign(morphCount, Morphogen());
+    morphCount_ = morphCount;
+
+    // Bin with the range of the last gather, the field moves little between two of them
+    binOffset_.resize(morphCount);
+    binScale_.resize(morphCount);
+    for (size_t m = 0; m < morphCount; ++m)
+    {
+        Morphogen& morphogen = morphogens_[m];
+        if (std::isfinite(morphogen.min) && std::isfinite(morphogen.max) && morphogen.max > morphogen.min)
+        {
+            morphogen.histogramMin = morphogen.min;
+            morphogen.histogramMax = morphogen.max;
+        }
+        binOffset_[m] = morphogen.histogramMin;
+        binScale_[m] = HistogramBins / (morphogen.histogramMax - morphogen.histogramMin);
+    }
+
+    partials_.resize(numThreads);
+    for (auto& partial : partials_)
+    {
+        partial.min.assign(morphCount, std::numeric_limits<float>::max());
+        partial.max.assign(morphCount, std::numeric_limits<float>::lowest());
+        partial.sum.assign(morphCount, 0.0);
+        partial.sumSq.assign(morphCount, 0.0);
+        partial.sumSqChange.assign(morphCount, 0.0);
+        partial.integral.assign(morphCount, CompensatedSum());
+        partial.histogram.assign(morphCount * HistogramBins, 0);
+        partial.count = 0;
+        partial.nonFinite = false;
+        partial.gathered = false;
+    }
+}
+
+bool FieldStats::gathering() const
+{
+    return gathering_;
+}
+
+bool FieldStats::gathered() const
+{
+    for (auto& partial : partials_)
+        if (partial.gathered)
+            return true;
+    return false;
+}
+
+// Each thread only touches its own partial, so no locking is needed
+void FieldStats::accumulate(size_t threadID, const std::vector<unsigned>& indices, const std::vector<SimulationDomain::Cell>& readFrom, const std::vector<SimulationDomain::Cell>& writeTo, const SimulationDomain& domain)
+{
+    if (!gathering_ || threadID >= partials_.size())
+        return;
+
+    Partial& partial = partials_[threadID];
+    partial.gathered = true;
+    partial.count += indices.size();
+
+    float* min = partial.min.data();
+    float* max = partial.max.data();
+    double* sum = partial.sum.data();
+    double* sumSq = partial.sumSq.data();
+    double* sumSqChange = partial.sumSqChange.data();
+    unsigned* histogram = partial.histogram.data();
+    const float* binOffset = binOffset_.data();
+    const float* binScale = binScale_.data();
+    const float lastBin = static_cast<float>(HistogramBins - 1);
+    bool nonFinite = false;
+    for (unsigned i : indices)
+    {
+        const float* before = readFrom[i].vals.data();
+        const float* after = writeTo[i].vals.data();
+        const double area = domain.getArea(i);
+        for (size_t m = 0; m < morphCount_; ++m)
+        {
+            const float value = after[m];
+            const double change = double(value) - double(before[m]);
+            min[m] = std::min(min[m], value);
+            max[m] = std::max(max[m], value);
+            sum[m] += value;
+            sumSq[m] += double(value) * double(value);
+            sumSqChange[m] += change * change;
+            partial.integral[m].add(value * area);
+            nonFinite |= !std::isfinite(value);
+
+            // Written so a NaN lands in the first bin instead of an undefined cast
+            float bin = (value - binOffset[m]) * binScale[m];
+            bin = bin > 0.f ? std::min(bin, lastBin) : 0.f;
+            histogram[m * HistogramBins + static_cast<unsigned>(bin)]++;
+        }
+    }
+    partial.nonFinite |= nonFinite;
+}
+
+bool FieldStats::finish()
+{
+    if (!gathering_)
+        return false;
+    gathering_ = false;
+
+    size_t count = 0;
+    bool nonFinite = false;
+    for (auto& partial : partials_)
+    {
+        count += partial.count;
+        nonFinite |= partial.nonFinite;
+    }
+    if (count == 0)
+        return false;
+
+    cellCount_ = count;
+    nonFinite_ = nonFinite;
+    for (size_t m = 0; m < morphCount_; ++m)
+    {
+        Morphogen& morphogen = morphogens_[m];
+        float min = std::numeric_limits<float>::max(), max = std::numeric_limits<float>::lowest();
+        double sum = 0.0, sumSq = 0.0, sumSqChange = 0.0;
+        CompensatedSum integral;
+        morphogen.histogram.assign(HistogramBins, 0);
+        for (auto& partial : partials_)
+        {
+            min = std::min(min, partial.min[m]);
+            max = std::max(max, partial.max[m]);
+            sum += partial.sum[m];
+            sumSq += partial.sumSq[m];
+            sumSqChange += partial.sumSqChange[m];
+            integral.add(partial.integral[m].value());
+            for (int b = 0; b < HistogramBins; ++b)
+                morphogen.histogram[b] += partial.histogram[m * HistogramBins + b];
+        }
+
+        morphogen.min = min;
+        morphogen.max = max;
+        morphogen.mean = sum / double(count);
+        morphogen.rms = std::sqrt(sumSq / double(count));
+        morphogen.rmsChange = std::sqrt(sumSqChange / double(count));
+        morphogen.integral = integral.value();
+    }
+    return true;
+}
+
+const std::vector<FieldStats::Morphogen>& FieldStats::morphogens() const
+{
+    return morphogens_;
+}
+
+size_t FieldStats::cellCount() const
+{
+    return cellCount_;
+}
+
+bool FieldStats::nonFinite() const
+{
+    return nonFinite_;
+}
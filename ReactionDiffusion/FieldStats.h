@@ -0,0 +1,74 @@
+#pragma once
+#include "SimulationDomain.h"
+
+#include <vector>
+
+
+// Per morphogen reductions of one step, gathered by the step tasks while the new values are still
+// in cache. Each thread fills its own partial and finish() combines them at the step barrier.
+// The normalization, the Stats window and the convergence and health monitors all read the result.
+class FieldStats
+{
+public:
+    struct Morphogen
+    {
+        float min = 0.f;
+        float max = 0.f;
+        double mean = 0.0;
+        double rms = 0.0;
+        double rmsChange = 0.0;    // of the change over the step
+        double integral = 0.0;     // area weighted
+        float histogramMin = 0.f;  // the histogram spans the previous gather's range, values outside land in the end bins
+        float histogramMax = 1.f;
+        std::vector<unsigned> histogram;
+    };
+
+    static constexpr int HistogramBins = 32;
+
+    FieldStats() = default;
+
+    void begin(size_t numThreads, size_t morphCount);
+    bool gathering() const;
+    bool gathered() const;
+    void accumulate(size_t threadID, const std::vector<unsigned>& indices, const std::vector<SimulationDomain::Cell>& readFrom, const std::vector<SimulationDomain::Cell>& writeTo, const SimulationDomain& domain);
+    // Combines the partials, returns false if nothing was gathered this step
+    bool finish();
+
+    const std::vector<Morphogen>& morphogens() const;
+    size_t cellCount() const;
+    bool nonFinite() const;
+
+private:
+    // Neumaier's variant of Kahan summation, exact enough that a drift in an integral is real
+    struct CompensatedSum
+    {
+        double sum = 0.0;
+        double compensation = 0.0;
+
+        void add(double value);
+        double value() const;
+    };
+
+    struct Partial
+    {
+        std::vector<float> min;
+        std::vector<float> max;
+        std::vector<double> sum;
+        std::vector<double> sumSq;
+        std::vector<double> sumSqChange;
+        std::vector<CompensatedSum> integral;
+        std::vector<unsigned> histogram; // HistogramBins per morphogen
+        size_t count = 0;
+        bool nonFinite = false;
+        bool gathered = false;
+    };
+
+    std::vector<Partial> partials_;
+    std::vector<Morphogen> morphogens_;
+    std::vector<float> binOffset_;
+    std::vector<float> binScale_;
+    size_t morphCount_ = 0;
+    size_t cellCount_ = 0;
+    bool gathering_ = false;
+    bool nonFinite_ = false;
+};
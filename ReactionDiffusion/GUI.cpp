@@ -15,6 +15,7 @@
 #include <imgui.h>
 #include <iostream>
 #include <algorithm>
+#include <cfloat>
 //#include <nfd.h>
 
 
@@ -121,6 +122,7 @@ void GUI::draw(RDPG* app)
 
     if (simulation)
     {
+        simulation->statsRequested = showStatsWindow_;
         if (showSaveWindow_)
             drawSaveWindow(app);
         if (app->domain_ && app->domain_->growing)
@@ -382,7 +384,7 @@ void GUI::save(RDPG* app)
     if (app->domain_->isDomainType(SimulationDomain::DomainType::MESH))
     {
         HalfEdgeMesh* meshDomain = dynamic_cast<HalfEdgeMesh*>(domain);
-        meshDomain->saveToPly(patternNameStr + "/" + objNameStr, domain->hasVeins());
+        meshDomain->saveToPly(patternNameStr + "/" + objNameStr, domain->hasVeins(), simulation->exportInfo.binaryPly);
     }
 
     bool colorMapsSameName = domain->colorMapInside.getName() == domain->colorMapOutside.getName();
@@ -484,6 +486,48 @@ void GUI::save(RDPG* app)
         configFile << "growthY: " << simulation->growth.y << "\n";
         configFile << "growthZ: " << simulation->growth.z << "\n";
         configFile << "growthTickLimit: " << simulation->getGrowthTickLimit() << "\n";
+        configFile << "growthTimeBudget: " << domain->growthTimeBudget << "\n";
+        configFile << "adaptive: " << (domain->adaptivityInfo.enabled ? "true" : "false") << "\n";
+        configFile << "refineError: " << domain->adaptivityInfo.refineError << "\n";
+        configFile << "coarsenError: " << domain->adaptivityInfo.coarsenError << "\n";
+        configFile << "minFaceArea: " << domain->adaptivityInfo.minFaceArea << "\n";
+        configFile << "activeSet: " << (simulation->activeSetInfo.enabled ? "true" : "false") << "\n";
+        configFile << "activeSetTolerance: " << simulation->activeSetInfo.tolerance << "\n";
+        configFile << "activeSetSweepInterval: " << simulation->activeSetInfo.sweepInterval << "\n";
+
+        const ConvergenceMonitor::Info& convergence = simulation->convergence.info;
+        configFile << "convergence: " << (convergence.enabled ? "true" : "false") << "\n";
+        configFile << "convergenceInterval: " << convergence.interval << "\n";
+        configFile << "convergenceAbsTolerance: " << convergence.absTolerance << "\n";
+        configFile << "convergenceRelTolerance: " << convergence.relTolerance << "\n";
+        configFile << "convergencePatience: " << convergence.patience << "\n";
+        configFile << "convergenceHomogeneousTolerance: " << convergence.homogeneousTolerance << "\n";
+        configFile << "convergenceBlowUpLimit: " << convergence.blowUpLimit << "\n";
+        configFile << "convergenceAction: " << ConvergenceMonitor::actionName(convergence.action) << "\n";
+
+        configFile << "checkpointInterval: " << simulation->autoCheckpointInfo.interval << "\n";
+        configFile << "checkpointSeconds: " << simulation->autoCheckpointInfo.seconds << "\n";
+        if (!simulation->autoCheckpointInfo.fileName.empty())
+            configFile << "checkpointFile: " << simulation->autoCheckpointInfo.fileName << "\n";
+
+        configFile << "exportWriters: " << simulation->exportInfo.writers << "\n";
+        configFile << "exportQueueSize: " << simulation->exportInfo.queueSize << "\n";
+        configFile << "exportBackpressure: " << ExportPipeline::backpressureName(simulation->exportInfo.backpressure) << "\n";
+        configFile << "exportBinaryPly: " << (simulation->exportInfo.binaryPly ? "true" : "false") << "\n";
+        configFile << "textureDilation: " << simulation->exportInfo.textureDilation << "\n";
+        configFile << "seriesEncoding: " << TimeSeries::encodingName(simulation->exportInfo.series.encoding) << "\n";
+        configFile << "seriesKeyInterval: " << simulation->exportInfo.series.keyInterval << "\n";
+
+        const HealthMonitor::Info& health = simulation->health.info;
+        configFile << "health: " << (health.enabled ? "true" : "false") << "\n";
+        configFile << "healthInterval: " << health.interval << "\n";
+        configFile << "healthMinValue: " << health.minValue << "\n";
+        configFile << "healthMaxValue: " << health.maxValue << "\n";
+        configFile << "healthMassTolerance: " << health.massTolerance << "\n";
+        configFile << "healthSnapshots: " << health.snapshotCount << "\n";
+        configFile << "healthSnapshotInterval: " << health.snapshotInterval << "\n";
+        configFile << "healthMaxRollbacks: " << health.maxRollbacks << "\n";
+        configFile << "healthHalveDt: " << (health.halveDt ? "true" : "false") << "\n";
 
         // Write morphogens used		
         configFile << "\n### Morphogens and domain info ###\n";
@@ -696,11 +740,25 @@ void GUI::drawGrowthControls(RDPG* app)
         if (ImGui::InputInt("sims/grow", &growPerSim))
             simulation->setGrowthTickLimit((unsigned long long) growPerSim);
 
+        if (domain->isDomainType(SimulationDomain::DomainType::MESH))
+            ImGui::InputFloat("ms/step##grow", &domain->growthTimeBudget, .5f, 1.f, "%.2f");
+
         if (simulation->subdivisionEnabled_)
         {
             if (domain->isDomainType(SimulationDomain::DomainType::MESH))
                 ImGui::InputFloat("max area", &simulation->maxFaceArea, .01f, .1f, "%.6f");
         }
+
+        if (domain->isDomainType(SimulationDomain::DomainType::MESH) && !simulation->isGPUEnabled)
+        {
+            ImGui::Checkbox("Adaptive##grow", &domain->adaptivityInfo.enabled);
+            if (domain->adaptivityInfo.enabled)
+            {
+                ImGui::InputFloat("refine error", &domain->adaptivityInfo.refineError, .01f, .1f, "%.4f");
+                ImGui::InputFloat("coarsen error", &domain->adaptivityInfo.coarsenError, .01f, .1f, "%.4f");
+                ImGui::InputFloat("min area", &domain->adaptivityInfo.minFaceArea, .001f, .01f, "%.6f");
+            }
+        }
     }
 
     ImGui::NewLine();
@@ -1016,6 +1074,7 @@ void GUI::drawPaintingControls(RDPG* app)
             if (ImGui::Button(("set##" + m.first).c_str()))
             {
                 domain->clearMorphogens(m.second);
+                simulation->requestFullSweep();
                 simulation->updateColorsFromRam = true;
                 simulation->gpuUpToDate(false);
             }
@@ -1305,6 +1364,8 @@ void GUI::drawRenderingControls(RDPG* app)
     }
 
     ImGui::DragFloat("Normalization", &domain->normCoef, .01f, 0.f, 100.f);
+    ImGui::SameLine();
+    ImGui::Checkbox("Auto##AutoNormalize", &domain->autoNormalize);
     ImGui::DragFloat("Background Span", &domain->backgroundThreshold_, .01f, 0.f, 10.f);
     ImGui::DragFloat("Background Offset", &domain->backgroundOffset_, .01f, 0.f, 10.f);
     ImGui::DragFloat("Line width", &lineWidth_, .1f, 1.f, 10.f);
@@ -1357,8 +1418,58 @@ void GUI::drawStats(RDPG* app)
     ImGui::Separator();
     ImGui::Text(("Sim Steps:       " + std::to_string(simulation->stepCount)).c_str());
     ImGui::Text(("Cell count:      " + std::to_string(domain->getCellCount())).c_str());
+    if (simulation->activeSetInfo.enabled)
+        ImGui::Text("Active cells:    %.1f%%", simulation->activeFraction() * 100.f);
+    if (simulation->convergence.info.enabled)
+    {
+        ImGui::Text("Convergence:     %s", ConvergenceMonitor::stateName(simulation->convergence.state()));
+        ImGui::Text("Rms change:      %g", simulation->convergence.maxChange());
+    }
+    if (simulation->health.info.enabled)
+    {
+        ImGui::Text("Health:          %s", simulation->health.failed() ? "failed" : HealthMonitor::violationName(simulation->health.violation()));
+        const std::vector<double>& masses = simulation->health.masses();
+        for (auto& morph : simulation->morphIndexMap)
+            if (morph.second < static_cast<int>(masses.size()))
+                ImGui::Text("Integral %-7s %g", (morph.first + ":").c_str(), masses[morph.second]);
+    }
+
+    if (simulation->recording())
+    {
+        ExportPipeline::Stats exportStats = app->exporter_.stats();
+        ImGui::Separator();
+        ImGui::Text("Frames written:  %zu (%zu pending)", exportStats.written, exportStats.pending);
+        if (exportStats.dropped > 0 || exportStats.degraded > 0)
+            ImGui::Text("Dropped:         %zu, degraded %zu", exportStats.dropped, exportStats.degraded);
+        ImGui::Text("Frame stall:     %.2f ms", exportStats.stallMs);
+        ImGui::Text("Write latency:   %.1f ms (max %.1f)", exportStats.latencyMs, exportStats.maxLatencyMs);
+        ImGui::Text("Throughput:      %.2f frames/s, %.1f MB/s", exportStats.framesPerSecond, exportStats.megabytesPerSecond);
+    }
 
     ImGui::Separator();
+    const std::vector<FieldStats::Morphogen>& morphogens = simulation->fieldStats.morphogens();
+    if (!morphogens.empty() && ImGui::TreeNode("Morphogens"))
+    {
+        for (auto& morph : simulation->morphIndexMap)
+        {
+            if (morph.second >= static_cast<int>(morphogens.size()))
+                continue;
+
+            const FieldStats::Morphogen& stats = morphogens[morph.second];
+            ImGui::Text("%-7s min %g  max %g  mean %g", (morph.first + ":").c_str(), stats.min, stats.max, stats.mean);
+            if (stats.histogram.size() == FieldStats::HistogramBins)
+            {
+                float histogram[FieldStats::HistogramBins];
+                for (int b = 0; b < FieldStats::HistogramBins; ++b)
+                    histogram[b] = static_cast<float>(stats.histogram[b]);
+                std::string label = "##Histogram" + morph.first;
+                std::string overlay = std::to_string(stats.histogramMin) + " - " + std::to_string(stats.histogramMax);
+                ImGui::PlotHistogram(label.c_str(), histogram, FieldStats::HistogramBins, 0, overlay.c_str(), 0.f, FLT_MAX, ImVec2(0.f, 50.f));
+            }
+        }
+        ImGui::TreePop();
+    }
+
     if (ImGui::TreeNode("Geometry"))
     {
         ImGui::Text(("Vertices count:  " + std::to_string(domain->positions_.size())).c_str());
@@ -1456,6 +1567,9 @@ void GUI::drawControls(RDPG* app)
     ImGui::SameLine();
     if (ImGui::Button("save##rd")) 
         simulation->saveConcentrations("", std::string(simulationName_) + ".rd");
+    ImGui::SameLine();
+    if (ImGui::Button("checkpoint##rdc"))
+        simulation->saveCheckpoint("", std::string(simulationName_) + ".rdc");
 
     // obj file
     if (domain->isDomainType(SimulationDomain::DomainType::MESH))
@@ -1469,7 +1583,7 @@ void GUI::drawControls(RDPG* app)
         ImGui::InputText(".ply", plyName_, 128);
         ImGui::SameLine();
         if (ImGui::Button("save##ply"))
-            meshDomain->saveToPly((std::string(plyName_) + ".ply").c_str());
+            meshDomain->saveToPly((std::string(plyName_) + ".ply").c_str(), false, simulation->exportInfo.binaryPly);
     }
 
     if (ImGui::Button("Reload PDEs"))
@@ -1492,6 +1606,34 @@ void GUI::drawControls(RDPG* app)
     ImGui::InputInt("##ExitStep", &simulation->exitStepCount);
     ImGui::SameLine();
     ImGui::Checkbox("Exit step", &simulation->exitAt);
+
+    ConvergenceMonitor::Info& convergence = simulation->convergence.info;
+    ImGui::Checkbox("Convergence monitor", &convergence.enabled);
+    if (convergence.enabled)
+    {
+        int action = static_cast<int>(convergence.action);
+        if (ImGui::Combo("Action##convergence", &action, "Report\0Checkpoint\0Stop\0"))
+            convergence.action = static_cast<ConvergenceMonitor::Action>(action);
+        ImGui::InputInt("Check interval", &convergence.interval);
+        ImGui::InputInt("Patience", &convergence.patience);
+        ImGui::InputFloat("Abs tolerance", &convergence.absTolerance, 0.f, 0.f, "%g");
+        ImGui::InputFloat("Rel tolerance", &convergence.relTolerance, 0.f, 0.f, "%g");
+    }
+
+    HealthMonitor::Info& health = simulation->health.info;
+    ImGui::Checkbox("Health monitor", &health.enabled);
+    if (health.enabled)
+    {
+        ImGui::InputInt("Check interval##health", &health.interval);
+        ImGui::InputFloat("Min value##health", &health.minValue, 0.f, 0.f, "%g");
+        ImGui::InputFloat("Max value##health", &health.maxValue, 0.f, 0.f, "%g");
+        ImGui::InputFloat("Integral tolerance", &health.massTolerance, 0.f, 0.f, "%g");
+        ImGui::Checkbox("Halve dt on rollback", &health.halveDt);
+    }
+
+    AutoCheckpointInfo& checkpoint = simulation->autoCheckpointInfo;
+    ImGui::InputInt("Checkpoint steps", &checkpoint.interval);
+    ImGui::InputFloat("Checkpoint seconds", &checkpoint.seconds, 0.f, 0.f, "%g");
     ImGui::Checkbox("Save on exit##", &simulation->createModelOnExit);
 
     // Save model on exit
@@ -1509,6 +1651,32 @@ void GUI::drawControls(RDPG* app)
     ImGui::Checkbox("Output textures", &simulation->outputTextures);
     ImGui::Checkbox("Output screenshots", &simulation->outputScreens);
     ImGui::Checkbox("Output plys", &simulation->outputPlys);
+    ImGui::Checkbox("Output series", &simulation->outputSeries);
+
+    // Restarting the writers waits for the frames already queued
+    ExportInfo& exportInfo = simulation->exportInfo;
+    bool exportChanged = ImGui::InputInt("Writer threads", &exportInfo.writers);
+    exportChanged |= ImGui::InputInt("Queued frames", &exportInfo.queueSize);
+    int backpressure = static_cast<int>(exportInfo.backpressure);
+    if (ImGui::Combo("When full##export", &backpressure, "Block\0Drop\0Degrade\0"))
+    {
+        exportInfo.backpressure = static_cast<ExportInfo::Backpressure>(backpressure);
+        exportChanged = true;
+    }
+    int encoding = static_cast<int>(exportInfo.series.encoding);
+    if (ImGui::Combo("Series encoding", &encoding, "Raw\0Delta\0Quantized\0"))
+    {
+        exportInfo.series.encoding = static_cast<TimeSeries::Encoding>(encoding);
+        exportChanged = true;
+    }
+    exportChanged |= ImGui::InputInt("Series key interval", &exportInfo.series.keyInterval);
+    exportChanged |= ImGui::Checkbox("Binary plys", &exportInfo.binaryPly);
+    if (exportChanged)
+    {
+        // The series recorded so far is carried on, not replaced
+        exportInfo.series.append = true;
+        app->exporter_.start(exportInfo);
+    }
     ImGui::NewLine();
 
     // Save a texture
@@ -1522,6 +1690,7 @@ void GUI::drawControls(RDPG* app)
             Utils::stripNulls(std::string(textureName_ + std::string(".png"))));
     }
     ImGui::InputInt2("Texture Size", app->texSize_);
+    ImGui::InputInt("Seam dilation", &simulation->exportInfo.textureDilation);
     ImGui::Checkbox("Save texture on exit", &simulation->createTextureOnExit);
     ImGui::NewLine();
     ImGui::NewLine();
@@ -1613,7 +1782,7 @@ void GUI::drawAnimationControls(RDPG* app)
             ctrlPoint.set(pos[0], pos[1], pos[2]);
             app->patch_[splineIndex].setControlPoint(curPtIndex, ctrlPoint);
             app->patch_[splineIndex].initDrawable(*app->patchDrawable_[splineIndex]);
-            updatePositionsFromBSplinePatch(domain->positions_, domain->animation_.UVs(), app->patch_);
+            domain->animation_.updatePositionsFromPatch(domain->positions_, app->patch_);
             domain->updatePositionVBO();
         }
 
@@ -1636,7 +1805,7 @@ void GUI::drawAnimationControls(RDPG* app)
 
         if (ImGui::Button("update"))
         {
-            updatePositionsFromBSplinePatch(domain->positions_, domain->animation_.UVs(), app->patch_);
+            domain->animation_.updatePositionsFromPatch(domain->positions_, app->patch_);
             domain->updatePositionVBO();
         }
 
@@ -5,6 +5,7 @@
 
 #include <random>
 #include <algorithm>
+#include <cmath>
 
 
 Grid::Grid(int xRes, int yRes, float cellSize) :
@@ -592,6 +593,22 @@ std::vector<unsigned> Grid::getNeighboursByRadius(unsigned i, float radius)
     return foundNeighbours;
 }
 
+// Marks the square of cells within order steps of each seed, the footprint of the 9 point stencil
+void Grid::markNeighbours(const std::vector<unsigned>& seeds, unsigned order, std::vector<char>& marked)
+{
+    const int o = static_cast<int>(order);
+    for (unsigned i : seeds)
+    {
+        int x, y;
+        indexToVec2(i, x, y);
+        int x0 = std::max(x - o, 0), x1 = std::min(x + o, xRes_ - 1);
+        int y0 = std::max(y - o, 0), y1 = std::min(y + o, yRes_ - 1);
+        for (int xi = x0; xi <= x1; ++xi)
+            for (int yi = y0; yi <= y1; ++yi)
+                marked[vec2ToIndex(xi, yi)] = 1;
+    }
+}
+
 void Grid::growAndSubdivide(Vec3& growth, float, bool, size_t)
 {
     std::random_device rd;
@@ -624,9 +641,17 @@ std::vector<unsigned> Grid::getCellIndices(const Vec3&, const Vec3& origin, floa
     std::vector<unsigned> foundIndices;
     Vec3 loc = Vec3(origin.x, origin.y, 0);
 
-    for (int x = 0; x < xRes_; ++x)
+    // Only visit the cells under the brush's bounding box
+    float cx = loc.x + (float)xRes_ * .5f;
+    float cy = loc.y + (float)yRes_ * .5f;
+    int x0 = std::max(0, (int)std::floor(cx - radius));
+    int y0 = std::max(0, (int)std::floor(cy - radius));
+    int x1 = std::min(xRes_ - 1, (int)std::ceil(cx + radius));
+    int y1 = std::min(yRes_ - 1, (int)std::ceil(cy + radius));
+
+    for (int x = x0; x <= x1; ++x)
     {
-        for (int y = 0; y < yRes_; ++y)
+        for (int y = y0; y <= y1; ++y)
         {
             Vec3 p = Vec3((float)x, (float)y, 0.f) - Vec3((float)xRes_ * .5f, (float)yRes_ * .5f, 0.f);
             if (length(p - loc) <= radius)
@@ -960,15 +985,42 @@ void Grid::copyGradientToDiffusion(int /*morphIndex*/, int /*gradIndex*/)
     // TODO
 }
 
-void Grid::exportTexture(unsigned char* pixels, int exportWidth, int exportHeight)
+void Grid::exportTexture(unsigned char* pixels, int exportWidth, int exportHeight, int dilation)
+{
+    TextureSnapshot snapshot;
+    snapshotTexture(snapshot);
+    snapshot.dilation = dilation;
+    rasterizeTexture(snapshot, pixels, exportWidth, exportHeight);
+}
+
+void Grid::snapshotTexture(TextureSnapshot& snapshot) const
+{
+    snapshot.domainType = domainType;
+    snapshot.colorMap = colorMapOutside.lookupTable();
+    snapshot.normCoef = normCoef;
+    snapshot.xRes = xRes_;
+    snapshot.yRes = yRes_;
+    snapshot.values.resize(colors_.size());
+    for (size_t i = 0; i < colors_.size(); ++i)
+        snapshot.values[i] = colors_[i].r;
+}
+
+void Grid::rasterizeTexture(const TextureSnapshot& snapshot, unsigned char* pixels, int exportWidth, int exportHeight)
 {
+    const int xRes = snapshot.xRes;
+    const int yRes = snapshot.yRes;
+    auto vec2ToIndex = [yRes](int x, int y)
+    {
+        return y + x * yRes;
+    };
     auto lerp = [](float s, float a, float b)
     {
         return s * b + (1.f - s) * a;
     };
 
-    int i = 0;
-    unsigned char r, g, b;
+    // Each row's values are coloured in one batch
+    std::vector<float> values(exportWidth);
+    unsigned char* row = pixels;
     for (int y = exportHeight - 1; y >= 0; --y)
     {
         for (int x = 0; x < exportWidth; ++x)
@@ -976,31 +1028,25 @@ void Grid::exportTexture(unsigned char* pixels, int exportWidth, int exportHeigh
             float u = float(x) / float(exportWidth - 1);
             float v = float(y) / float(exportHeight - 1);
 
-            int x0 = int(u * (xRes_ - 1));
-            int x1 = x0 < xRes_ - 1 ? x0 + 1 : x0;
-            int y0 = int(v * (yRes_ - 1));
-            int y1 = y0 < yRes_ - 1 ? y0 + 1 : y0;
+            int x0 = int(u * (xRes - 1));
+            int x1 = x0 < xRes - 1 ? x0 + 1 : x0;
+            int y0 = int(v * (yRes - 1));
+            int y1 = y0 < yRes - 1 ? y0 + 1 : y0;
 
-            float u0 = (float(x0) / float(xRes_ - 1));
-            float u1 = (float(x1) / float(xRes_ - 1));
-            float v0 = (float(y0) / float(yRes_ - 1));
-            float v1 = (float(y1) / float(yRes_ - 1));
+            float u0 = (float(x0) / float(xRes - 1));
+            float u1 = (float(x1) / float(xRes - 1));
+            float v0 = (float(y0) / float(yRes - 1));
+            float v1 = (float(y1) / float(yRes - 1));
 
             u = u1 != u0 ? (u - u0) / (u1 - u0) : 0.f;
             v = v1 != v0 ? (v - v0) / (v1 - v0) : 0.f;
 
-            float s = lerp(v,
-                lerp(u, colors_[vec2ToIndex(x0, y0)].r, colors_[vec2ToIndex(x1, y0)].r),
-                lerp(u, colors_[vec2ToIndex(x0, y1)].r, colors_[vec2ToIndex(x1, y1)].r));
-
-            colorMapOutside.sample(
-                s / normCoef,
-                r, g, b
-            );
-
-            pixels[i++] = r;
-            pixels[i++] = g;
-            pixels[i++] = b;
+            values[x] = lerp(v,
+                lerp(u, snapshot.values[vec2ToIndex(x0, y0)], snapshot.values[vec2ToIndex(x1, y0)]),
+                lerp(u, snapshot.values[vec2ToIndex(x0, y1)], snapshot.values[vec2ToIndex(x1, y1)]));
         }
+
+        snapshot.colorMap.map(values.data(), values.size(), snapshot.normCoef, row);
+        row += exportWidth * 3;
     }
 }
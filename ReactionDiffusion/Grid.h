@@ -28,7 +28,8 @@ public:
 
     bool isBoundary(unsigned i) override;
     std::vector<unsigned> getNeighbours(unsigned i, unsigned order) override;
-    std::vector<unsigned> getNeighboursByRadius(unsigned i, float radius);
+    std::vector<unsigned> getNeighboursByRadius(unsigned i, float radius) override;
+    void markNeighbours(const std::vector<unsigned>& seeds, unsigned order, std::vector<char>& marked) override;
     void growAndSubdivide(Vec3& growth, float maxFaceArea, bool subdivisionEnabled, size_t stepCount) override;
     void doUpdate() override;
     float getArea(unsigned i) const override;
@@ -39,7 +40,9 @@ public:
     virtual int raycast(const Vec3& dir, const Vec3& origin, float& t0) const override;
     void updateDiffusionCoefs() override;
     void updateDiffusionCoef(unsigned i, int morph);
-    void exportTexture(unsigned char* pixels, int width, int height) override;
+    void exportTexture(unsigned char* pixels, int width, int height, int dilation) override;
+    void snapshotTexture(TextureSnapshot& snapshot) const override;
+    static void rasterizeTexture(const TextureSnapshot& snapshot, unsigned char* pixels, int width, int height);
     bool hideAnisoVec(int i) const override;
     void updateGradLines() override;
     void updateDiffDirLines() override;
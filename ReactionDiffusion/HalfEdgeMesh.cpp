@@ -4,6 +4,8 @@
 #include "Mat3.h"
 #include "Quaternion.h"
 #include "Triangle.h"
+#include "ThreadPool.h"
+#include "Checkpoint.h"
 
 #include <iostream>
 #include <fstream>
@@ -12,6 +14,304 @@
 #include <stack>
 #include <unordered_set>
 #include <cmath>
+#include <chrono>
+#include <thread>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <queue>
+
+namespace
+{
+    // Dijkstra from start over the graph neighbours(v, reach) describes, reach(j, length) being
+    // called for every edge out of v. found gets everything within radius of start in order of
+    // distance, start first. distances only holds valid values where reached has been visited.
+    template<typename Stamps, typename Neighbours>
+    void gatherByDistance(unsigned start, float radius, Stamps& reached, std::vector<float>& distances, Neighbours neighbours, std::vector<unsigned>& found)
+    {
+        using Entry = std::pair<float, unsigned>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        reached.reset(distances.size());
+        reached.visit(start);
+        distances[start] = 0.f;
+        queue.emplace(0.f, start);
+        while (!queue.empty())
+        {
+            auto [distance, v] = queue.top();
+            queue.pop();
+            if (distance > distances[v])
+                continue; // a shorter path got there first
+
+            found.push_back(v);
+            neighbours(v, [&](unsigned j, float length)
+            {
+                float d = distance + length;
+                if (d <= radius && (reached.visit(j) || d < distances[j]))
+                {
+                    distances[j] = d;
+                    queue.emplace(d, j);
+                }
+            });
+        }
+    }
+
+    // Sorts each thread's range then merges neighbouring ranges in rounds
+    template<typename T>
+    void parallelSort(ThreadPool& pool, std::vector<T>& values)
+    {
+        const size_t count = values.size();
+        size_t width = std::max<size_t>(1, (count + pool.getNumThreads() - 1) / pool.getNumThreads());
+        pool.parallelFor((count + width - 1) / width, [&](size_t range) {
+            size_t start = range * width;
+            size_t end = std::min(start + width, count);
+            std::sort(values.begin() + start, values.begin() + end);
+            });
+
+        for (; width < count; width *= 2)
+        {
+            pool.parallelFor((count + width * 2 - 1) / (width * 2), [&](size_t pair) {
+                size_t start = pair * width * 2;
+                size_t middle = std::min(start + width, count);
+                size_t end = std::min(start + width * 2, count);
+                std::inplace_merge(values.begin() + start, values.begin() + middle, values.begin() + end);
+                });
+        }
+    }
+
+    // Runs func(chunk) for every chunk in [0, chunkCount) on the shared pool
+    template<typename Func>
+    void parallelChunks(size_t chunkCount, Func func)
+    {
+        ThreadPool::shared().parallelFor(chunkCount, func);
+    }
+
+    // Formats rows [0, count) into one buffer per chunk of rows, the chunks in parallel when
+    // there are several. formatRow(p, i) writes at most maxRowSize characters at p and returns the end.
+    template<typename Func>
+    std::vector<std::vector<char>> formatRows(size_t count, size_t maxRowSize, Func formatRow)
+    {
+        const size_t rowsPerChunk = 1 << 15;
+        const size_t chunkCount = (count + rowsPerChunk - 1) / rowsPerChunk;
+        std::vector<std::vector<char>> chunks(chunkCount);
+        auto formatChunk = [&](size_t chunk)
+        {
+            const size_t start = chunk * rowsPerChunk;
+            const size_t end = std::min(start + rowsPerChunk, count);
+            std::vector<char>& buffer = chunks[chunk];
+            buffer.resize((end - start) * maxRowSize);
+            char* p = buffer.data();
+            for (size_t i = start; i < end; ++i)
+                p = formatRow(p, i);
+            buffer.resize(p - buffer.data());
+        };
+
+        parallelChunks(chunkCount, formatChunk);
+        return chunks;
+    }
+
+    // Writes " value" for each value, in the shortest form that reads back to the same float
+    char* formatValues(char* p, std::initializer_list<float> values)
+    {
+        for (float value : values)
+        {
+            *p++ = ' ';
+            p = std::to_chars(p, p + 24, value).ptr;
+        }
+        return p;
+    }
+
+    // Where every texel of a mesh texture takes its value from. It depends only on the triangles,
+    // their texture coordinates and the texture size, so it is built once and every frame exported
+    // at that size just gathers the values.
+    struct TextureMap
+    {
+        struct Texel
+        {
+            int face = -1;          // first of the triangle's entries in the snapshot, -1 for background
+            float u = 0.f, v = 0.f; // weights of the triangle's second and third corners
+        };
+
+        uint64_t layout = 0;
+        int width = 0, height = 0, dilation = 0;
+        std::vector<Texel> texels;
+    };
+
+    std::shared_ptr<const TextureMap> buildTextureMap(const SimulationDomain::TextureSnapshot& snapshot, uint64_t layout, int width, int height)
+    {
+        auto map = std::make_shared<TextureMap>();
+        map->layout = layout;
+        map->width = width;
+        map->height = height;
+        map->dilation = snapshot.dilation;
+        std::vector<TextureMap::Texel>& texels = map->texels;
+        texels.resize(static_cast<size_t>(width) * height);
+
+        // One band of rows per thread, each visits the triangles in order so later triangles
+        // still cover earlier ones
+        const size_t bandCount = std::max<size_t>(1, std::min<size_t>(ThreadPool::shared().getNumThreads(), height));
+        const int rowsPerBand = static_cast<int>((height + bandCount - 1) / bandCount);
+        parallelChunks(bandCount, [&](size_t band)
+        {
+            const int bandMinY = static_cast<int>(band) * rowsPerBand;
+            const int bandMaxY = std::min(bandMinY + rowsPerBand, height) - 1;
+            for (size_t f = 0; f < snapshot.indices.size(); f += 3)
+            {
+                Vec2 t0 = snapshot.textureCoords[f];
+                Vec2 t1 = snapshot.textureCoords[f + 1];
+                Vec2 t2 = snapshot.textureCoords[f + 2];
+
+                int minX = static_cast<int>(Utils::min(Utils::min(t0.u_, t1.u_), t2.u_) * (width - 1));
+                int minY = static_cast<int>(Utils::min(Utils::min(t0.v_, t1.v_), t2.v_) * (height - 1));
+                int maxX = static_cast<int>(Utils::max(Utils::max(t0.u_, t1.u_), t2.u_) * (width - 1));
+                int maxY = static_cast<int>(Utils::max(Utils::max(t0.v_, t1.v_), t2.v_) * (height - 1));
+                minX = std::max(minX, 0);
+                maxX = std::min(maxX, width - 1);
+                minY = std::max(minY, bandMinY);
+                maxY = std::min(maxY, bandMaxY);
+
+                float u = 0.f, v = 0.f, w = 0.f;
+                for (int x = minX; x <= maxX; ++x)
+                {
+                    for (int y = minY; y <= maxY; ++y)
+                    {
+                        if (pointInTriangle(
+                            Vec3(t0.x_, t0.y_, 0.f),
+                            Vec3(t1.x_, t1.y_, 0.f),
+                            Vec3(t2.x_, t2.y_, 0.f),
+                            Vec3(x / (width - 1.f), y / (height - 1.f), 0.f),
+                            u, v, w))
+                            texels[x + (height - 1 - y) * width] = { static_cast<int>(f), u, v };
+                    }
+                }
+            }
+        });
+
+        // Background texels within dilation of the surface take the value of the closest covered
+        // texel to avoid texture seams. The closest one comes from an exact distance transform,
+        // a pass down the columns and then one along the rows, both in parallel.
+        const int dilation = snapshot.dilation;
+        if (dilation > 0)
+        {
+            // Row of the closest covered texel in each texel's column, -1 if it's further than dilation
+            std::vector<int> closest(texels.size(), -1);
+            const int columnsPerBlock = 64;
+            parallelChunks((width + columnsPerBlock - 1) / columnsPerBlock, [&](size_t block)
+            {
+                const int minX = static_cast<int>(block) * columnsPerBlock;
+                const int maxX = std::min(minX + columnsPerBlock, width);
+                for (int y = 0; y < height; ++y)
+                {
+                    for (int x = minX; x < maxX; ++x)
+                    {
+                        const size_t i = x + static_cast<size_t>(y) * width;
+                        if (texels[i].face != -1)
+                            closest[i] = y;
+                        else if (y > 0 && closest[i - width] != -1 && y - closest[i - width] <= dilation)
+                            closest[i] = closest[i - width];
+                    }
+                }
+                for (int y = height - 2; y >= 0; --y)
+                {
+                    for (int x = minX; x < maxX; ++x)
+                    {
+                        const size_t i = x + static_cast<size_t>(y) * width;
+                        const int below = closest[i + width];
+                        if (below != -1 && below - y <= dilation && (closest[i] == -1 || below - y < y - closest[i]))
+                            closest[i] = below;
+                    }
+                }
+            });
+
+            // Along each row the closest covered texel is found on the lower envelope of the
+            // parabolas (x - column)^2 + (y - row)^2 of the columns' closest texels. Each row's
+            // result replaces its column rows, which no other row reads.
+            const double maxDistance = static_cast<double>(dilation) * dilation;
+            parallelChunks(bandCount, [&](size_t band)
+            {
+                std::vector<int> columns(width), sources(width);
+                std::vector<double> bounds(width);
+                const int bandMinY = static_cast<int>(band) * rowsPerBand;
+                const int bandMaxY = std::min(bandMinY + rowsPerBand, height);
+                for (int y = bandMinY; y < bandMaxY; ++y)
+                {
+                    int* rows = closest.data() + static_cast<size_t>(y) * width;
+                    auto parabola = [&](int x) { const double dy = rows[x] - y; return dy * dy + static_cast<double>(x) * x; };
+
+                    int k = -1;
+                    for (int x = 0; x < width; ++x)
+                    {
+                        if (rows[x] == -1)
+                            continue;
+
+                        double bound = -std::numeric_limits<double>::infinity();
+                        while (k >= 0)
+                        {
+                            bound = (parabola(x) - parabola(columns[k])) / (2.0 * (x - columns[k]));
+                            if (bound > bounds[k])
+                                break;
+                            --k;
+                        }
+                        if (k < 0)
+                            bound = -std::numeric_limits<double>::infinity();
+                        columns[++k] = x;
+                        bounds[k] = bound;
+                    }
+
+                    for (int x = 0, j = 0; x < width; ++x)
+                    {
+                        sources[x] = -1;
+                        if (k < 0 || texels[x + static_cast<size_t>(y) * width].face != -1)
+                            continue;
+
+                        while (j < k && bounds[j + 1] < x)
+                            ++j;
+                        const int column = columns[j];
+                        const double dx = x - column;
+                        const double dy = rows[column] - y;
+                        if (dx * dx + dy * dy <= maxDistance)
+                            sources[x] = column + rows[column] * width;
+                    }
+                    std::copy(sources.begin(), sources.end(), rows);
+                }
+            });
+
+            for (size_t i = 0; i < texels.size(); ++i)
+                if (closest[i] >= 0)
+                    texels[i] = texels[closest[i]];
+        }
+        return map;
+    }
+
+    // The maps of the last two layouts or sizes, so a run that alternates between full and
+    // degraded textures keeps both
+    std::shared_ptr<const TextureMap> findTextureMap(const SimulationDomain::TextureSnapshot& snapshot, int width, int height)
+    {
+        static std::mutex mutex;
+        static std::vector<std::shared_ptr<const TextureMap>> maps; // most recently used last
+
+        uint64_t layout = Checkpoint::checksum(snapshot.indices.data(), snapshot.indices.size() * sizeof(unsigned));
+        layout = layout * 31 + Checkpoint::checksum(snapshot.textureCoords.data(), snapshot.textureCoords.size() * sizeof(Vec2));
+
+        // Built under the lock, writers that need the same map wait for it instead of building it again
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t i = 0; i < maps.size(); ++i)
+        {
+            if (maps[i]->layout == layout && maps[i]->width == width && maps[i]->height == height && maps[i]->dilation == snapshot.dilation)
+            {
+                std::shared_ptr<const TextureMap> map = maps[i];
+                maps.erase(maps.begin() + i);
+                maps.push_back(map);
+                return map;
+            }
+        }
+
+        maps.push_back(buildTextureMap(snapshot, layout, width, height));
+        if (maps.size() > 2)
+            maps.erase(maps.begin());
+        return maps.back();
+    }
+}
 
 
 HalfEdgeMesh::HalfEdgeMesh()
@@ -41,11 +341,20 @@ void HalfEdgeMesh::init(const Drawable& drawable)
     }
 
     //============== reset mesh state =================
+    spatialHashDirty_ = true;
     edges.clear();
     faces.clear();
     vertices.clear();
+    edgeKeyIndexMap.clear();
+    gradCoefs.clear();
     initialized_ = false;
 
+    // Interior edges come in pairs so there are about as many half edges as indices
+    const size_t numFaces = drawable.indices_.size() / 3;
+    edges.reserve(drawable.indices_.size() + numFaces / 2);
+    faces.reserve(numFaces);
+    edgeKeyIndexMap.reserve(drawable.indices_.size() + numFaces / 2);
+
     prevP_.resize(1, Vec3(0.f, 0.f, 0.f));
     cells1.resize(numVertices);
     cells2.resize(numVertices);
@@ -61,6 +370,47 @@ void HalfEdgeMesh::init(const Drawable& drawable)
         colors_ = drawable.colors_;
 
     //Create edges, faces, vertices
+    ThreadPool& pool = ThreadPool::shared();
+    if (createFromTriangles(drawable, pool))
+    {
+        pool.parallelFor(faces.size(), [&](size_t i) { calculateFaceArea(faces[i]); });
+        pool.parallelFor(vertices.size(), [&](size_t i) { calculateDualArea(vertices[i]); });
+        pool.parallelFor(faces.size(), [&](size_t i) { calculateFaceNormal(faces[i]); });
+        pool.parallelFor(vertices.size(), [&](size_t i) { calculateVertexNormal(vertices[i]); });
+    }
+    else
+    {
+        createFromTrianglesIncremental(drawable);
+        createBoundaryEdges();
+        calculateBoundaryVertices();
+        calculateDualAreas();
+        calculateFaceNormals();
+        calculateVertexNormals();
+    }
+
+    // Init gradient lines graphics
+    for (size_t i = 0; i < faces.size(); ++i)
+        gradientLines.addLine(Vec3(0, 0, 0), Vec3(1,0,0), Vec3(0.2f, 0.2f, 0.2f), Vec3(1, 0, 0));
+
+    // Create openGL representation
+    initVBOs();
+
+    // Print mesh info
+    printInfo();
+
+    ASSERT(!validateMesh(), "Mesh is invalid");
+}
+
+// One triangle at a time, handles input the bulk builder rejects
+void HalfEdgeMesh::createFromTrianglesIncremental(const Drawable& drawable)
+{
+    edges.clear();
+    faces.clear();
+    vertices.clear();
+    edgeKeyIndexMap.clear();
+    gradCoefs.clear();
+    indices_.clear();
+
     for (size_t i = 0; i < drawable.indices_.size() - 2; i += 3)
     {
         unsigned i0 = drawable.indices_[i];
@@ -73,30 +423,197 @@ void HalfEdgeMesh::init(const Drawable& drawable)
         Vertex* v2 = vertexExists(i2) ? vertices[i2] : createVertex(drawable.positions_[i2], i2);
 
         // Get Edges
-        Edge* e01 = edgeExists(v0, v1) ? getEdge(v0, v1) : createEdge(v0, v1);
-        Edge* e12 = edgeExists(v1, v2) ? getEdge(v1, v2) : createEdge(v1, v2);
-        Edge* e20 = edgeExists(v2, v0) ? getEdge(v2, v0) : createEdge(v2, v0);
+        Edge* e01 = findEdge(i0, i1);
+        Edge* e12 = findEdge(i1, i2);
+        Edge* e20 = findEdge(i2, i0);
+        if (e01 == nullptr) e01 = createEdge(v0, v1);
+        if (e12 == nullptr) e12 = createEdge(v1, v2);
+        if (e20 == nullptr) e20 = createEdge(v2, v0);
 
         // Create Face
         createFace(e01, e12, e20);
     }
-    createBoundaryEdges();
-    calculateBoundaryVertices();
-    calculateDualAreas();
-    calculateFaceNormals();
-    calculateVertexNormals();
+}
 
-    // Init gradient lines graphics
-    for (size_t i = 0; i < faces.size(); ++i)
-        gradientLines.addLine(Vec3(0, 0, 0), Vec3(1,0,0), Vec3(0.2f, 0.2f, 0.2f), Vec3(1, 0, 0));
+// Builds the whole structure at once. Half edge 3 * t + k runs from corner k of triangle t
+// to corner k + 1, twins are found by sorting the half edges on their undirected vertex pair
+// and boundary half edges are appended after them. The resulting indices, pairs and vertex
+// edges match the incremental build. Returns false without modifying the mesh if the input
+// has degenerate triangles, inconsistent winding or non-manifold edges or vertices.
+bool HalfEdgeMesh::createFromTriangles(const Drawable& drawable, ThreadPool& pool)
+{
+    const std::vector<unsigned>& triangles = drawable.indices_;
+    const size_t numFaces = triangles.size() / 3;
+    const size_t numHalfEdges = numFaces * 3;
+    if (numFaces == 0)
+        return false;
 
-    // Create openGL representation
-    initVBOs();
+    auto origin = [&triangles](size_t e) { return triangles[e]; };
+    auto destination = [&triangles](size_t e) { return triangles[e - e % 3 + (e + 1) % 3]; };
+
+    // Sort half edges by their undirected key so twins end up next to each other
+    std::vector<std::pair<EdgeKey, unsigned>> sorted(numHalfEdges);
+    pool.parallelFor(numHalfEdges, [&](size_t e) {
+        unsigned i0 = origin(e);
+        unsigned i1 = destination(e);
+        sorted[e] = std::make_pair(edgeKey(std::min(i0, i1), std::max(i0, i1)), static_cast<unsigned>(e));
+        });
+    parallelSort(pool, sorted);
+
+    // Pair up runs of equal keys
+    std::vector<int> twin(numHalfEdges, -1);
+    std::vector<char> valid(pool.getNumThreads(), 1);
+    size_t runsPerThread = (numHalfEdges + pool.getNumThreads() - 1) / pool.getNumThreads();
+    pool.parallelFor(pool.getNumThreads(), [&](size_t thread) {
+        size_t end = std::min((thread + 1) * runsPerThread, numHalfEdges);
+        for (size_t i = thread * runsPerThread; i < end; ++i)
+        {
+            // Each thread owns the runs starting in its range
+            if (i > 0 && sorted[i - 1].first == sorted[i].first)
+                continue;
 
-    // Print mesh info
-    printInfo();
+            size_t runLength = 1;
+            while (i + runLength < numHalfEdges && sorted[i + runLength].first == sorted[i].first)
+                runLength++;
 
-    ASSERT(!validateMesh(), "Mesh is invalid");
+            unsigned e0 = sorted[i].second;
+            if (origin(e0) == destination(e0) || runLength > 2)
+            {
+                valid[thread] = 0;
+                return;
+            }
+            if (runLength == 2)
+            {
+                unsigned e1 = sorted[i + 1].second;
+                if (origin(e0) != destination(e1))
+                {
+                    valid[thread] = 0;
+                    return;
+                }
+                twin[e0] = e1;
+                twin[e1] = e0;
+            }
+        }
+        });
+    if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+        return false;
+    sorted = std::vector<std::pair<EdgeKey, unsigned>>();
+
+    // Boundary half edges are created in order of the face half edge they pair with,
+    // and each boundary vertex must have exactly one outgoing boundary half edge
+    unsigned numVertices = *std::max_element(triangles.begin(), triangles.end()) + 1;
+    std::vector<unsigned> boundaryTwin;
+    std::vector<int> boundaryOut(numVertices, -1);
+    for (size_t e = 0; e < numHalfEdges; ++e)
+    {
+        if (twin[e] != -1)
+            continue;
+
+        unsigned b = static_cast<unsigned>(numHalfEdges + boundaryTwin.size());
+        if (boundaryOut[destination(e)] != -1)
+            return false;
+        boundaryOut[destination(e)] = b;
+        twin[e] = b;
+        boundaryTwin.emplace_back(static_cast<unsigned>(e));
+    }
+    for (unsigned e : boundaryTwin)
+        if (boundaryOut[origin(e)] == -1)
+            return false;
+    const size_t numEdges = numHalfEdges + boundaryTwin.size();
+
+    // Vertices keep the edge the incremental build would leave them with, the
+    // half edge of the last face around them or their outgoing boundary edge
+    std::vector<int> vertexEdge(numVertices, -1);
+    for (size_t e = 0; e < numHalfEdges; ++e)
+        vertexEdge[origin(e)] = static_cast<int>(e);
+    for (unsigned i = 0; i < numVertices; ++i)
+        if (boundaryOut[i] != -1)
+            vertexEdge[i] = boundaryOut[i];
+
+    // Allocate everything
+    vertices.assign(numVertices, nullptr);
+    edges.resize(numEdges);
+    faces.resize(numFaces);
+    indices_.resize(numHalfEdges);
+    gradCoefs.resize(numFaces);
+
+    pool.parallelFor(numVertices, [&](size_t i) {
+        if (vertexEdge[i] == -1)
+            return;
+        positions_[i] = drawable.positions_[i];
+        vertices[i] = new Vertex(static_cast<unsigned>(i));
+        vertices[i]->isBoundary = boundaryOut[i] != -1;
+        });
+    pool.parallelFor(numEdges, [&](size_t e) {
+        Edge* edge = new Edge();
+        edge->index = static_cast<unsigned>(e);
+        edge->diffVec.resize(numMorphs_);
+        edge->cotacotb.resize(numMorphs_);
+        edge->nranVec.resize(numMorphs_);
+        edges[e] = edge;
+        });
+    pool.parallelFor(numFaces, [&](size_t t) {
+        faces[t] = new Face();
+        faces[t]->index = static_cast<unsigned>(t);
+        faces[t]->firstIndexIndex = static_cast<unsigned>(t * 3);
+        });
+
+    // Link face half edges
+    pool.parallelFor(numHalfEdges, [&](size_t e) {
+        Edge* edge = edges[e];
+        edge->setOrigin(vertices[origin(e)]);
+        edge->setDestination(vertices[destination(e)]);
+        edge->setNext(edges[e - e % 3 + (e + 1) % 3]);
+        edge->setPair(edges[twin[e]]);
+        edge->setFace(faces[e / 3]);
+        edge->key = edgeKey(origin(e), destination(e));
+        edge->isBoundary = twin[e] >= (int)numHalfEdges;
+        indices_[e] = origin(e);
+        });
+
+    // Link boundary half edges into loops
+    pool.parallelFor(boundaryTwin.size(), [&](size_t i) {
+        unsigned e = boundaryTwin[i];
+        Edge* edge = edges[numHalfEdges + i];
+        edge->setOrigin(vertices[destination(e)]);
+        edge->setDestination(vertices[origin(e)]);
+        edge->setNext(edges[boundaryOut[origin(e)]]);
+        edge->setPair(edges[e]);
+        edge->key = edgeKey(destination(e), origin(e));
+        edge->isBoundary = true;
+        });
+
+    pool.parallelFor(numVertices, [&](size_t i) {
+        if (vertices[i] != nullptr)
+            vertices[i]->setEdge(edges[vertexEdge[i]]);
+        });
+
+    // Per face geometry, same as join()
+    pool.parallelFor(numFaces, [&](size_t t) {
+        Face* f = faces[t];
+        Edge* e0 = edges[t * 3];
+        Edge* e1 = edges[t * 3 + 1];
+        Edge* e2 = edges[t * 3 + 2];
+        unsigned i0 = triangles[t * 3];
+        unsigned i1 = triangles[t * 3 + 1];
+        unsigned i2 = triangles[t * 3 + 2];
+
+        e0->angle = acuteAngleBetween(positions_[i1] - positions_[i0], positions_[i2] - positions_[i0]);
+        e1->angle = acuteAngleBetween(positions_[i0] - positions_[i1], positions_[i2] - positions_[i1]);
+        e2->angle = acuteAngleBetween(positions_[i0] - positions_[i2], positions_[i1] - positions_[i2]);
+
+        f->area = areaBetween(positions_[i1] - positions_[i0], positions_[i2] - positions_[i0]);
+        f->circumcentre = calculateCentre(i0, i1, i2);
+        f->setEdge(e0);
+        f->normal = normalize(cross(positions_[i1] - positions_[i0], positions_[i2] - positions_[i0]));
+        precomputeGradCoef(f);
+        });
+
+    edgeKeyIndexMap.reserve(numEdges);
+    for (Edge* e : edges)
+        edgeKeyIndexMap.insert(e->key, e->index);
+
+    return true;
 }
 
 bool HalfEdgeMesh::isInitialized()
@@ -261,8 +778,73 @@ void HalfEdgeMesh::subdivideFace(Face* f)
     }
 }
 
+// Splits f like subdivideFace, then gives each new cell the mean of the edge it split and
+// rescales every cell whose dual area changed so each morphogen's mass is what it was before.
+// The dual areas of the existing vertices must be up to date.
+void HalfEdgeMesh::subdivideFaceConservatively(Face* f)
+{
+    const size_t firstTouched = touchedVertices_.size();
+    const unsigned firstNew = static_cast<unsigned>(vertices.size());
+    subdivideFace(f);
+
+    std::vector<unsigned> region(touchedVertices_.begin() + firstTouched, touchedVertices_.end());
+    std::sort(region.begin(), region.end());
+    region.erase(std::unique(region.begin(), region.end()), region.end());
+
+    auto& cells = getWriteToCells();
+    std::vector<float> mass(numMorphs_, 0.f);
+    for (unsigned i : region)
+        if (i < firstNew)
+            for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+                mass[morphIndex] += cells[i][morphIndex] * vertices[i]->area;
+
+    // Later splits can end on earlier new vertices, so they are filled in creation order
+    for (unsigned i = firstNew; i < vertices.size(); ++i)
+    {
+        const std::vector<unsigned>& ends = cellsToUpdate[i].neighbours;
+        for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+            cells[i][morphIndex] = (cells[ends[0]][morphIndex] + cells[ends[1]][morphIndex]) * .5f;
+    }
+
+    for (unsigned i : region)
+    {
+        Edge* start = vertices[i]->edge();
+        Edge* current = start;
+        do
+        {
+            if (current->face() != nullptr)
+                calculateFaceArea(current->face());
+            current = current->pair()->next();
+        } while (start != current);
+    }
+    for (unsigned i : region)
+        calculateDualArea(vertices[i]);
+
+    for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+    {
+        float newMass = 0.f;
+        for (unsigned i : region)
+            newMass += cells[i][morphIndex] * vertices[i]->area;
+
+        float scale = newMass != 0.f ? mass[morphIndex] / newMass : 1.f;
+        if (!std::isfinite(scale))
+            scale = 1.f;
+
+        for (unsigned i : region)
+            if (!cells[i].isConstVal[morphIndex])
+                cells[i][morphIndex] *= scale;
+    }
+
+    for (unsigned i : region)
+    {
+        cells1[i] = cells[i];
+        cells2[i] = cells[i];
+    }
+}
+
 void HalfEdgeMesh::precomputeGradCoefs()
 {
+    gradCoefs.resize(faces.size());
     for (Face* f : faces)
         precomputeGradCoef(f);
 }
@@ -301,14 +883,21 @@ void HalfEdgeMesh::precomputeGradCoef(Face* f)
     int j = f->edge()->destination()->index;
     int k = f->edge()->next()->destination()->index;
 
+    if (f->index >= gradCoefs.size())
+        gradCoefs.resize(f->index + 1);
+
     float area = (1.f / (f->area * 2.f));
-    gradCoefs[f] = std::pair<Vec3, Vec3>(
+    gradCoefs[f->index] = std::pair<Vec3, Vec3>(
         area * rotate((positions_[i] - positions_[k]), Math::degToRad(90.f), f->normal),		// e_ki 
         area * rotate((positions_[j] - positions_[i]), Math::degToRad(90.f), f->normal));		// e_ij
 }
 
 void HalfEdgeMesh::growAndSubdivide(Vec3& growth, float maxFaceArea, bool subdivisionEnabled, size_t stepCount)
 {
+    // Finish whatever is left over from the previous growth tick
+    if (growthPending())
+        continueGrowth(0.f);
+
     // Grow
     if (growthMode == SimulationDomain::GrowthMode::AnimationGrowth)
         animation_.updatePositionsFromUVs(positions_, stepCount);
@@ -341,56 +930,761 @@ void HalfEdgeMesh::growAndSubdivide(Vec3& growth, float maxFaceArea, bool subdiv
             i++;
         }
     }
-
-    // Find faces that are too big
-    const unsigned FACE_COUNT = static_cast<unsigned>(faces.size());
-    bool subdivdeHappened = false;
-    if (subdivisionEnabled)
+
+    spatialHashDirty_ = true;
+
+    // Find faces that are too big, or too coarse for the solution when adapting
+    fatFaces_.clear();
+    if (subdivisionEnabled)
+    {
+        bool adapting = adaptivityInfo.enabled && !isGPUEnabled;
+        std::vector<float> faceErrors;
+        if (adapting)
+        {
+            // Conservative splits weigh the cells by their dual areas before and after
+            calculateFaceAreas();
+            calculateDualAreas();
+            faceErrors = calculateFaceErrors();
+        }
+
+        const unsigned FACE_COUNT = static_cast<unsigned>(faces.size());
+        for (unsigned i = 0; i < FACE_COUNT; ++i)
+        {
+            float area = faces[i]->area;
+            if (!std::isfinite(area))
+                continue;
+
+            if (area > maxFaceArea)
+                fatFaces_.emplace_back(i, maxFaceArea);
+            else if (adapting && area > adaptivityInfo.minFaceArea && faceErrors[i] > adaptivityInfo.refineError)
+                fatFaces_.emplace_back(i, std::max(area * .75f, adaptivityInfo.minFaceArea)); // skip once halved by a neighbour's split
+        }
+    }
+
+    growthMaxFaceArea_ = maxFaceArea;
+    growthSubdivided_ = false;
+    growthCursor_ = 0;
+    growthStage_ = GrowthStage::Subdivide;
+
+    // Geometry is refreshed on the device when using the GPU so do it all at once
+    continueGrowth(isGPUEnabled ? 0.f : growthTimeBudget);
+}
+
+// Works through the pending growth stages until timeBudget (ms) is spent. 
+// A budget <= 0 finishes all remaining work.
+bool HalfEdgeMesh::continueGrowth(float timeBudget)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto startTime = Clock::now();
+
+    // Runs work(i) on [growthCursor_, count) in chunks, returns false if time ran out first
+    auto runSliced = [&](size_t count, size_t chunkSize, auto work)
+    {
+        while (growthCursor_ < count)
+        {
+            size_t chunkEnd = std::min(count, growthCursor_ + chunkSize);
+            for (; growthCursor_ < chunkEnd; ++growthCursor_)
+                work(growthCursor_);
+
+            if (timeBudget > 0.f && growthCursor_ < count &&
+                std::chrono::duration<float, std::milli>(Clock::now() - startTime).count() >= timeBudget)
+                return false;
+        }
+        growthCursor_ = 0;
+        return true;
+    };
+
+    if (growthStage_ == GrowthStage::Subdivide)
+    {
+        bool subdivided = false;
+        bool done = runSliced(fatFaces_.size(), 1, [&](size_t i) 
+            {
+                // The recursive subdivision may have already split a previously fat face
+                Face* f = faces[fatFaces_[i].first];
+                if (f->area >= fatFaces_[i].second)
+                {
+                    if (adaptivityInfo.enabled && !isGPUEnabled)
+                        subdivideFaceConservatively(f);
+                    else
+                        subdivideFace(f);
+                    subdivided = true;
+                }
+            });
+
+        if (subdivided)
+        {
+            // New cells are simulated next step so their coefficients must be valid now
+            if (!isGPUEnabled && timeBudget > 0.f)
+                refreshRegion(touchedVertices_);
+            touchedVertices_.clear();
+            growthSubdivided_ = true;
+        }
+
+        if (!done)
+            return true;
+
+        // Rebuilt once per pass, until then updates only fill the cells the buffers were made with
+        if (growthSubdivided_)
+        {
+            destroyVBOs();
+            initVBOs();
+        }
+        fatFaces_.clear();
+        growthStage_ = isGPUEnabled ? GrowthStage::Idle : GrowthStage::Coarsen;
+    }
+
+    // Removing cells renumbers everything so coarsening is done in one go
+    if (growthStage_ == GrowthStage::Coarsen)
+    {
+        if (adaptivityInfo.enabled)
+            coarsen(growthMaxFaceArea_);
+        growthStage_ = GrowthStage::FaceGeometry;
+    }
+
+    // Angles, face areas and normals are refreshed in place. Dual areas, cotangents and diffusion
+    // vectors are computed into the staged copies and swapped in together after the last stage,
+    // so a sliced pass never simulates with a mix of old and new coefficients
+    if (growthStage_ == GrowthStage::FaceGeometry)
+    {
+        bool done = runSliced(faces.size(), 256, [&](size_t i)
+            {
+                Face* f = faces[i];
+                calculateAngles(f);
+                calculateFaceArea(f);
+                calculateFaceNormal(f);
+                for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+                {
+                    Vec3 T = cross(f->normal, tangents[morphIndex][f->index]);
+                    tangents[morphIndex][f->index] = normalize(cross(T, f->normal));
+                }
+            });
+
+        if (!done)
+            return true;
+        stageCoefficients();
+        growthStage_ = GrowthStage::VertexGeometry;
+    }
+
+    // calculateCotangent writes v's outgoing half edges, so those are swapped around it too
+    if (growthStage_ == GrowthStage::VertexGeometry)
+    {
+        bool done = runSliced(vertices.size(), 256, [&](size_t i)
+            {
+                Vertex* v = vertices[i];
+                calculateVertexNormal(v);
+
+                Edge* start = v->edge();
+                Edge* current = start;
+                swapStaged(v);
+                do
+                {
+                    swapStaged(current);
+                    current = current->pair()->next();
+                } while (current != start);
+
+                calculateDualArea(v);
+                for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+                    calculateCotangent(v, morphIndex);
+
+                swapStaged(v);
+                do
+                {
+                    swapStaged(current);
+                    current = current->pair()->next();
+                } while (current != start);
+            });
+
+        if (!done)
+            return true;
+        growthStage_ = GrowthStage::DiffusionCoefs;
+    }
+
+    if (growthStage_ == GrowthStage::DiffusionCoefs)
+    {
+#if DIFFUSION_EQNS==1
+        // Reads the staged cotangents of the face's half edges and writes their diffusion vectors
+        bool done = runSliced(faces.size(), 256, [&](size_t i)
+            {
+                Edge* e = faces[i]->edge();
+                for (int k = 0; k < 3; ++k, e = e->next())
+                    swapStaged(e);
+                computeVecLambda(faces[i]);
+                for (int k = 0; k < 3; ++k, e = e->next())
+                    swapStaged(e);
+            });
+
+        if (!done)
+            return true;
+#endif
+        for (Vertex* v : vertices)
+            swapStaged(v);
+        for (Edge* e : edges)
+            swapStaged(e);
+        growthStage_ = GrowthStage::Idle;
+    }
+
+    finishGrowth();
+    return false;
+}
+
+bool HalfEdgeMesh::growthPending() const
+{
+    return growthStage_ != GrowthStage::Idle;
+}
+
+// Recalculates geometry and diffusion coefficients around the given vertices only
+void HalfEdgeMesh::refreshRegion(const std::vector<unsigned>& vertexIndices)
+{
+    std::vector<Face*> regionFaces;
+    std::vector<Vertex*> regionVertices;
+    for (unsigned i : vertexIndices)
+    {
+        Vertex* v = vertices[i];
+        regionVertices.push_back(v);
+
+        Edge* start = v->edge();
+        Edge* current = start;
+        do
+        {
+            if (current->face() != nullptr)
+                regionFaces.push_back(current->face());
+            regionVertices.push_back(current->destination());
+            current = current->pair()->next();
+        } while (start != current);
+    }
+
+    std::sort(regionFaces.begin(), regionFaces.end());
+    regionFaces.erase(std::unique(regionFaces.begin(), regionFaces.end()), regionFaces.end());
+    std::sort(regionVertices.begin(), regionVertices.end());
+    regionVertices.erase(std::unique(regionVertices.begin(), regionVertices.end()), regionVertices.end());
+
+    for (Face* f : regionFaces)
+    {
+        calculateAngles(f);
+        calculateFaceArea(f);
+        calculateFaceNormal(f);
+        for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+        {
+            Vec3 T = cross(f->normal, tangents[morphIndex][f->index]);
+            tangents[morphIndex][f->index] = normalize(cross(T, f->normal));
+        }
+    }
+
+    for (Vertex* v : regionVertices)
+    {
+        calculateVertexNormal(v);
+        calculateDualArea(v);
+        for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+            calculateCotangent(v, morphIndex);
+    }
+
+#if DIFFUSION_EQNS==1
+    for (Face* f : regionFaces)
+        computeVecLambda(f);
+#endif
+}
+
+// Estimated change of the solution across each face, the larger of the gradient and
+// the jump in gradient to its neighbours (curvature) over the face's length scale
+std::vector<float> HalfEdgeMesh::calculateFaceErrors()
+{
+    auto& cells = getWriteToCells();
+    const size_t FACE_COUNT = faces.size();
+
+    std::vector<Vec3> grads(FACE_COUNT * numMorphs_);
+    for (size_t i = 0; i < FACE_COUNT; ++i)
+        for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+            gradientFace(faces[i], morphIndex, cells, grads[i * numMorphs_ + morphIndex]);
+
+    std::vector<float> errors(FACE_COUNT, 0.f);
+    for (size_t i = 0; i < FACE_COUNT; ++i)
+    {
+        Face* f = faces[i];
+        float h = sqrt(f->area);
+        for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+        {
+            const Vec3& grad = grads[i * numMorphs_ + morphIndex];
+            float jump = 0.f;
+            Edge* e = f->edge();
+            do
+            {
+                Face* neighbour = e->pair()->face();
+                if (neighbour != nullptr)
+                    jump = std::max(jump, (grad - grads[neighbour->index * numMorphs_ + morphIndex]).length());
+                e = e->next();
+            } while (e != f->edge());
+
+            float error = std::max(grad.length(), jump) * h;
+            if (std::isfinite(error))
+                errors[i] = std::max(errors[i], error);
+        }
+    }
+    return errors;
+}
+
+// e can be collapsed if it is interior, smooth, keeps the mesh manifold (link condition)
+// and the faces it moves neither flip nor get too big
+bool HalfEdgeMesh::canCollapse(Edge* e, const std::vector<float>& faceErrors, const std::vector<bool>& locked)
+{
+    Edge* ePair = e->pair();
+    if (e->face() == nullptr || ePair == nullptr || ePair->face() == nullptr)
+        return false;
+
+    Vertex* v0 = e->origin();
+    Vertex* v1 = e->destination();
+    if (v0->isBoundary || v1->isBoundary || locked[v0->index] || locked[v1->index])
+        return false;
+
+    for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+        if (cells1[v0->index].isConstVal[morphIndex] || cells1[v1->index].isConstVal[morphIndex])
+            return false;
+
+    Vertex* a = e->next()->destination();
+    Vertex* b = ePair->next()->destination();
+
+    auto ring = [](Vertex* v)
+    {
+        std::vector<Vertex*> neighbours;
+        Edge* start = v->edge();
+        Edge* current = start;
+        do
+        {
+            neighbours.push_back(current->destination());
+            current = current->pair()->next();
+        } while (start != current);
+        return neighbours;
+    };
+
+    // a and b lose an edge so must keep a valence of at least 3
+    if (ring(a).size() <= 3 || ring(b).size() <= 3)
+        return false;
+
+    // Link condition: only a and b may be shared by both rings
+    std::vector<Vertex*> ring0 = ring(v0);
+    for (Vertex* v : ring(v1))
+        if (v != a && v != b && std::find(ring0.begin(), ring0.end(), v) != ring0.end())
+            return false;
+
+    // Check the faces that will move with the merged vertex
+    const float maxArea = growthMaxFaceArea_ * .75f; // leave room before they are split again
+    Vec3 p = lerp(.5f, positions_[v0->index], positions_[v1->index]);
+    for (Vertex* v : { v0, v1 })
+    {
+        Edge* start = v->edge();
+        Edge* current = start;
+        do
+        {
+            Face* f = current->face();
+            if (f != nullptr)
+            {
+                if (faceErrors[f->index] >= adaptivityInfo.coarsenError)
+                    return false;
+
+                if (f != e->face() && f != ePair->face())
+                {
+                    Vec3 p1 = positions_[current->destination()->index];
+                    Vec3 p2 = positions_[current->next()->destination()->index];
+                    Vec3 n = cross(p1 - p, p2 - p);
+                    if (areaBetween(p1 - p, p2 - p) > maxArea || dot(normalize(n), f->normal) < .5f)
+                        return false;
+                }
+            }
+            current = current->pair()->next();
+        } while (start != current);
+    }
+
+    return true;
+}
+
+// Collapses e's destination into its origin, which moves to the edge's midpoint.
+// Concentrations are rescaled over the affected cells so their total mass is unchanged, and the
+// faces that take over the removed faces' area blend in their diffusion tensors and directions.
+void HalfEdgeMesh::collapseEdge(Edge* e, std::vector<bool>& locked)
+{
+    Edge* ePair = e->pair();
+    Vertex* v0 = e->origin();
+    Vertex* v1 = e->destination();
+    unsigned i0 = v0->index;
+    unsigned i1 = v1->index;
+
+    Edge* e1 = e->next();       // v1 -> a
+    Edge* e2 = e1->next();      // a -> v0
+    Edge* e3 = ePair->next();   // v0 -> b
+    Edge* e4 = e3->next();      // b -> v1
+    Edge* p1 = e1->pair();      // a -> v1
+    Edge* p2 = e2->pair();      // v0 -> a
+    Edge* p3 = e3->pair();      // b -> v0
+    Edge* p4 = e4->pair();      // v1 -> b
+    Vertex* a = e2->origin();
+    Vertex* b = e4->origin();
+    Face* fl = e->face();
+    Face* fr = ePair->face();
+
+    // Cells whose dual area changes
+    std::vector<unsigned> region;
+    for (Vertex* v : { v0, v1 })
+    {
+        Edge* start = v->edge();
+        Edge* current = start;
+        do
+        {
+            region.push_back(current->destination()->index);
+            current = current->pair()->next();
+        } while (start != current);
+    }
+    std::sort(region.begin(), region.end());
+    region.erase(std::unique(region.begin(), region.end()), region.end());
+
+    auto& cells = getWriteToCells();
+    std::vector<float> mass(numMorphs_, 0.f);
+    for (unsigned i : region)
+        for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+            mass[morphIndex] += cells[i][morphIndex] * vertices[i]->area;
+
+    // Faces that survive around the edge and the area they had
+    std::vector<std::pair<Face*, float>> ring;
+    for (Vertex* v : { v0, v1 })
+    {
+        Edge* start = v->edge();
+        Edge* current = start;
+        do
+        {
+            Face* f = current->face();
+            if (f != nullptr && f != fl && f != fr)
+                ring.emplace_back(f, f->area);
+            current = current->pair()->next();
+        } while (start != current);
+    }
+
+    // Area weighted tensors and directions of the two faces that go. Directions only matter up to
+    // sign, so they are turned to agree before being summed.
+    const float areaL = fl->area, areaR = fr->area;
+    const float removedArea = areaL + areaR;
+    std::vector<float> removedT0(numMorphs_), removedT1(numMorphs_);
+    std::vector<Vec3> removedTangents(numMorphs_);
+    for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+    {
+        const auto& tensors = diffusionTensors[morphIndex];
+        float wl = removedArea > 0.f ? areaL / removedArea : .5f;
+        removedT0[morphIndex] = Utils::lerp(tensors.t0_[fr->index], tensors.t0_[fl->index], wl);
+        removedT1[morphIndex] = Utils::lerp(tensors.t1_[fr->index], tensors.t1_[fl->index], wl);
+
+        Vec3 tl = tangents[morphIndex][fl->index];
+        Vec3 tr = tangents[morphIndex][fr->index];
+        if (dot(tl, tr) < 0.f)
+            tr = -1.f * tr;
+        removedTangents[morphIndex] = tl * areaL + tr * areaR;
+    }
+
+    // Merge v1 into v0
+    float area0 = v0->area, area1 = v1->area;
+    float w = area0 + area1 > 0.f ? area1 / (area0 + area1) : .5f;
+    for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+        cells[i0][morphIndex] = Utils::lerp(cells[i0][morphIndex], cells[i1][morphIndex], w);
+
+    positions_[i0] = lerp(.5f, positions_[i0], positions_[i1]);
+    normals_[i0] = normalize(normals_[i0] + normals_[i1]);
+    if (textureCoords_.size() > i1)
+        textureCoords_[i0] = (textureCoords_[i0] + textureCoords_[i1]) * .5f;
+    if (animation_.UVs_.size() > i1)
+    {
+        animation_.UVs_[i0] = (animation_.UVs_[i0] + animation_.UVs_[i1]) / 2.f;
+        animation_.invalidateWeights();
+    }
+
+    Edge* start = v1->edge();
+    Edge* current = start;
+    do
+    {
+        current->setOrigin(v0);
+        current->pair()->setDestination(v0);
+        current = current->pair()->next();
+    } while (start != current);
+
+    p1->setPair(p2);
+    p2->setPair(p1);
+    p3->setPair(p4);
+    p4->setPair(p3);
+    v0->setEdge(p2);
+    a->setEdge(p1);
+    b->setEdge(p3);
+
+    // Remove the two faces and six half edges around the collapsed edge
+    for (Edge* dead : { e, ePair, e1, e2, e3, e4 })
+    {
+        edges[dead->index] = nullptr;
+        delete dead;
+    }
+    for (Face* dead : { fl, fr })
+    {
+        faces[dead->index] = nullptr;
+        delete dead;
+    }
+    vertices[i1] = nullptr;
+    delete v1;
+
+    // Refresh the geometry around v0 and restore the region's mass
+    start = v0->edge();
+    current = start;
+    do
+    {
+        Face* f = current->face();
+        if (f != nullptr)
+        {
+            unsigned j = current->destination()->index;
+            unsigned k = current->next()->destination()->index;
+            calculateAngles(f);
+            calculateFaceArea(f);
+            calculateFaceNormal(f);
+            f->circumcentre = calculateCentre(i0, j, k);
+            precomputeGradCoef(f);
+        }
+        current = current->pair()->next();
+    } while (start != current);
+
+    // Each surviving face blends in the removed faces' values by the area it gained
+    for (auto& [f, oldArea] : ring)
+    {
+        float gained = f->area - oldArea;
+        if (!(gained > 0.f) || !(removedArea > 0.f))
+            continue;
+
+        float w = gained / f->area;
+        for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+        {
+            auto& tensors = diffusionTensors[morphIndex];
+            tensors.t0_[f->index] = Utils::lerp(tensors.t0_[f->index], removedT0[morphIndex], w);
+            tensors.t1_[f->index] = Utils::lerp(tensors.t1_[f->index], removedT1[morphIndex], w);
+
+            Vec3& tangent = tangents[morphIndex][f->index];
+            Vec3 removed = removedTangents[morphIndex];
+            if (dot(removed, tangent) < 0.f)
+                removed = -1.f * removed;
+            Vec3 blended = tangent * oldArea + removed * (gained / removedArea);
+            Vec3 T = cross(f->normal, blended);
+            if (T.length() > 0.f)
+                tangent = normalize(cross(T, f->normal));
+        }
+    }
+
+    region.erase(std::find(region.begin(), region.end(), i1));
+    for (unsigned i : region)
+        calculateDualArea(vertices[i]);
+
+    for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+    {
+        float newMass = 0.f;
+        for (unsigned i : region)
+            newMass += cells[i][morphIndex] * vertices[i]->area;
+
+        float scale = newMass != 0.f ? mass[morphIndex] / newMass : 1.f;
+        if (!std::isfinite(scale))
+            scale = 1.f;
+
+        for (unsigned i : region)
+            if (!cells[i].isConstVal[morphIndex])
+                cells[i][morphIndex] *= scale;
+    }
+
+    for (unsigned i : region)
+    {
+        cells1[i] = cells[i];
+        cells2[i] = cells[i];
+        locked[i] = true;
+    }
+}
+
+// Collapses the shortest edges in regions where the solution is smooth
+void HalfEdgeMesh::coarsen(float maxFaceArea)
+{
+    growthMaxFaceArea_ = maxFaceArea;
+    calculateFaceAreas();
+    calculateFaceNormals();
+    calculateDualAreas();
+    std::vector<float> faceErrors = calculateFaceErrors();
+
+    std::vector<std::pair<float, unsigned>> candidates;
+    for (Edge* e : edges)
+    {
+        if (e->face() == nullptr || e->pair()->face() == nullptr || e->index > e->pair()->index)
+            continue;
+        if (faceErrors[e->face()->index] < adaptivityInfo.coarsenError && faceErrors[e->pair()->face()->index] < adaptivityInfo.coarsenError)
+            candidates.emplace_back((positions_[e->origin()->index] - positions_[e->destination()->index]).length(), e->index);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, unsigned>& lhs, const std::pair<float, unsigned>& rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    // Collapses are kept apart so each sees up to date geometry
+    std::vector<bool> locked(vertices.size(), false);
+    unsigned collapsed = 0;
+    for (auto& candidate : candidates)
+    {
+        Edge* e = edges[candidate.second];
+        if (e == nullptr) // removed by an earlier collapse
+            continue;
+
+        if (canCollapse(e, faceErrors, locked))
+        {
+            collapseEdge(e, locked);
+            collapsed++;
+        }
+    }
+
+    if (collapsed > 0)
+    {
+        compact();
+        growthSubdivided_ = true;
+        destroyVBOs();
+        initVBOs();
+        anisotropicDiffusionTensor.destroyVBOs();
+        anisotropicDiffusionTensor.initVBOs();
+    }
+}
+
+// Removes the null slots left by edge collapses and renumbers everything that remains.
+// cellRemap records where each cell went so the simulation can follow.
+void HalfEdgeMesh::compact()
+{
+    // Vertices and their cells
+    cellRemap.assign(vertices.size(), -1);
+    unsigned n = 0;
+    for (unsigned i = 0; i < vertices.size(); ++i)
+    {
+        if (vertices[i] == nullptr)
+            continue;
+
+        cellRemap[i] = n;
+        if (n != i)
+        {
+            vertices[n] = vertices[i];
+            positions_[n] = positions_[i];
+            normals_[n] = normals_[i];
+            colors_[n] = colors_[i];
+            cells1[n] = std::move(cells1[i]);
+            cells2[n] = std::move(cells2[i]);
+            if (textureCoords_.size() > i)
+                textureCoords_[n] = textureCoords_[i];
+            if (animation_.UVs_.size() > i)
+                animation_.UVs_[n] = animation_.UVs_[i];
+            for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+                L[n * numMorphs_ + morphIndex] = L[i * numMorphs_ + morphIndex];
+        }
+        vertices[n]->index = n;
+        n++;
+    }
+    vertices.resize(n);
+    positions_.resize(n);
+    normals_.resize(n);
+    colors_.resize(n);
+    cells1.resize(n);
+    cells2.resize(n);
+    L.resize(n * numMorphs_);
+    if (textureCoords_.size() > n)
+        textureCoords_.resize(n);
+    if (animation_.UVs_.size() > n)
+        animation_.UVs_.resize(n);
+    animation_.invalidateWeights();
+
+    std::set<unsigned> selected;
+    for (unsigned i : selectedCells)
+        if (i < cellRemap.size() && cellRemap[i] != -1)
+            selected.insert(cellRemap[i]);
+    selectedCells = selected;
+    if (selectedCell >= (int)n)
+        selectedCell = 0;
+
+    // Faces and their per face data
+    n = 0;
+    for (unsigned i = 0; i < faces.size(); ++i)
     {
-        std::vector<unsigned> fatFaces;
-        for (unsigned i = 0; i < FACE_COUNT; ++i)
-            if (faces[i]->area > maxFaceArea && std::isfinite(faces[i]->area))
-                fatFaces.push_back(i);
+        if (faces[i] == nullptr)
+            continue;
 
-        // Subdivide faces
-        subdivdeHappened = fatFaces.size() > 0;
-        for (unsigned i : fatFaces)
-            // Need to check if we still need to subdivide face 
-            // because the recursive subdiv algorithm may have already
-            // subdivided some previously fat faces
-            if (faces[i]->area >= maxFaceArea) 
-                subdivideFace(faces[i]);
-    }
+        if (n != i)
+        {
+            faces[n] = faces[i];
+            if (i < gradCoefs.size())
+                gradCoefs[n] = gradCoefs[i];
+            for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
+            {
+                tangents[morphIndex][n] = tangents[morphIndex][i];
+                diffusionTensors[morphIndex].t0_[n] = diffusionTensors[morphIndex].t0_[i];
+                diffusionTensors[morphIndex].t1_[n] = diffusionTensors[morphIndex].t1_[i];
+            }
+            for (unsigned j = 0; j < 2; ++j)
+            {
+                gradientLines.positions_[n * 2 + j] = gradientLines.positions_[i * 2 + j];
+                anisotropicDiffusionTensor.positions_[n * 2 + j] = anisotropicDiffusionTensor.positions_[i * 2 + j];
+            }
+        }
 
-    if (subdivdeHappened)
-    {           
-        destroyVBOs();
-        initVBOs();
-        bvh_.build(*this);
+        Face* f = faces[n];
+        f->index = n;
+        f->firstIndexIndex = n * 3;
+        indices_[n * 3] = f->edge()->origin()->index;
+        indices_[n * 3 + 1] = f->edge()->next()->origin()->index;
+        indices_[n * 3 + 2] = f->edge()->next()->next()->origin()->index;
+        n++;
     }
-    else
+    faces.resize(n);
+    indices_.resize(n * 3);
+    if (gradCoefs.size() > n)
+        gradCoefs.resize(n);
+    for (int morphIndex = 0; morphIndex < numMorphs_; ++morphIndex)
     {
-        updatePositionVBO();
-        updateTextureVBO();
-        updateNormalVBO();        
+        tangents[morphIndex].resize(n);
+        diffusionTensors[morphIndex].resize(n);
     }
 
-    // Update areas and contangents
-    if (!isGPUEnabled)
+    // Lines are all the same so dropping the tail keeps them consistent
+    for (Lines* lines : { &gradientLines, &anisotropicDiffusionTensor })
     {
-        calculateAngles();
-        calculateNormals();
-        projectAniVecs();
-        calculateDualAreas();
-        updateDiffusionCoefs();
+        lines->positions_.resize(n * 2);
+        lines->normals_.resize(n * 2);
+        lines->colors_.resize(n * 2);
+        lines->textureCoords_.resize(n * 2);
+        lines->indices_.resize(n * 2);
+    }
+
+    // Edges, keyed by the new vertex indices
+    n = 0;
+    edgeKeyIndexMap.clear();
+    for (unsigned i = 0; i < edges.size(); ++i)
+    {
+        if (edges[i] == nullptr)
+            continue;
+
+        Edge* e = edges[i];
+        edges[n] = e;
+        e->index = n;
+        e->key = edgeKey(e->origin()->index, e->destination()->index);
+        edgeKeyIndexMap.insert(e->key, n);
+        n++;
     }
+    edges.resize(n);
+}
+
+// Buffer and acceleration structure updates deferred until a growth tick is complete
+void HalfEdgeMesh::finishGrowth()
+{
+    spatialHashDirty_ = true;
+
+    updatePositionVBO();
+    updateTextureVBO();
+    updateNormalVBO();
+
+    // Pure deformation keeps the tree's structure, only the boxes move
+    if (growthSubdivided_)
+        bvh_.build(*this);
+    else
+        bvh_.refit(*this);
 
     // Update tangents
     ASSERT(anisotropicDiffusionTensor.numLines() == faces.size(), "tensor vec num != num faces");
     ASSERT(gradientLines.numLines() == faces.size(), "gradient num != num faces");
 
-
-    if (subdivdeHappened)
+    if (growthSubdivided_)
     {
         anisotropicDiffusionTensor.destroyVBOs();
         anisotropicDiffusionTensor.initVBOs();
@@ -401,9 +1695,9 @@ void HalfEdgeMesh::growAndSubdivide(Vec3& growth, float maxFaceArea, bool subdiv
     gradientLines.initVBOs();
 
     // Update edge data
-    if (isGPUEnabled && subdivdeHappened)
+    if (isGPUEnabled && growthSubdivided_)
     {
-        for (unsigned i = 0; i < FACE_COUNT; ++i)
+        for (unsigned i = 0; i < faces.size(); ++i)
         {
             Face* f = faces[i];
             if (f->dirty())
@@ -423,6 +1717,60 @@ void HalfEdgeMesh::growAndSubdivide(Vec3& growth, float maxFaceArea, bool subdiv
             }
         }
     }
+
+    growthSubdivided_ = false;
+}
+
+// Copies the live coefficients to the staged ones, which the sliced stages then overwrite
+void HalfEdgeMesh::stageCoefficients()
+{
+    stagedAreas_.resize(vertices.size());
+    stagedVertexCotangents_.resize(vertices.size());
+    for (Vertex* v : vertices)
+    {
+        stagedAreas_[v->index] = v->area;
+        stagedVertexCotangents_[v->index] = v->cotacotb;
+    }
+
+    stagedEdgeCotangents_.resize(edges.size());
+    stagedCotans_.resize(edges.size());
+    stagedDiffVecs_.resize(edges.size());
+    for (Edge* e : edges)
+    {
+        stagedEdgeCotangents_[e->index] = e->cotacotb;
+        stagedCotans_[e->index] = e->cotan;
+        stagedDiffVecs_[e->index] = e->diffVec;
+    }
+}
+
+void HalfEdgeMesh::swapStaged(Vertex* v)
+{
+    std::swap(v->area, stagedAreas_[v->index]);
+    std::swap(v->cotacotb, stagedVertexCotangents_[v->index]);
+}
+
+void HalfEdgeMesh::swapStaged(Edge* e)
+{
+    std::swap(e->cotacotb, stagedEdgeCotangents_[e->index]);
+    std::swap(e->cotan, stagedCotans_[e->index]);
+    std::swap(e->diffVec, stagedDiffVecs_[e->index]);
+}
+
+void HalfEdgeMesh::restorePositions(const float* positions)
+{
+    for (size_t i = 0; i < positions_.size(); ++i, positions += 3)
+        positions_[i].set(positions[0], positions[1], positions[2]);
+
+    calculateAngles();
+    calculateFaceAreas();
+    calculateDualAreas();
+    calculateNormals();
+    precomputeGradCoefs();
+    updateDiffusionCoefs();
+
+    spatialHashDirty_ = true;
+    bvh_.refit(*this);
+    updatePositionVBO();
 }
 
 HalfEdgeMesh::Vertex* HalfEdgeMesh::createVertex(const Vec3& pos, const unsigned index)
@@ -475,7 +1823,7 @@ HalfEdgeMesh::Edge* HalfEdgeMesh::createEdge(Vertex* v0, Vertex* v1)
     Edge* e01 = new Edge();
     e01->index = static_cast<int>(edges.size());
     e01->key = edgeKey(v0->index, v1->index);
-    edgeKeyIndexMap[e01->key] = e01->index;
+    edgeKeyIndexMap.insert(e01->key, e01->index);
 
     e01->setOrigin(v0);
     e01->setDestination(v1);
@@ -487,8 +1835,12 @@ HalfEdgeMesh::Edge* HalfEdgeMesh::createEdge(Vertex* v0, Vertex* v1)
     v0->setEdge(e01);
     edges.push_back(e01);
 
-    if (edgeExists(v1, v0))
-        associateNeighbours(v0->index, v1->index);
+    Edge* e10 = findEdge(v1->index, v0->index);
+    if (e10 != nullptr)
+    {
+        e01->setPair(e10);
+        e10->setPair(e01);
+    }
 
     return e01;
 }
@@ -596,14 +1948,14 @@ HalfEdgeMesh::Edge* HalfEdgeMesh::splitEdge(Edge* e02)
 
         edgeKeyIndexMap.erase(e01->key);
         e01->key = edgeKey(v0->index, v1->index);
-        edgeKeyIndexMap[e01->key] = e01->index;
+        edgeKeyIndexMap.insert(e01->key, e01->index);
         e01->setOrigin(v0);
         e01->setDestination(v1);
         associateNeighbours(e01);
 
         edgeKeyIndexMap.erase(e10->key);
         e10->key = edgeKey(v1->index, v0->index);
-        edgeKeyIndexMap[e10->key] = e10->index;
+        edgeKeyIndexMap.insert(e10->key, e10->index);
         e10->setOrigin(v1);
         e10->setDestination(v0);
         associateNeighbours(e10);
@@ -665,7 +2017,7 @@ HalfEdgeMesh::Edge* HalfEdgeMesh::splitEdge(Edge* e02)
 
         edgeKeyIndexMap.erase(e01->key);
         e01->key = edgeKey(v0->index, v1->index);
-        edgeKeyIndexMap[e01->key] = e01->index;
+        edgeKeyIndexMap.insert(e01->key, e01->index);
         e01->setOrigin(v0);
         e01->setDestination(v1);
         e01->origin()->setEdge(e01);
@@ -1061,7 +2413,7 @@ void HalfEdgeMesh::updateDiffDirLines()
 
 void HalfEdgeMesh::gradientFace(Face* f, int morphIndex, std::vector<Cell>& readFromCells, Vec3& faceGrad) const
 {
-    const std::pair<Vec3, Vec3>& gradVecs = gradCoefs.at(f);
+    const std::pair<Vec3, Vec3>& gradVecs = gradCoefs[f->index];
     int i = f->edge()->origin()->index;
     int j = f->edge()->destination()->index;
     int k = f->edge()->next()->destination()->index;
@@ -1368,10 +2720,10 @@ void HalfEdgeMesh::calculateBoundaryVertices()
 
 void HalfEdgeMesh::associateNeighbours(unsigned i0, unsigned i1)
 {
-    if (edgeExists(i0, i1) && edgeExists(i1, i0))
+    Edge* e = findEdge(i0, i1);
+    Edge* pair = findEdge(i1, i0);
+    if (e != nullptr && pair != nullptr)
     {
-        Edge* e = getEdge(i0, i1);
-        Edge* pair = getEdge(i1, i0);
         e->setPair(pair);
         pair->setPair(e);
     }
@@ -1384,99 +2736,186 @@ void HalfEdgeMesh::associateNeighbours(Edge* e)
     associateNeighbours(i0, i1);
 }
 
-std::vector<HalfEdgeMesh::Edge*> HalfEdgeMesh::getEdgesByRadius(unsigned i, float radius)
+// Breadth first search from vertex i over vertices at most maxOrder rings away. found starts
+// with i, is in BFS order and doubles as the queue.
+void HalfEdgeMesh::gatherVertices(unsigned i, unsigned maxOrder, std::vector<unsigned>& found)
 {
-    std::vector<HalfEdgeMesh::Edge*> foundEdges;
-    std::vector<unsigned> neighbours;
-    std::vector<unsigned> visit;
-    visit.push_back(i);
-    neighbours.push_back(i);
+    found.clear();
+    if (!vertexExists(i))
+        return;
 
-    Vec3 v = positions_[i];
-    do
+    vertexVisits_.reset(vertices.size());
+    vertexVisits_.visit(i);
+    found.push_back(i);
+
+    size_t head = 0;
+    for (unsigned order = 0; order < maxOrder && head < found.size(); ++order)
     {
-        visit.erase(visit.begin());
+        size_t ringEnd = found.size();
+        for (; head < ringEnd; ++head)
+        {
+            Edge* start = vertices[found[head]]->edge();
+            Edge* e = start;
+            do
+            {
+                unsigned j = e->destination()->index;
+                if (vertexVisits_.visit(j))
+                    found.push_back(j);
+                e = e->pair()->next();
+            } while (e != start);
+        }
+    }
+}
 
-        Edge* startE = vertices[visit[0]]->edge();
-        Edge* e = startE;
+// Vertices whose shortest path to i along the edges is at most radius, i first and the rest
+// in order of that distance
+void HalfEdgeMesh::gatherVerticesByRadius(unsigned i, float radius, std::vector<unsigned>& found)
+{
+    found.clear();
+    if (!vertexExists(i))
+        return;
+
+    vertexDistances_.resize(vertices.size());
+    gatherByDistance(i, radius, vertexVisits_, vertexDistances_, [this](unsigned v, auto reach)
+    {
+        Edge* start = vertices[v]->edge();
+        Edge* e = start;
         do
         {
-            foundEdges.push_back(e);
-
             unsigned j = e->destination()->index;
-            if (length(v - positions_[j]) <= radius &&
-                std::find(visit.begin(), visit.end(), j) == visit.end() &&
-                std::find(neighbours.begin(), neighbours.end(), j) == neighbours.end())
-            {
-                neighbours.push_back(j);
-                visit.push_back(j);
-            }
+            reach(j, length(positions_[v] - positions_[j]));
             e = e->pair()->next();
-        } while (e != startE);
-    } while (visit.size() > 0);
-    return foundEdges;
+        } while (e != start);
+    }, found);
 }
 
-std::vector<unsigned> HalfEdgeMesh::getNeighboursByRadius(unsigned i, float radius)
+// One breadth first search from all seeds at once so overlapping neighbourhoods are only walked once
+void HalfEdgeMesh::markNeighbours(const std::vector<unsigned>& seeds, unsigned order, std::vector<char>& marked)
 {
-    std::vector<unsigned> neighbours;
-    std::vector<unsigned> visit;
-    visit.push_back(i);
-    neighbours.push_back(i);
+    std::vector<unsigned> found;
+    vertexVisits_.reset(vertices.size());
+    for (unsigned i : seeds)
+        if (vertexExists(i) && vertexVisits_.visit(i))
+            found.push_back(i);
 
-    Vec3 v = positions_[i];
-    do
+    size_t head = 0;
+    for (unsigned ring = 0; ring < order && head < found.size(); ++ring)
     {
-        Edge* startE = vertices[visit[0]]->edge();
-        Edge* e = startE;
-        visit.erase(visit.begin());
-        do
+        size_t ringEnd = found.size();
+        for (; head < ringEnd; ++head)
         {
-            unsigned j = e->destination()->index;
-            if (length(v - positions_[j]) <= radius &&
-                std::find(visit.begin(), visit.end(), j) == visit.end() &&
-                std::find(neighbours.begin(), neighbours.end(), j) == neighbours.end())
+            Edge* start = vertices[found[head]]->edge();
+            Edge* e = start;
+            do
             {
-                neighbours.push_back(j);
-                visit.push_back(j);
-            }
+                unsigned j = e->destination()->index;
+                if (vertexVisits_.visit(j))
+                    found.push_back(j);
+                e = e->pair()->next();
+            } while (e != start);
+        }
+    }
+
+    for (unsigned i : found)
+        marked[i] = 1;
+}
+
+std::vector<HalfEdgeMesh::Edge*> HalfEdgeMesh::getEdgesByRadius(unsigned i, float radius)
+{
+    std::vector<unsigned> found;
+    gatherVerticesByRadius(i, radius, found);
+
+    std::vector<HalfEdgeMesh::Edge*> foundEdges;
+    for (unsigned j : found)
+    {
+        Edge* start = vertices[j]->edge();
+        Edge* e = start;
+        do
+        {
+            foundEdges.push_back(e);
             e = e->pair()->next();
-        } while (e != startE);
-    } while (visit.size() > 0);
+        } while (e != start);
+    }
+    return foundEdges;
+}
 
+std::vector<unsigned> HalfEdgeMesh::getNeighboursByRadius(unsigned i, float radius)
+{
+    std::vector<unsigned> neighbours;
+    gatherVerticesByRadius(i, radius, neighbours);
     return neighbours;
 }
 
+// Rebuilds the vertex and face centroid hashes if positions or topology changed since the last query
+void HalfEdgeMesh::updateSpatialHashes()
+{
+    if (!spatialHashDirty_)
+        return;
+
+    // Cells about two edge lengths wide hold a handful of points each
+    float area = 0.f;
+    for (Face* f : faces)
+        if (f != nullptr)
+            area += f->area;
+    float cellSize = 2.f * std::sqrt(area / std::max<size_t>(1, vertices.size()));
+
+    // Faces removed by a growth tick still in progress keep a placeholder until compact() runs
+    std::vector<Vec3> centroids(faces.size(), Vec3(0.f));
+    for (size_t i = 0; i < faces.size(); ++i)
+        if (faces[i] != nullptr)
+            centroids[i] = getFaceCentroid(faces[i]);
+
+    // A growth tick moves the points a little, so most keep their bucket and are refitted in place.
+    // The hashes are rebuilt once the counts change or the cells are far off the mesh's scale
+    const float builtSize = vertexHash_.cellSize();
+    const bool refit = !vertexHash_.empty() && cellSize < 2.f * builtSize && cellSize > .5f * builtSize;
+    if (!refit || !vertexHash_.refit(positions_))
+        vertexHash_.build(positions_, cellSize);
+    if (!refit || !faceHash_.refit(centroids))
+        faceHash_.build(centroids, cellSize);
+
+    spatialHashDirty_ = false;
+}
+
+std::vector<unsigned> HalfEdgeMesh::getVerticesInRadius(const Vec3& p, float radius)
+{
+    updateSpatialHashes();
+    std::vector<unsigned> found;
+    vertexHash_.query(p, radius, found);
+    found.erase(std::remove_if(found.begin(), found.end(), [this](unsigned i) { return !vertexExists(i); }), found.end());
+    return found;
+}
+
+std::vector<unsigned> HalfEdgeMesh::getFacesInRadius(const Vec3& p, float radius)
+{
+    updateSpatialHashes();
+    std::vector<unsigned> found;
+    faceHash_.query(p, radius, found);
+    found.erase(std::remove_if(found.begin(), found.end(), [this](unsigned i) { return faces[i] == nullptr; }), found.end());
+    return found;
+}
+
+// Faces whose shortest path to faceIndex through the centroids of neighbouring faces is at most
+// radius, faceIndex first
 std::vector<unsigned> HalfEdgeMesh::getFaceNeighboursByRadius(unsigned faceIndex, float radius)
 {
     std::vector<unsigned> neighbours;
-    std::vector<unsigned> visit;
-    visit.push_back(faceIndex);
-    neighbours.push_back(faceIndex);
-
-    Vec3 v = getFaceCentroid(faces[faceIndex]);
-    do
+    faceDistances_.resize(faces.size());
+    gatherByDistance(faceIndex, radius, faceVisits_, faceDistances_, [this](unsigned f, auto reach)
     {
-        Edge* startE = faces[visit[0]]->edge();
-        Edge* e = startE;
-        visit.erase(visit.begin());
+        Vec3 centroid = getFaceCentroid(faces[f]);
+        Edge* start = faces[f]->edge();
+        Edge* e = start;
         do
         {
             if (!e->isBoundary)
             {
-                unsigned j = e->pair()->face()->index;
-                if (length(v - getFaceCentroid(faces[j])) <= radius &&                      // neighbour is in radius
-                    std::find(visit.begin(), visit.end(), j) == visit.end() &&              // neighbour not to be visited
-                    std::find(neighbours.begin(), neighbours.end(), j) == neighbours.end()) // neighour not visited
-                {
-                    neighbours.push_back(j);
-                    visit.push_back(j);
-                }
+                Face* neighbour = e->pair()->face();
+                reach(neighbour->index, length(centroid - getFaceCentroid(neighbour)));
             }
             e = e->next();
-        } while (e != startE);
-
-    } while (visit.size() > 0);
+        } while (e != start);
+    }, neighbours);
 
     return neighbours;
 }
@@ -1493,58 +2932,15 @@ std::set<unsigned> HalfEdgeMesh::getBoundaryCellsIndices()
 std::vector<unsigned> HalfEdgeMesh::getNeighbours(unsigned i, unsigned order)
 {
     std::vector<unsigned> foundNeighbours;
-    std::vector<unsigned> visited;
-    std::vector<unsigned> visit;
-
     if (order == 0)
         return foundNeighbours;
 
-    visit.push_back(i);
-    getNeighbours(order, visit, visited, foundNeighbours);
+    gatherVertices(i, order, foundNeighbours);
+    if (!foundNeighbours.empty())
+        foundNeighbours.erase(foundNeighbours.begin()); // i is not its own neighbour
     return foundNeighbours;
 }
 
-void HalfEdgeMesh::getNeighbours(unsigned order, std::vector<unsigned>& visit, std::vector<unsigned>& visited, std::vector<unsigned>& neighbours)
-{
-    if (order == 0)
-        return;
-
-    std::vector<unsigned> newVisits;
-    while (visit.size() > 0)
-    {
-        unsigned i = visit[0];
-        Vertex* v = vertices[i];
-        Edge* start = v->edge();
-        Edge* current = start;
-
-        //for each neighbour
-        do
-        {
-            unsigned j = current->destination()->index;
-
-            // if not visited
-            if (std::find(visited.begin(), visited.end(), j) == visited.end())
-            {
-
-                // and not queued to visit then add to visit
-                if (std::find(visit.begin(), visit.end(), j) == visit.end())
-                    newVisits.push_back(j);
-
-                // if not a neighbour add it to neighbours
-                if (std::find(neighbours.begin(), neighbours.end(), j) == neighbours.end())
-                    neighbours.push_back(j);
-            }
-            current = current->pair()->next();
-
-        } while (current != start);
-
-        visited.push_back(i);
-        visit.erase(std::find(visit.begin(), visit.end(), i));
-    }
-    visit = newVisits;
-    getNeighbours(order - 1, visit, visited, neighbours);
-}
-
 Vec3 HalfEdgeMesh::getFaceNormal(unsigned i)
 {
     return faces[i]->normal;
@@ -1590,6 +2986,12 @@ bool HalfEdgeMesh::edgeExists(uint32_t i0, uint32_t i1)
     return edgeKeyIndexMap.count(key) > 0;
 }
 
+HalfEdgeMesh::Edge* HalfEdgeMesh::findEdge(uint32_t i0, uint32_t i1)
+{
+    int index = edgeKeyIndexMap.find(edgeKey(i0, i1));
+    return index != -1 ? edges[index] : nullptr;
+}
+
 HalfEdgeMesh::Edge* HalfEdgeMesh::getEdge(Vertex* v0, Vertex* v1)
 {
     return getEdge(v0->index, v1->index);
@@ -1597,7 +2999,7 @@ HalfEdgeMesh::Edge* HalfEdgeMesh::getEdge(Vertex* v0, Vertex* v1)
 
 HalfEdgeMesh::Edge* HalfEdgeMesh::getEdge(unsigned i0, unsigned i1)
 {
-    return edges.at(edgeKeyIndexMap.at(edgeKey(i0, i1)));
+    return edges.at(edgeKeyIndexMap.find(edgeKey(i0, i1)));
 }
 
 HalfEdgeMesh::Vertex* HalfEdgeMesh::getVertex(unsigned i)
@@ -1690,17 +3092,20 @@ HalfEdgeMesh::Edge* HalfEdgeMesh::getLongestEdge(Face* f)
 void HalfEdgeMesh::calculateAngles()
 {
     for (Face* f : faces)
-    {
-        Edge* e01 = f->edge();
-        Edge* e12 = f->edge()->next();
-        Edge* e20 = f->edge()->next()->next();
-        unsigned i0 = e01->origin()->index;
-        unsigned i1 = e12->origin()->index;
-        unsigned i2 = e20->origin()->index;
-        e01->angle = acuteAngleBetween(positions_[i1] - positions_[i0], positions_[i2] - positions_[i0]);
-        e12->angle = acuteAngleBetween(positions_[i0] - positions_[i1], positions_[i2] - positions_[i1]);
-        e20->angle = acuteAngleBetween(positions_[i0] - positions_[i2], positions_[i1] - positions_[i2]);
-    }
+        calculateAngles(f);
+}
+
+void HalfEdgeMesh::calculateAngles(Face* f)
+{
+    Edge* e01 = f->edge();
+    Edge* e12 = f->edge()->next();
+    Edge* e20 = f->edge()->next()->next();
+    unsigned i0 = e01->origin()->index;
+    unsigned i1 = e12->origin()->index;
+    unsigned i2 = e20->origin()->index;
+    e01->angle = acuteAngleBetween(positions_[i1] - positions_[i0], positions_[i2] - positions_[i0]);
+    e12->angle = acuteAngleBetween(positions_[i0] - positions_[i1], positions_[i2] - positions_[i1]);
+    e20->angle = acuteAngleBetween(positions_[i0] - positions_[i2], positions_[i1] - positions_[i2]);
 }
 
 void HalfEdgeMesh::calculateDualAreas()
@@ -1866,6 +3271,10 @@ HalfEdgeMesh::Vertex* HalfEdgeMesh::splitFaceAt(Face* f, Edge* e20)
     Edge* e23 = splitEdge(e20);
 
     cellsToUpdate[e23->destination()->index] = NewCell{{e23->origin()->index, e01->origin()->index}};
+    touchedVertices_.push_back(e23->origin()->index);
+    touchedVertices_.push_back(e23->destination()->index);
+    touchedVertices_.push_back(e01->origin()->index);
+    touchedVertices_.push_back(e12->origin()->index);
 
     animation_.addVertex(e23->destination()->index, e23->origin()->index, e01->origin()->index);
 
@@ -1948,9 +3357,9 @@ void HalfEdgeMesh::paint(int faceIndex, Vec3 p, float paintRadius)
     // Find neighbour indices_
     std::vector<unsigned> neighbours;
     if (paintingDiffDirIndex >= 0)
-        neighbours = getFaceNeighboursByRadius(faceIndex, paintRadius);
+        neighbours = getFacesInRadius(getFaceCentroid(faces[faceIndex]), paintRadius);
     else
-        neighbours = getNeighboursByRadius(ind, paintRadius);
+        neighbours = getVerticesInRadius(positions_[ind], paintRadius);
 
     // Update values at indices_
     for (unsigned i : neighbours)
@@ -2069,49 +3478,47 @@ float HalfEdgeMesh::getArea(const Vec3& p0, const Vec3& p1, const Vec3& p2, cons
 
 void HalfEdgeMesh::saveToObj(const std::string& filename)
 {
-    std::ofstream objFile;
-    objFile.open(filename, std::ofstream::out);
-    std::vector<unsigned> nullsBefore(vertices.size(), 0);
-    unsigned nulls = 0;
-    unsigned i = 0;
-    for (Vertex* v : vertices)
-    {
-        if (v == nullptr)
-        {
-            nulls++;
-            nullsBefore[i++] = nulls;
-            continue;
-        }
-
-        nullsBefore[i++] = nulls;
-
-        Vec3 p = positions_[v->index];
-        objFile << "v " << p.x << " " << p.y << " " << p.z << std::endl;
-    }
-
-    for (Vertex* v : vertices)
-    {
-        if (v == nullptr)
-            continue;
-
-        Vec3 n = normals_[v->index];
-        objFile << "vn " << n.x << " " << n.y << " " << n.z << std::endl;
-    }
+    PlySnapshot snapshot;
+    snapshotPly(snapshot);
 
-    for (Face* f : faces)
+    std::ofstream objFile(filename, std::ofstream::binary);
+    auto writeChunks = [&objFile](const std::vector<std::vector<char>>& chunks)
     {
-        Vertex* v0 = f->edge()->origin();
-        Vertex* v1 = f->edge()->next()->origin();
-        Vertex* v2 = f->edge()->next()->next()->origin();
-        unsigned i0 = v0->index;
-        unsigned i1 = v1->index;
-        unsigned i2 = v2->index;
+        for (auto& chunk : chunks)
+            objFile.write(chunk.data(), chunk.size());
+    };
 
-        objFile << "f ";
-        objFile << i0 - nullsBefore[i0] + 1 << "//" << i0 - nullsBefore[i0] + 1 << " ";
-        objFile << i1 - nullsBefore[i1] + 1 << "//" << i1 - nullsBefore[i1] + 1 << " ";
-        objFile << i2 - nullsBefore[i2] + 1 << "//" << i2 - nullsBefore[i2] + 1 << std::endl;
-    }
+    writeChunks(formatRows(snapshot.positions.size(), 80, [&](char* p, size_t i) {
+        const Vec3& v = snapshot.positions[i];
+        *p++ = 'v';
+        p = formatValues(p, { v.x, v.y, v.z });
+        *p++ = '\n';
+        return p;
+        }));
+
+    writeChunks(formatRows(snapshot.normals.size(), 80, [&](char* p, size_t i) {
+        const Vec3& n = snapshot.normals[i];
+        *p++ = 'v';
+        *p++ = 'n';
+        p = formatValues(p, { n.x, n.y, n.z });
+        *p++ = '\n';
+        return p;
+        }));
+
+    // Positions and normals share their indices
+    writeChunks(formatRows(snapshot.indices.size() / 3, 80, [&](char* p, size_t i) {
+        *p++ = 'f';
+        for (size_t j = 0; j < 3; ++j)
+        {
+            *p++ = ' ';
+            p = std::to_chars(p, p + 16, snapshot.indices[i * 3 + j] + 1).ptr;
+            *p++ = '/';
+            *p++ = '/';
+            p = std::to_chars(p, p + 16, snapshot.indices[i * 3 + j] + 1).ptr;
+        }
+        *p++ = '\n';
+        return p;
+        }));
     objFile.close();
 }
 
@@ -2132,40 +3539,23 @@ float HalfEdgeMesh::avgFaceSize()
     return avgFaceSize;
 }
 
-void HalfEdgeMesh::saveToPly(const std::string& filename, bool saveVeins)
-{        
-    std::ofstream plyFile;
-    plyFile.open(filename, std::ofstream::out);
-
-    plyFile << R"(ply
-format ascii 1.0
-comment Created by LRDS - https://www.leeringham.com/
-)";
-
-    //bool hasTextureCoords = textureCoords_.size() > 0;
-
-    plyFile << "element vertex " << vertices.size() << "\n";
-
-    plyFile << "property float x\n";
-    plyFile << "property float y\n";
-    plyFile << "property float z\n";
-    plyFile << "property float nx\n";
-    plyFile << "property float ny\n";
-    plyFile << "property float nz\n";
-    plyFile << "property float s\n";
-    plyFile << "property float t\n";
-    plyFile << "property uchar red\n";
-    plyFile << "property uchar green\n";
-    plyFile << "property uchar blue\n";
-
-    plyFile << "element face " << faces.size() << "\n";
+void HalfEdgeMesh::saveToPly(const std::string& filename, bool saveVeins, bool binary)
+{
+    PlySnapshot snapshot;
+    snapshotPly(snapshot, saveVeins);
+    writePly(filename, snapshot, binary);
+}
 
-    plyFile << R"(property list uchar uint vertex_indices_
-end_header
-)";
+void HalfEdgeMesh::snapshotPly(PlySnapshot& snapshot, bool saveVeins)
+{
+    snapshot.positions.clear();
+    snapshot.normals.clear();
+    snapshot.textureCoords.clear();
+    snapshot.colors.clear();
+    snapshot.indices.clear();
 
-    // Write data
     std::vector<unsigned> nullsBefore(vertices.size(), 0);
+    std::vector<float> values;
     unsigned nulls = 0;
     size_t i = 0;
     for (Vertex* v : vertices)
@@ -2178,158 +3568,216 @@ end_header
         }
         nullsBefore[i++] = nulls;
 
-        unsigned char r = 0, g = 0, b = 0;
         if (saveVeins && veinMorphIndex_ >= 0)
-        {
-            float morphVal = getReadFromCells()[v->index][veinMorphIndex_];
-            r = static_cast<unsigned char>(morphVal * 255);
-            g = r;
-            b = r;
-        }
+            values.push_back(getReadFromCells()[v->index][veinMorphIndex_]);
         else
-            colorMapOutside.sample(colors_[v->index].r / normCoef, r, g, b);
+            values.push_back(colors_[v->index].r);
 
-        Vec3 p = positions_[v->index];
-        Vec3 n = normals_[v->index];
-        Vec2 t = textureCoords_[v->index];
-        plyFile << p.x  << " " << p.y << " " << p.z << " "
-                << n.x  << " " << n.y << " " << n.z << " "
-                << t.u_ << " " << t.v_ << " ";
-
-        //if (hasTextureCoords)
-        //    plyFile << t.u_ << " " << t.v_ << " ";
+        snapshot.positions.push_back(positions_[v->index]);
+        snapshot.normals.push_back(normals_[v->index]);
+        snapshot.textureCoords.push_back(textureCoords_[v->index]);
+    }
 
-        plyFile << (int)r << " " << (int)g << " " << (int)b << "\n";
+    // Vertex colours go through the colour map in one batch, veins are grey
+    snapshot.colors.assign(values.size() * 3, 0);
+    if (saveVeins && veinMorphIndex_ >= 0)
+    {
+        for (size_t v = 0; v < values.size(); ++v)
+        {
+            unsigned char grey = static_cast<unsigned char>(values[v] * 255);
+            snapshot.colors[v * 3] = grey;
+            snapshot.colors[v * 3 + 1] = grey;
+            snapshot.colors[v * 3 + 2] = grey;
+        }
     }
+    else
+        colorMapOutside.lookupTable().map(values.data(), values.size(), normCoef, snapshot.colors.data());
 
     for (Face* f : faces)
     {
-        Vertex* v0 = f->edge()->origin();
-        Vertex* v1 = f->edge()->next()->origin();
-        Vertex* v2 = f->edge()->next()->next()->origin();
-        unsigned i0 = v0->index;
-        unsigned i1 = v1->index;
-        unsigned i2 = v2->index;
+        unsigned i0 = f->edge()->origin()->index;
+        unsigned i1 = f->edge()->next()->origin()->index;
+        unsigned i2 = f->edge()->next()->next()->origin()->index;
+        snapshot.indices.push_back(i0 - nullsBefore[i0]);
+        snapshot.indices.push_back(i1 - nullsBefore[i1]);
+        snapshot.indices.push_back(i2 - nullsBefore[i2]);
+    }
+}
 
-        plyFile << "3 ";
-        plyFile << i0 - nullsBefore[i0] << " ";
-        plyFile << i1 - nullsBefore[i1] << " ";
-        plyFile << i2 - nullsBefore[i2] << "\n";
+bool HalfEdgeMesh::writePly(const std::string& filename, const PlySnapshot& snapshot, bool binary)
+{
+    const size_t vertexCount = snapshot.positions.size();
+    const size_t faceCount = snapshot.indices.size() / 3;
+
+    std::string header = "ply\nformat ";
+    header += !binary ? "ascii" : Utils::isBigEndian() ? "binary_big_endian" : "binary_little_endian";
+    header += " 1.0\ncomment Created by LRDS - https://www.leeringham.com/\n";
+    header += "element vertex " + std::to_string(vertexCount) + "\n";
+    header += "property float x\n";
+    header += "property float y\n";
+    header += "property float z\n";
+    header += "property float nx\n";
+    header += "property float ny\n";
+    header += "property float nz\n";
+    header += "property float s\n";
+    header += "property float t\n";
+    header += "property uchar red\n";
+    header += "property uchar green\n";
+    header += "property uchar blue\n";
+    header += "element face " + std::to_string(faceCount) + "\n";
+    header += "property list uchar uint vertex_indices\n";
+    header += "end_header\n";
+
+    std::ofstream plyFile(filename, std::ofstream::binary);
+    plyFile.write(header.data(), header.size());
+
+    if (binary)
+    {
+        // Rows packed as the header lists them, in the machine's byte order
+        static_assert(sizeof(unsigned) == 4, "face indices are written as uint");
+        const size_t vertexSize = 8 * sizeof(float) + 3;
+        const size_t faceSize = 1 + 3 * sizeof(unsigned);
+        std::vector<char> data(vertexCount * vertexSize + faceCount * faceSize);
+        char* p = data.data();
+        for (size_t i = 0; i < vertexCount; ++i, p += vertexSize)
+        {
+            const Vec3& v = snapshot.positions[i];
+            const Vec3& n = snapshot.normals[i];
+            const Vec2& t = snapshot.textureCoords[i];
+            const float values[8] = { v.x, v.y, v.z, n.x, n.y, n.z, t.u_, t.v_ };
+            std::memcpy(p, values, sizeof(values));
+            std::memcpy(p + sizeof(values), &snapshot.colors[i * 3], 3);
+        }
+        for (size_t i = 0; i < faceCount; ++i, p += faceSize)
+        {
+            *p = 3;
+            std::memcpy(p + 1, &snapshot.indices[i * 3], 3 * sizeof(unsigned));
+        }
+        plyFile.write(data.data(), data.size());
+    }
+    else
+    {
+        for (auto& chunk : formatRows(vertexCount, 240, [&](char* p, size_t i) {
+            const Vec3& v = snapshot.positions[i];
+            const Vec3& n = snapshot.normals[i];
+            const Vec2& t = snapshot.textureCoords[i];
+            const unsigned char* c = &snapshot.colors[i * 3];
+            p = std::to_chars(p, p + 24, v.x).ptr;
+            p = formatValues(p, { v.y, v.z, n.x, n.y, n.z, t.u_, t.v_ });
+            for (size_t j = 0; j < 3; ++j)
+            {
+                *p++ = ' ';
+                p = std::to_chars(p, p + 4, static_cast<unsigned>(c[j])).ptr;
+            }
+            *p++ = '\n';
+            return p;
+            }))
+            plyFile.write(chunk.data(), chunk.size());
+
+        for (auto& chunk : formatRows(faceCount, 40, [&](char* p, size_t i) {
+            *p++ = '3';
+            for (size_t j = 0; j < 3; ++j)
+            {
+                *p++ = ' ';
+                p = std::to_chars(p, p + 16, snapshot.indices[i * 3 + j]).ptr;
+            }
+            *p++ = '\n';
+            return p;
+            }))
+            plyFile.write(chunk.data(), chunk.size());
     }
 
     plyFile.close();
+    return !plyFile.fail();
+}
+
+void HalfEdgeMesh::exportTexture(unsigned char* pixels, int width, int height, int dilation)
+{
+    TextureSnapshot snapshot;
+    snapshotTexture(snapshot);
+    snapshot.dilation = dilation;
+    rasterizeTexture(snapshot, pixels, width, height);
 }
 
-void HalfEdgeMesh::exportTexture(unsigned char* pixels, int width, int height)
+void HalfEdgeMesh::snapshotTexture(TextureSnapshot& snapshot) const
 {
+    snapshot.domainType = domainType;
+    snapshot.colorMap = colorMapOutside.lookupTable();
+    snapshot.normCoef = normCoef;
+    snapshot.values.resize(colors_.size());
+    for (size_t i = 0; i < colors_.size(); ++i)
+        snapshot.values[i] = colors_[i].r;
+
+    snapshot.indices.clear();
+    snapshot.textureCoords.clear();
     if (textureCoords_.size() == 0)
-    {
-        LOG("No texture coordinates found when saving texture!");
         return;
-    }
 
-    std::vector<int> originalClosestIndices(width * height, -1);
-    std::vector<int> closestIndices(width * height, -1);
-    for (HalfEdgeMesh::Face* f : faces)
+    // Texture coordinates belong to the vertices, like the positions
+    for (Face* f : faces)
     {
         unsigned i0 = f->edge()->origin()->index;
         unsigned i1 = f->edge()->next()->origin()->index;
         unsigned i2 = f->edge()->next()->next()->origin()->index;
-
-        Vec2 t0 = textureCoords_[f->firstIndexIndex];
-        Vec2 t1 = textureCoords_[f->firstIndexIndex + 1];
-        Vec2 t2 = textureCoords_[f->firstIndexIndex + 2];
-
-        int minX = static_cast<int>(Utils::min(Utils::min(t0.u_, t1.u_), t2.u_) * (width - 1));
-        int minY = static_cast<int>(Utils::min(Utils::min(t0.v_, t1.v_), t2.v_) * (height - 1));
-        int maxX = static_cast<int>(Utils::max(Utils::max(t0.u_, t1.u_), t2.u_) * (width - 1));
-        int maxY = static_cast<int>(Utils::max(Utils::max(t0.v_, t1.v_), t2.v_) * (height - 1));
-
-        float c0 = colors_[i0].r;
-        float c1 = colors_[i1].r;
-        float c2 = colors_[i2].r;
-
-        float u = 0.f, v = 0.f, w = 0.f;
-        unsigned char r = 0, g = 0, b = 0;
-        int j = 0;
-        for (int x = minX; x <= maxX; ++x)
-        {
-            for (int y = minY; y <= maxY; ++y)
-            {
-                j = x + (height - 1 - y) * width;
-                if (pointInTriangle(
-                    Vec3(t0.x_, t0.y_, 0.f),
-                    Vec3(t1.x_, t1.y_, 0.f),
-                    Vec3(t2.x_, t2.y_, 0.f),
-                    Vec3(x / (width - 1.f), y / (height - 1.f), 0.f),
-                    u, v, w))
-                {
-                    colorMapOutside.sample((c0 * w + c1 * u + c2 * v) / normCoef, r, g, b);
-                    pixels[j * 3] = r;
-                    pixels[j * 3 + 1] = g;
-                    pixels[j * 3 + 2] = b;
-                    originalClosestIndices[j] = j * 3;
-                }
-            }
-        }
+        snapshot.indices.push_back(i0);
+        snapshot.indices.push_back(i1);
+        snapshot.indices.push_back(i2);
+        snapshot.textureCoords.push_back(textureCoords_[i0]);
+        snapshot.textureCoords.push_back(textureCoords_[i1]);
+        snapshot.textureCoords.push_back(textureCoords_[i2]);
     }
+}
 
-    auto checkAdjPixel = [](int p_i, int x, int y, int x1, int y1, int width, int height, std::vector<int>& closestIndices, std::vector<int>& originalClosestIndices, float& foundDist)
+void HalfEdgeMesh::rasterizeTexture(const TextureSnapshot& snapshot, unsigned char* pixels, int width, int height)
+{
+    if (snapshot.textureCoords.size() == 0)
     {
-        if (x1 < 0 || x1 >= width || y1 < 0 || y1 >= height)
-            return;
+        LOG("No texture coordinates found when saving texture!");
+        return;
+    }
 
-        int index = (x1 + y1 * width);
-        if (originalClosestIndices[index] != -1)
-        {
-            float dx = float(x - x1);
-            float dy = float(y - y1);
-            float dist = sqrt(dx * dx + dy * dy);
-            if (dist < foundDist)
-            {
-                foundDist = dist;
-                closestIndices[p_i] = index * 3;
-            }
-        }
-    };
+    std::shared_ptr<const TextureMap> map = findTextureMap(snapshot, width, height);
+    const std::vector<TextureMap::Texel>& texels = map->texels;
 
-    // Assign colors_ to background pixels to avoid texture seams
-    int x, y;
-    const int order = 10;
-    ASSERT(closestIndices.size() <= std::numeric_limits<size_t>::max(), "Texture too large");
-    for (int p_i = 0; p_i < static_cast<int>(closestIndices.size()); ++p_i)
+    // Each band of rows interpolates a row's values, colours the whole row at once and writes
+    // the covered texels, the background keeps what pixels held
+    const size_t bandCount = std::max<size_t>(1, std::min<size_t>(ThreadPool::shared().getNumThreads(), height));
+    const int rowsPerBand = static_cast<int>((height + bandCount - 1) / bandCount);
+    parallelChunks(bandCount, [&](size_t band)
     {
-        // Skip colored pixels
-        if (originalClosestIndices[p_i] != -1)
-            continue;
-
-        // Find closest color
-        x = p_i % width;
-        y = p_i / width;
-        float foundDist = std::numeric_limits<float>::max();
-        for (int i = 1; i <= order; ++i)
+        std::vector<float> values(width);
+        std::vector<unsigned char> colors(static_cast<size_t>(width) * 3);
+        const int bandMinY = static_cast<int>(band) * rowsPerBand;
+        const int bandMaxY = std::min(bandMinY + rowsPerBand, height);
+        for (int y = bandMinY; y < bandMaxY; ++y)
         {
-            int offset = (i * 2 + 1) / 2;
-            for (int j = -offset; j <= offset; ++j)
+            const TextureMap::Texel* row = texels.data() + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; ++x)
             {
-                checkAdjPixel(p_i, x, y, x + j, y - offset, width, height, closestIndices, originalClosestIndices, foundDist);
-                checkAdjPixel(p_i, x, y, x + j, y + offset, width, height, closestIndices, originalClosestIndices, foundDist);
-                checkAdjPixel(p_i, x, y, x - offset, y + j, width, height, closestIndices, originalClosestIndices, foundDist);
-                checkAdjPixel(p_i, x, y, x + offset, y + j, width, height, closestIndices, originalClosestIndices, foundDist);
+                const TextureMap::Texel& texel = row[x];
+                values[x] = 0.f;
+                if (texel.face < 0)
+                    continue;
+
+                float c0 = snapshot.values[snapshot.indices[texel.face]];
+                float c1 = snapshot.values[snapshot.indices[texel.face + 1]];
+                float c2 = snapshot.values[snapshot.indices[texel.face + 2]];
+                float w = 1.f - texel.u - texel.v;
+                values[x] = c0 * w + c1 * texel.u + c2 * texel.v;
             }
-        }
-    }
+            snapshot.colorMap.map(values.data(), width, snapshot.normCoef, colors.data());
 
-    // Copy found colors_ to image
-    for (size_t p_i = 0; p_i < closestIndices.size(); ++p_i)
-    {
-        if (closestIndices[p_i] >= 0)
-        {
-            pixels[p_i * 3] = pixels[closestIndices[p_i]];
-            pixels[p_i * 3 + 1] = pixels[closestIndices[p_i] + 1];
-            pixels[p_i * 3 + 2] = pixels[closestIndices[p_i] + 2];
+            unsigned char* out = pixels + static_cast<size_t>(y) * width * 3;
+            for (int x = 0; x < width; ++x)
+            {
+                if (row[x].face < 0)
+                    continue;
+                out[x * 3] = colors[x * 3];
+                out[x * 3 + 1] = colors[x * 3 + 1];
+                out[x * 3 + 2] = colors[x * 3 + 2];
+            }
         }
-    }
+    });
 }
 
 void HalfEdgeMesh::projectAniVecs(const Vec3& guessVec)
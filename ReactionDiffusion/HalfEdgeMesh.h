@@ -3,12 +3,16 @@
 #include "Ply.h"
 #include "BVH.h"
 #include "Animation.h"
+#include "EdgeHashMap.h"
+#include "SpatialHash.h"
 
 #include <vector>
 #include <unordered_map>
 #include <utility>
 #include <algorithm>
 
+class ThreadPool;
+
 
 class HalfEdgeMesh : 
     public SimulationDomain
@@ -129,6 +133,16 @@ public:
         {}
     };
 
+    // What saveToPly writes, gathered so the file can be written while the simulation goes on
+    struct PlySnapshot
+    {
+        std::vector<Vec3> positions;
+        std::vector<Vec3> normals;
+        std::vector<Vec2> textureCoords;
+        std::vector<unsigned char> colors; // 3 bytes per vertex
+        std::vector<unsigned> indices;     // 3 per face, into the vertices without the removed ones
+    };
+
     // Inhereted methods
     void laplacian(unsigned i, const std::vector<Cell>& readFromCells, std::vector<float>::iterator lap) override;
 	void laplacianCLE(unsigned i, const std::vector<Cell>& readFromCells, std::vector<float>::iterator lap, std::vector<float>::iterator lapNoise) override;
@@ -138,13 +152,19 @@ public:
     void gradient(unsigned i, int morphIndex, std::vector<Cell>& readFromCells, Vec3& grad) override;
     bool isBoundary(unsigned i) override;
     std::vector<unsigned> getNeighbours(unsigned i, unsigned order = 1) override;
-    std::vector<unsigned> getNeighboursByRadius(unsigned i, float radius);
+    std::vector<unsigned> getNeighboursByRadius(unsigned i, float radius) override;
+    void markNeighbours(const std::vector<unsigned>& seeds, unsigned order, std::vector<char>& marked) override;
     std::vector<unsigned> getFaceNeighboursByRadius(unsigned i, float radius);
+    std::vector<unsigned> getVerticesInRadius(const Vec3& p, float radius);
+    std::vector<unsigned> getFacesInRadius(const Vec3& p, float radius);
+    void updateSpatialHashes();
     std::set<unsigned> getBoundaryCellsIndices() override;
     std::vector<Edge*> getEdgesByRadius(unsigned i, float radius);
     bool hideAnisoVec(int i) const override;
     void gradientFace(Face* f, int morphIndex, std::vector<Cell>& readFromCells, Vec3& faceGrad) const;
     void growAndSubdivide(Vec3& growth, float maxFaceArea, bool subdivisionEnabled, size_t stepCount) override;
+    bool continueGrowth(float timeBudget) override;
+    bool growthPending() const override;
     float getTotalArea() const override;
     float getCotanWeights(unsigned v0, unsigned v1, int morphIndex);
     float getEdgeCotanWeight(unsigned edgeIndex, int morphIndex);
@@ -154,7 +174,10 @@ public:
     void updateDiffusionCoefs() override;
     void doInit(int numMorphs) override;
     void doRecalculateParameters() override;
-    void exportTexture(unsigned char* pixels, int width, int height) override;    
+    void exportTexture(unsigned char* pixels, int width, int height, int dilation) override;
+    void snapshotTexture(TextureSnapshot& snapshot) const override;
+    // Texel to triangle mapping is cached per texture layout and size, repeated exports only gather
+    static void rasterizeTexture(const TextureSnapshot& snapshot, unsigned char* pixels, int width, int height);
     void updateGradLines() override;
     void updateDiffDirLines() override;
 
@@ -169,11 +192,16 @@ public:
     HalfEdgeMesh(const Drawable& drawable);
     virtual ~HalfEdgeMesh() = default;
     void init(const Drawable& drawable);
+    // Moves the vertices to positions, 3 floats each, and recomputes the geometry that follows them
+    void restorePositions(const float* positions);
     bool isInitialized();
     void printInfo();
     bool validateMesh();
     void saveToObj(const std::string& filename);
-    void saveToPly(const std::string& filename, bool saveVeins = false);
+    void saveToPly(const std::string& filename, bool saveVeins = false, bool binary = false);
+    void snapshotPly(PlySnapshot& snapshot, bool saveVeins = false);
+    // Ascii rows are formatted in parallel chunks, binary ones are packed in the machine's byte order
+    static bool writePly(const std::string& filename, const PlySnapshot& snapshot, bool binary = false);
 
     // Creation
     Vertex* createVertex(const Vec3& pos);
@@ -181,11 +209,14 @@ public:
     Edge* createEdge(Vertex* v0, Vertex* v1);
     Face* createFace(Edge* e01, Edge* e12, Edge* e20);
     void createBoundaryEdges();
+    bool createFromTriangles(const Drawable& drawable, ThreadPool& pool);
+    void createFromTrianglesIncremental(const Drawable& drawable);
 
     // Query
     bool vertexExists(unsigned i0);
     bool edgeExists(Vertex* v0, Vertex* v1);
     bool edgeExists(uint32_t i0, uint32_t i1);
+    Edge* findEdge(uint32_t i0, uint32_t i1);
 
     // Association
     void join(Edge* e0, Edge* e1, Edge* e2, Face* f);
@@ -197,6 +228,7 @@ public:
     Vec3 calculateCentre(Face* f);
     Vec3 calculateCentre(unsigned i0, unsigned i1, unsigned i2);
     void calculateAngles();
+    void calculateAngles(Face* f);
     void calculateDualAreas();
     void calculateDualArea(unsigned i);
     void calculateDualArea(Vertex* v);
@@ -220,13 +252,25 @@ public:
     Edge* splitEdge(Edge* e);
     Vertex* splitFaceAt(Face* f, Edge* e20);
     void subdivideFace(Face* f);
+    void subdivideFaceConservatively(Face* f);
+    void refreshRegion(const std::vector<unsigned>& vertexIndices);
+    std::vector<float> calculateFaceErrors();
+    bool canCollapse(Edge* e, const std::vector<float>& faceErrors, const std::vector<bool>& locked);
+    void collapseEdge(Edge* e, std::vector<bool>& locked);
+    void coarsen(float maxFaceArea);
+    void compact();
+    void finishGrowth();
+    void stageCoefficients();
+    void swapStaged(Vertex* v);
+    void swapStaged(Edge* e);
 
     // Getters
     Vertex* getVertex(unsigned i);
     Edge* getEdge(unsigned i0, unsigned i1);
     Edge* getEdge(Vertex* v0, Vertex* v1);
     float getArea(const Vec3& p0, const Vec3& p1, const Vec3& p2, const Vec3& centre);
-    void getNeighbours(unsigned order, std::vector<unsigned>& visit, std::vector<unsigned>& visited, std::vector<unsigned>& neighbours);
+    void gatherVertices(unsigned i, unsigned maxOrder, std::vector<unsigned>& found);
+    void gatherVerticesByRadius(unsigned i, float radius, std::vector<unsigned>& found);
     Vec3 getFaceNormal(unsigned i);
     Vec3 getFaceCentroid(Face* f);
     float getFaceMorph(Face * f, int morphIndex);
@@ -236,16 +280,73 @@ public:
     // Setters
     void setBoundaryColor(float r, float g, float b);
 
+    // Visited marks that are reset in O(1) by bumping the epoch instead of clearing
+    struct VisitedStamps
+    {
+        std::vector<unsigned> stamps;
+        unsigned epoch = 0;
+
+        void reset(size_t size)
+        {
+            stamps.resize(size, 0);
+            if (++epoch == 0)
+            {
+                std::fill(stamps.begin(), stamps.end(), 0);
+                epoch = 1;
+            }
+        }
+
+        // Returns false if i was already visited since the last reset
+        bool visit(unsigned i)
+        {
+            if (stamps[i] == epoch)
+                return false;
+            stamps[i] = epoch;
+            return true;
+        }
+    };
+
+    // Time sliced growth
+    enum class GrowthStage
+    {
+        Idle, Subdivide, Coarsen, FaceGeometry, VertexGeometry, DiffusionCoefs
+    };
+
     // Members
     std::vector<Edge*> edges;
     std::vector<Face*> faces;
     std::vector<Vertex*> vertices;
-    std::unordered_map<EdgeKey, int> edgeKeyIndexMap;
-    std::unordered_map<Face*, std::pair<Vec3, Vec3>> gradCoefs;
+    EdgeHashMap edgeKeyIndexMap;
+    std::vector<std::pair<Vec3, Vec3>> gradCoefs; // indexed by face
 
     bool initialized_ = false;
     bool thirdArea_ = true;
     std::vector<Vec3> prevP_;
     BVH bvh_;
     Animation animation_;
+
+    GrowthStage growthStage_ = GrowthStage::Idle;
+    std::vector<std::pair<unsigned, float>> fatFaces_; // face index and the area it is split at
+    std::vector<unsigned> touchedVertices_;
+    size_t growthCursor_ = 0;
+    float growthMaxFaceArea_ = 0.f;
+    bool growthSubdivided_ = false;
+
+    // What the laplacian reads, recomputed by the sliced growth stages and swapped in when they are done
+    std::vector<float> stagedAreas_;
+    std::vector<std::vector<float>> stagedVertexCotangents_;
+    std::vector<std::vector<float>> stagedEdgeCotangents_;
+    std::vector<float> stagedCotans_;
+    std::vector<std::vector<Vec3>> stagedDiffVecs_;
+
+    // Scratch for the neighbourhood and radius queries, which makes them non-reentrant: queries
+    // on one mesh must not run concurrently
+    VisitedStamps vertexVisits_;
+    VisitedStamps faceVisits_;
+    std::vector<float> vertexDistances_;
+    std::vector<float> faceDistances_;
+
+    SpatialHash vertexHash_;
+    SpatialHash faceHash_;
+    bool spatialHashDirty_ = true;
 };
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "HealthMonitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+
+bool HealthMonitor::due(int stepCount) const
+{
+    return info.enabled && !failed_ && info.interval > 0 && stepCount % info.interval == 0;
+}
+
+bool HealthMonitor::begin(int stepCount, size_t morphCount, uint64_t topology, const std::vector<SimulationDomain::Cell>& cells)
+{
+    checking_ = due(stepCount);
+    if (!checking_)
+        return false;
+
+    // The state the run starts from is the first thing to fall back to
+    morphCount_ = morphCount;
+    topology_ = topology;
+    if (lastSnapshotStep_ < 0)
+        takeSnapshot(stepCount, cells);
+    return true;
+}
+
+bool HealthMonitor::checking() const
+{
+    return checking_;
+}
+
+void HealthMonitor::snapshot(int stepCount, size_t morphCount, uint64_t topology, const std::vector<SimulationDomain::Cell>& cells)
+{
+    if (!info.enabled || failed_)
+        return;
+
+    morphCount_ = morphCount;
+    topology_ = topology;
+    takeSnapshot(stepCount, cells);
+}
+
+uint64_t HealthMonitor::topology() const
+{
+    return topology_;
+}
+
+bool HealthMonitor::finish(int stepCount, const FieldStats& stats, const std::vector<SimulationDomain::Cell>& cells)
+{
+    if (!checking_)
+        return true;
+    checking_ = false;
+
+    Violation violation = Violation::None;
+    std::vector<double> masses;
+    std::stringstream ss;
+    if (stats.nonFinite())
+        violation = Violation::NonFinite;
+    for (auto& morphogen : stats.morphogens())
+    {
+        if (violation == Violation::None && !(morphogen.min >= info.minValue && morphogen.max <= info.maxValue))
+            violation = Violation::OutOfRange;
+        masses.push_back(morphogen.integral);
+    }
+
+    if (info.massTolerance > 0.f && violation == Violation::None && masses_.size() == masses.size())
+    {
+        for (size_t m = 0; m < masses.size(); ++m)
+        {
+            const double change = std::abs(masses[m] - masses_[m]) / std::max(std::abs(masses_[m]), 1e-30);
+            if (!(change <= info.massTolerance))
+            {
+                violation = Violation::Mass;
+                ss << " (morphogen " << m << " integral " << masses_[m] << " -> " << masses[m] << ")";
+                break;
+            }
+        }
+    }
+
+    violation_ = violation;
+    if (violation != Violation::None)
+    {
+        report_ = std::string(violationName(violation)) + " at step " + std::to_string(stepCount + 1) + ss.str();
+        return false;
+    }
+
+    // The checked cells hold the state after this step
+    masses_ = masses;
+    const int checkedStep = stepCount + 1;
+    if (checkedStep - lastSnapshotStep_ >= info.snapshotInterval)
+        takeSnapshot(checkedStep, cells);
+    return true;
+}
+
+void HealthMonitor::takeSnapshot(int stepCount, const std::vector<SimulationDomain::Cell>& cells)
+{
+    if (info.snapshotCount <= 0)
+        return;
+
+    // Reuse the oldest snapshot's memory once the ring is full
+    Snapshot snapshot;
+    if (snapshots_.size() >= static_cast<size_t>(info.snapshotCount))
+    {
+        snapshot = std::move(snapshots_.front());
+        snapshots_.pop_front();
+    }
+
+    snapshot.stepCount = stepCount;
+    snapshot.cellCount = cells.size();
+    snapshot.topology = topology_;
+    snapshot.vals.resize(cells.size() * morphCount_);
+    float* dst = snapshot.vals.data();
+    for (auto& cell : cells)
+        for (size_t m = 0; m < morphCount_; ++m)
+            *dst++ = cell.vals[m];
+
+    snapshots_.push_back(std::move(snapshot));
+    lastSnapshotStep_ = stepCount;
+    rollbacks_ = 0;
+}
+
+bool HealthMonitor::rollback(std::vector<SimulationDomain::Cell>& readFrom, std::vector<SimulationDomain::Cell>& writeTo, int& stepCount)
+{
+    // Growth and coarsening renumber the cells, so snapshots of another topology can't be used
+    while (!snapshots_.empty() && (snapshots_.back().cellCount != readFrom.size() || snapshots_.back().topology != topology_))
+        snapshots_.pop_back();
+
+    // Without a smaller dt the newest snapshot would only blow up the same way again
+    if (rollbacks_ > 0 && !info.halveDt && !snapshots_.empty())
+        snapshots_.pop_back();
+
+    if (snapshots_.empty() || rollbacks_ >= info.maxRollbacks)
+    {
+        failed_ = true;
+        return false;
+    }
+
+    const Snapshot& snapshot = snapshots_.back();
+    const float* src = snapshot.vals.data();
+    for (size_t i = 0; i < readFrom.size(); ++i, src += morphCount_)
+    {
+        for (size_t m = 0; m < morphCount_; ++m)
+        {
+            readFrom[i].vals[m] = src[m];
+            writeTo[i].vals[m] = src[m];
+        }
+    }
+
+    stepCount = snapshot.stepCount;
+    lastSnapshotStep_ = snapshot.stepCount;
+    masses_.clear();
+    rollbacks_++;
+    return true;
+}
+
+void HealthMonitor::reset()
+{
+    snapshots_.clear();
+    masses_.clear();
+    checking_ = false;
+    failed_ = false;
+    lastSnapshotStep_ = -1;
+    rollbacks_ = 0;
+    violation_ = Violation::None;
+    report_.clear();
+}
+
+HealthMonitor::Violation HealthMonitor::violation() const
+{
+    return violation_;
+}
+
+bool HealthMonitor::failed() const
+{
+    return failed_;
+}
+
+int HealthMonitor::rollbacks() const
+{
+    return rollbacks_;
+}
+
+const std::vector<double>& HealthMonitor::masses() const
+{
+    return masses_;
+}
+
+const std::string& HealthMonitor::report() const
+{
+    return report_;
+}
+
+const char* HealthMonitor::violationName(Violation violation)
+{
+    switch (violation)
+    {
+    case Violation::NonFinite:  return "NaN/Inf";
+    case Violation::OutOfRange: return "value out of range";
+    case Violation::Mass:       return "integral jump";
+    default:                    return "healthy";
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "FieldStats.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+
+// Checks the field for NaN/Inf, values outside a range and jumps in each morphogen's integral
+// every few steps, and keeps a ring of recent healthy states to roll back to. The numbers come
+// from the step's FieldStats. Snapshots are tagged with the domain's topology key and only
+// rolled back to while the domain still has that topology.
+class HealthMonitor
+{
+public:
+    enum class Violation { None, NonFinite, OutOfRange, Mass };
+
+    struct Info
+    {
+        bool enabled = false;
+        int interval = 10;            // steps between checks
+        float minValue = -1e6f;       // allowed range of every morphogen
+        float maxValue = 1e6f;
+        float massTolerance = 0.f;    // largest relative change of an integral between checks, 0 ignores mass
+        int snapshotCount = 3;        // healthy states kept to roll back to
+        int snapshotInterval = 500;   // steps between snapshots
+        int maxRollbacks = 3;         // rollbacks in a row before giving up
+        bool halveDt = true;          // halve dt on every rollback
+    };
+
+    HealthMonitor() = default;
+
+    bool due(int stepCount) const;
+    // Decides if the coming step is checked, cells is the state about to be stepped
+    bool begin(int stepCount, size_t morphCount, uint64_t topology, const std::vector<SimulationDomain::Cell>& cells);
+    bool checking() const;
+    // Snapshots cells straight away, for a state whose topology just changed
+    void snapshot(int stepCount, size_t morphCount, uint64_t topology, const std::vector<SimulationDomain::Cell>& cells);
+    uint64_t topology() const;
+    // Snapshots the checked cells when one is due, returns false on a violation
+    bool finish(int stepCount, const FieldStats& stats, const std::vector<SimulationDomain::Cell>& cells);
+    // Copies the newest usable snapshot into both buffers, returns false if there is none
+    bool rollback(std::vector<SimulationDomain::Cell>& readFrom, std::vector<SimulationDomain::Cell>& writeTo, int& stepCount);
+    void reset();
+
+    Violation violation() const;
+    bool failed() const;
+    int rollbacks() const;
+    const std::vector<double>& masses() const;
+    const std::string& report() const;
+    static const char* violationName(Violation violation);
+
+    Info info;
+
+private:
+    struct Snapshot
+    {
+        int stepCount = 0;
+        size_t cellCount = 0;
+        uint64_t topology = 0;
+        std::vector<float> vals;
+    };
+
+    void takeSnapshot(int stepCount, const std::vector<SimulationDomain::Cell>& cells);
+
+    std::deque<Snapshot> snapshots_;
+    std::vector<double> masses_;
+    size_t morphCount_ = 0;
+    uint64_t topology_ = 0;
+    bool checking_ = false;
+    bool failed_ = false;
+    int lastSnapshotStep_ = -1;
+    int rollbacks_ = 0;
+    Violation violation_ = Violation::None;
+    std::string report_;
+};
@@ -0,0 +1,114 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& fileName, bool sequential)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS), nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return fail("Cannot open " + fileName);
+    file_ = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+        return fail("Cannot read the size of " + fileName);
+    size_ = static_cast<size_t>(size.QuadPart);
+
+    if (size_ > 0)
+    {
+        mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ != nullptr)
+            data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr)
+            return fail("Cannot map " + fileName);
+    }
+#else
+    int file = ::open(fileName.c_str(), O_RDONLY);
+    if (file < 0)
+        return fail("Cannot open " + fileName);
+
+    struct stat info;
+    if (fstat(file, &info) != 0)
+    {
+        ::close(file);
+        return fail("Cannot read the size of " + fileName);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+
+    // The mapping keeps the file alive on its own
+    void* mapped = size_ > 0 ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0) : nullptr;
+    ::close(file);
+    if (mapped == MAP_FAILED)
+        return fail("Cannot map " + fileName);
+    if (mapped != nullptr)
+    {
+        madvise(mapped, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        data_ = static_cast<const char*>(mapped);
+    }
+#endif
+    open_ = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+    if (mapping_ != nullptr)
+        CloseHandle(mapping_);
+    if (file_ != nullptr)
+        CloseHandle(file_);
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    if (data_ != nullptr)
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+bool MappedFile::isOpen() const
+{
+    return open_;
+}
+
+const char* MappedFile::data() const
+{
+    return data_;
+}
+
+size_t MappedFile::size() const
+{
+    return size_;
+}
+
+const std::string& MappedFile::error() const
+{
+    return error_;
+}
+
+bool MappedFile::fail(const std::string& error)
+{
+    error_ = error;
+    close();
+    return false;
+}
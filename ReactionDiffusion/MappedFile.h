@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+
+
+// Read only memory mapping of a whole file. The mapping is private, so the file can be replaced
+// while it is open.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // sequential hints the OS to read ahead, an empty file maps to no data
+    bool open(const std::string& fileName, bool sequential = true);
+    void close();
+    bool isOpen() const;
+    const char* data() const;
+    size_t size() const;
+    const std::string& error() const;
+
+private:
+    bool fail(const std::string& error);
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+    std::string error_;
+};
@@ -1,5 +1,48 @@
 #include "Mesh.h"
+#include "SpatialHash.h"
+#include "LOG.h"
 
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <unordered_map>
+
+
+namespace
+{
+    // Barycentric weights of the point of triangle abc closest to p, after Ericson (2004),
+    // Real-Time Collision Detection 5.1.5
+    void closestPointWeights(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c, float& wa, float& wb, float& wc)
+    {
+        Vec3 ab = b - a, ac = c - a;
+        float d1 = dot(ab, p - a), d2 = dot(ac, p - a);
+        float d3 = dot(ab, p - b), d4 = dot(ac, p - b);
+        float d5 = dot(ab, p - c), d6 = dot(ac, p - c);
+        float va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+
+        wa = 1.f, wb = 0.f, wc = 0.f;
+        if (d1 <= 0.f && d2 <= 0.f)
+            return;
+        if (d3 >= 0.f && d4 <= d3)
+            wa = 0.f, wb = 1.f;
+        else if (d6 >= 0.f && d5 <= d6)
+            wa = 0.f, wc = 1.f;
+        else if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+            wb = d1 / (d1 - d3), wa = 1.f - wb;
+        else if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+            wc = d2 / (d2 - d6), wa = 1.f - wc;
+        else if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+            wc = (d4 - d3) / ((d4 - d3) + (d5 - d6)), wa = 0.f, wb = 1.f - wc;
+        else if (va + vb + vc != 0.f)
+        {
+            wb = vb / (va + vb + vc);
+            wc = vc / (va + vb + vc);
+            wa = 1.f - wb - wc;
+        }
+    }
+}
 
 Mesh::Mesh(int xRes, int yRes, float width, float height)
 {
@@ -189,3 +232,454 @@ void Mesh::calculateNormals(bool useAngleWeights)
 
     updateNormalVBO();
 }
+
+// Isotropic remeshing after Botsch and Kobbelt (2004), A Remeshing Approach to Multiresolution Modeling.
+// Each iteration splits edges longer than 4/3 targetEdgeLength, collapses edges shorter than
+// 4/5 targetEdgeLength, flips edges towards valence 6 (4 on the boundary) and relaxes vertices
+// tangentially. Boundary vertices stay fixed, boundary edges are split but never collapsed.
+// Relaxed vertices are projected back onto the input surface, and their texture coordinates
+// and colours are sampled from it.
+void Mesh::remesh(float targetEdgeLength, unsigned iterations)
+{
+    if (targetEdgeLength <= 0.f || indices_.size() < 3)
+        return;
+
+    const float high = targetEdgeLength * 4.f / 3.f;
+    const float low = targetEdgeLength * 4.f / 5.f;
+    const bool hasUVs = textureCoords_.size() == positions_.size();
+    const bool hasColors = colors_.size() == positions_.size();
+
+    using Triangle = std::array<unsigned, 3>;
+    std::vector<Triangle> tris(indices_.size() / 3);
+    for (size_t i = 0; i < tris.size(); ++i)
+        tris[i] = { indices_[i * 3], indices_[i * 3 + 1], indices_[i * 3 + 2] };
+
+    auto edgeKey = [](unsigned a, unsigned b) -> uint64_t
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    };
+
+    auto length = [&](unsigned a, unsigned b)
+    {
+        return (positions_[a] - positions_[b]).length();
+    };
+
+    auto normalOf = [&](unsigned i0, unsigned i1, unsigned i2)
+    {
+        return normalize(cross(positions_[i1] - positions_[i0], positions_[i2] - positions_[i0]));
+    };
+
+    // Writes the interpolation of vertices a, b and c into vertex dst
+    auto interpolate = [&](unsigned dst, unsigned a, unsigned b, unsigned c, float wa, float wb, float wc)
+    {
+        Vec3 p = positions_[a] * wa + positions_[b] * wb + positions_[c] * wc;
+        Vec2 uv;
+        Vec4 color;
+        if (hasUVs)
+            uv = textureCoords_[a] * wa + textureCoords_[b] * wb + textureCoords_[c] * wc;
+        if (hasColors)
+            color = colors_[a] * wa + colors_[b] * wb + colors_[c] * wc;
+
+        positions_[dst] = p;
+        if (hasUVs)
+            textureCoords_[dst] = uv;
+        if (hasColors)
+            colors_[dst] = color;
+    };
+
+    auto addVertex = [&]()
+    {
+        positions_.emplace_back();
+        if (hasUVs)
+            textureCoords_.emplace_back();
+        if (hasColors)
+            colors_.emplace_back();
+        return static_cast<unsigned>(positions_.size() - 1);
+    };
+
+    // The input surface, a spatial hash over its triangles' centres finds the ones near a point
+    const std::vector<Triangle> sourceTris = tris;
+    const std::vector<Vec3> sourcePositions = positions_;
+    const std::vector<Vec2> sourceUVs = hasUVs ? textureCoords_ : std::vector<Vec2>();
+    const std::vector<Vec4> sourceColors = hasColors ? colors_ : std::vector<Vec4>();
+    std::vector<Vec3> sourceCentres(sourceTris.size());
+    float sourceReach = 0.f; // furthest a triangle's corner is from its centre
+    for (size_t f = 0; f < sourceTris.size(); ++f)
+    {
+        const Triangle& t = sourceTris[f];
+        sourceCentres[f] = (sourcePositions[t[0]] + sourcePositions[t[1]] + sourcePositions[t[2]]) * (1.f / 3.f);
+        for (unsigned i : t)
+            sourceReach = std::max(sourceReach, (sourcePositions[i] - sourceCentres[f]).length());
+    }
+    SpatialHash sourceHash;
+    sourceHash.build(sourceCentres, std::max(targetEdgeLength, sourceReach));
+
+    // Moves vertex v to the point of the input surface closest to q and samples it there.
+    // q is at most distance from the surface.
+    std::vector<unsigned> nearby;
+    auto project = [&](unsigned v, const Vec3& q, float distance)
+    {
+        float radius = sourceReach + distance;
+        sourceHash.query(q, radius, nearby);
+        for (int widen = 0; nearby.empty() && widen < 16; ++widen)
+        {
+            radius *= 2.f;
+            sourceHash.query(q, radius, nearby);
+        }
+
+        float closest = std::numeric_limits<float>::max();
+        for (unsigned f : nearby)
+        {
+            const Triangle& t = sourceTris[f];
+            float wa, wb, wc;
+            closestPointWeights(q, sourcePositions[t[0]], sourcePositions[t[1]], sourcePositions[t[2]], wa, wb, wc);
+            Vec3 p = sourcePositions[t[0]] * wa + sourcePositions[t[1]] * wb + sourcePositions[t[2]] * wc;
+            float d = (p - q).length();
+            if (d >= closest)
+                continue;
+
+            closest = d;
+            positions_[v] = p;
+            if (hasUVs)
+                textureCoords_[v] = sourceUVs[t[0]] * wa + sourceUVs[t[1]] * wb + sourceUVs[t[2]] * wc;
+            if (hasColors)
+                colors_[v] = sourceColors[t[0]] * wa + sourceColors[t[1]] * wb + sourceColors[t[2]] * wc;
+        }
+    };
+
+    // Faces on each edge, more than two means the edge is non-manifold
+    std::unordered_map<uint64_t, std::vector<unsigned>> edgeFaces;
+    std::vector<bool> isBoundary;
+    auto buildEdges = [&]()
+    {
+        edgeFaces.clear();
+        for (unsigned f = 0; f < tris.size(); ++f)
+            for (int k = 0; k < 3; ++k)
+                edgeFaces[edgeKey(tris[f][k], tris[f][(k + 1) % 3])].push_back(f);
+
+        isBoundary.assign(positions_.size(), false);
+        for (auto& edge : edgeFaces)
+            if (edge.second.size() != 2)
+            {
+                isBoundary[edge.first >> 32] = true;
+                isBoundary[edge.first & 0xffffffff] = true;
+            }
+    };
+
+    auto removeDeadTris = [&](const std::vector<bool>& dead)
+    {
+        size_t n = 0;
+        for (size_t f = 0; f < tris.size(); ++f)
+            if (!dead[f])
+                tris[n++] = tris[f];
+        tris.resize(n);
+    };
+
+    auto splitLongEdges = [&]()
+    {
+        for (int pass = 0; pass < 10; ++pass)
+        {
+            buildEdges();
+            std::vector<std::pair<float, uint64_t>> longEdges;
+            for (auto& edge : edgeFaces)
+            {
+                float len = length(edge.first >> 32, edge.first & 0xffffffff);
+                if (len > high && edge.second.size() <= 2)
+                    longEdges.emplace_back(len, edge.first);
+            }
+            if (longEdges.empty())
+                return;
+
+            std::sort(longEdges.begin(), longEdges.end(), std::greater<std::pair<float, uint64_t>>());
+            std::vector<bool> touched(tris.size(), false);
+            for (auto& longEdge : longEdges)
+            {
+                const auto& faces = edgeFaces[longEdge.second];
+                if (std::any_of(faces.begin(), faces.end(), [&](unsigned f) { return touched[f]; }))
+                    continue;
+
+                unsigned a = static_cast<unsigned>(longEdge.second >> 32);
+                unsigned b = static_cast<unsigned>(longEdge.second & 0xffffffff);
+                unsigned m = addVertex();
+                interpolate(m, a, b, b, .5f, .5f, 0.f);
+
+                for (unsigned f : faces)
+                {
+                    // Rotate so the split edge is (t[0], t[1])
+                    Triangle t = tris[f];
+                    while (!((t[0] == a && t[1] == b) || (t[0] == b && t[1] == a)))
+                        t = { t[1], t[2], t[0] };
+
+                    tris[f] = { t[0], m, t[2] };
+                    tris.push_back({ m, t[1], t[2] });
+                    touched[f] = true;
+                    touched.push_back(true);
+                }
+            }
+        }
+    };
+
+    auto collapseShortEdges = [&]()
+    {
+        buildEdges();
+        std::vector<std::vector<unsigned>> vertexFaces(positions_.size());
+        for (unsigned f = 0; f < tris.size(); ++f)
+            for (unsigned i : tris[f])
+                vertexFaces[i].push_back(f);
+
+        auto neighbours = [&](unsigned v)
+        {
+            std::vector<unsigned> ring;
+            for (unsigned f : vertexFaces[v])
+                for (unsigned i : tris[f])
+                    if (i != v)
+                        ring.push_back(i);
+            std::sort(ring.begin(), ring.end());
+            ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+            return ring;
+        };
+
+        std::vector<std::pair<float, uint64_t>> shortEdges;
+        for (auto& edge : edgeFaces)
+        {
+            float len = length(edge.first >> 32, edge.first & 0xffffffff);
+            if (len < low && edge.second.size() <= 2)
+                shortEdges.emplace_back(len, edge.first);
+        }
+        std::sort(shortEdges.begin(), shortEdges.end());
+
+        std::vector<bool> locked(positions_.size(), false);
+        std::vector<bool> dead(tris.size(), false);
+        for (auto& shortEdge : shortEdges)
+        {
+            unsigned keep = static_cast<unsigned>(shortEdge.second >> 32);
+            unsigned remove = static_cast<unsigned>(shortEdge.second & 0xffffffff);
+            if (locked[keep] || locked[remove])
+                continue;
+
+            // Boundary vertices stay where they are, so an edge between two of them is kept
+            if (isBoundary[keep] && isBoundary[remove])
+                continue;
+            if (isBoundary[remove])
+                std::swap(keep, remove);
+
+            bool keepInPlace = isBoundary[keep];
+            Vec3 target = keepInPlace ? positions_[keep] : (positions_[keep] + positions_[remove]) * .5f;
+
+            // Link condition
+            std::vector<unsigned> ringKeep = neighbours(keep);
+            std::vector<unsigned> ringRemove = neighbours(remove);
+            std::vector<unsigned> shared;
+            std::set_intersection(ringKeep.begin(), ringKeep.end(), ringRemove.begin(), ringRemove.end(), std::back_inserter(shared));
+            if (shared.size() != edgeFaces[shortEdge.second].size())
+                continue;
+
+            // Faces that move must not get long edges or flip
+            bool valid = true;
+            for (unsigned v : { keep, remove })
+            {
+                for (unsigned f : vertexFaces[v])
+                {
+                    Triangle t = tris[f];
+                    bool hasKeep = t[0] == keep || t[1] == keep || t[2] == keep;
+                    bool hasRemove = t[0] == remove || t[1] == remove || t[2] == remove;
+                    if (hasKeep && hasRemove)
+                        continue;
+
+                    Vec3 p[3];
+                    for (int k = 0; k < 3; ++k)
+                        p[k] = t[k] == v ? target : positions_[t[k]];
+
+                    Vec3 n = cross(p[1] - p[0], p[2] - p[0]);
+                    if ((p[1] - p[0]).length() > high || (p[2] - p[1]).length() > high || (p[0] - p[2]).length() > high ||
+                        n.length() == 0.f || dot(normalize(n), normalOf(t[0], t[1], t[2])) < .2f)
+                    {
+                        valid = false;
+                        break;
+                    }
+                }
+                if (!valid)
+                    break;
+            }
+            if (!valid)
+                continue;
+
+            if (!keepInPlace)
+                interpolate(keep, keep, remove, remove, .5f, .5f, 0.f);
+
+            for (unsigned f : vertexFaces[remove])
+            {
+                Triangle& t = tris[f];
+                if (t[0] == keep || t[1] == keep || t[2] == keep)
+                    dead[f] = true;
+                else
+                {
+                    for (unsigned& i : t)
+                        if (i == remove)
+                            i = keep;
+                    vertexFaces[keep].push_back(f);
+                }
+            }
+
+            locked[keep] = locked[remove] = true;
+            for (unsigned i : ringKeep)
+                locked[i] = true;
+            for (unsigned i : ringRemove)
+                locked[i] = true;
+        }
+
+        removeDeadTris(dead);
+    };
+
+    auto flipEdges = [&]()
+    {
+        buildEdges();
+        std::vector<int> valence(positions_.size(), 0);
+        for (auto& edge : edgeFaces)
+        {
+            valence[edge.first >> 32]++;
+            valence[edge.first & 0xffffffff]++;
+        }
+
+        auto deviation = [&](unsigned v, int val)
+        {
+            return std::abs(val - (isBoundary[v] ? 4 : 6));
+        };
+
+        std::vector<bool> touched(tris.size(), false);
+        std::vector<uint64_t> keys;
+        for (auto& edge : edgeFaces)
+            keys.push_back(edge.first);
+        std::sort(keys.begin(), keys.end());
+
+        for (uint64_t key : keys)
+        {
+            auto it = edgeFaces.find(key);
+            if (it == edgeFaces.end() || it->second.size() != 2)
+                continue;
+
+            unsigned f0 = it->second[0], f1 = it->second[1];
+            if (touched[f0] || touched[f1])
+                continue;
+
+            // Orient f0 as (a, b, c) and find d opposite in f1
+            Triangle t0 = tris[f0];
+            unsigned u = static_cast<unsigned>(key >> 32);
+            unsigned w = static_cast<unsigned>(key & 0xffffffff);
+            while (!((t0[0] == u && t0[1] == w) || (t0[0] == w && t0[1] == u)))
+                t0 = { t0[1], t0[2], t0[0] };
+            unsigned a = t0[0], b = t0[1], c = t0[2];
+            unsigned d = tris[f1][0] + tris[f1][1] + tris[f1][2] - a - b;
+
+            if (c == d || edgeFaces.count(edgeKey(c, d)) > 0 || valence[a] <= 3 || valence[b] <= 3)
+                continue;
+
+            int before = deviation(a, valence[a]) + deviation(b, valence[b]) + deviation(c, valence[c]) + deviation(d, valence[d]);
+            int after = deviation(a, valence[a] - 1) + deviation(b, valence[b] - 1) + deviation(c, valence[c] + 1) + deviation(d, valence[d] + 1);
+            if (after >= before)
+                continue;
+
+            // Do not fold non convex quads
+            Vec3 n = normalOf(a, b, c) + normalOf(b, a, d);
+            if (dot(normalOf(a, d, c), n) <= 0.f || dot(normalOf(d, b, c), n) <= 0.f)
+                continue;
+
+            tris[f0] = { a, d, c };
+            tris[f1] = { d, b, c };
+            touched[f0] = touched[f1] = true;
+
+            valence[a]--;
+            valence[b]--;
+            valence[c]++;
+            valence[d]++;
+            edgeFaces.erase(it);
+            edgeFaces[edgeKey(c, d)] = { f0, f1 };
+        }
+    };
+
+    auto relaxVertices = [&]()
+    {
+        buildEdges();
+        std::vector<Vec3> centroids(positions_.size(), Vec3(0.f));
+        std::vector<int> counts(positions_.size(), 0);
+        std::vector<Vec3> normals(positions_.size(), Vec3(0.f));
+        for (unsigned f = 0; f < tris.size(); ++f)
+        {
+            Vec3 n = cross(positions_[tris[f][1]] - positions_[tris[f][0]], positions_[tris[f][2]] - positions_[tris[f][0]]);
+            for (unsigned i : tris[f])
+                normals[i] = normals[i] + n;
+        }
+        for (auto& edge : edgeFaces)
+        {
+            unsigned a = static_cast<unsigned>(edge.first >> 32);
+            unsigned b = static_cast<unsigned>(edge.first & 0xffffffff);
+            centroids[a] = centroids[a] + positions_[b];
+            centroids[b] = centroids[b] + positions_[a];
+            counts[a]++;
+            counts[b]++;
+        }
+
+        // Relax against a snapshot so the update is independent of vertex order
+        std::vector<Vec3> oldPositions = positions_;
+        for (unsigned v = 0; v < positions_.size(); ++v)
+        {
+            if (isBoundary[v] || counts[v] == 0)
+                continue;
+
+            Vec3 n = normalize(normals[v]);
+            Vec3 p = oldPositions[v];
+            Vec3 move = centroids[v] / static_cast<float>(counts[v]) - p;
+            Vec3 q = p + move - n * dot(n, move);
+
+            // Splits and collapses leave vertices within about an edge length of the surface
+            project(v, q, (q - p).length() + targetEdgeLength);
+        }
+    };
+
+    size_t startTris = tris.size();
+    for (unsigned i = 0; i < iterations; ++i)
+    {
+        splitLongEdges();
+        collapseShortEdges();
+        flipEdges();
+        relaxVertices();
+    }
+
+    // Drop vertices that were collapsed away
+    std::vector<int> remap(positions_.size(), -1);
+    for (const Triangle& t : tris)
+        for (unsigned i : t)
+            remap[i] = 0;
+
+    unsigned n = 0;
+    for (unsigned i = 0; i < positions_.size(); ++i)
+    {
+        if (remap[i] == -1)
+            continue;
+
+        remap[i] = n;
+        positions_[n] = positions_[i];
+        if (hasUVs)
+            textureCoords_[n] = textureCoords_[i];
+        if (hasColors)
+            colors_[n] = colors_[i];
+        n++;
+    }
+    positions_.resize(n);
+    if (hasUVs)
+        textureCoords_.resize(n);
+    if (hasColors)
+        colors_.resize(n);
+
+    indices_.clear();
+    for (const Triangle& t : tris)
+        for (unsigned i : t)
+            indices_.push_back(remap[i]);
+
+    LOG("Remeshed " << startTris << " to " << tris.size() << " triangles (target edge length " << targetEdgeLength << ")");
+
+    normals_.resize(positions_.size(), Vec3(0, 0, 1));
+    calculateNormals();
+    destroyVBOs();
+    initVBOs();
+}
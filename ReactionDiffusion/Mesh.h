@@ -11,5 +11,6 @@ public:
 	virtual ~Mesh() = default;
 
 	void subdivide(unsigned iterations = 1);
+	void remesh(float targetEdgeLength, unsigned iterations = 5);
 	void calculateNormals(bool useAngleWeights = true);
 };
\ No newline at end of file
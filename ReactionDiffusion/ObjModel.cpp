@@ -1,4 +1,12 @@
 #include "ObjModel.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstring>
 
 
 void saveObj(char * filename, const Drawable& mesh)
@@ -46,3 +54,274 @@ void saveObj(char * filename, const Drawable& mesh)
 	}
 	file.close();
 }
+
+namespace
+{
+	// 0 based indices of a face corner, -1 when it has no texture coordinate or normal
+	struct Corner
+	{
+		int v = -1, t = -1, n = -1;
+	};
+
+	// What one chunk of lines holds. Negative indices are resolved against the chunk's own counts
+	// and get the elements of the earlier chunks added once those are known.
+	struct Chunk
+	{
+		std::vector<Vec3> positions;
+		std::vector<Vec3> normals;
+		std::vector<Vec2> textureCoords;
+		std::vector<Corner> corners;		// 3 per triangle
+		std::vector<unsigned char> relative;	// per corner, bit 0 to 2 set when v, t or n is relative to the chunk
+		size_t faceCount = 0;
+		size_t badLine = 0;			// first line that couldn't be parsed, 1 based within the chunk
+	};
+
+	const char* skipSpaces(const char* p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			++p;
+		return p;
+	}
+
+	template<size_t N>
+	bool parseFloats(const char* p, const char* end, float (&values)[N], size_t required)
+	{
+		for (size_t i = 0; i < N; ++i)
+		{
+			p = skipSpaces(p, end);
+			auto result = std::from_chars(p, end, values[i]);
+			if (result.ec != std::errc())
+				return i >= required;
+			p = result.ptr;
+		}
+		return true;
+	}
+
+	// Reads v, v/t, v//n or v/t/n as written, 1 based with negative indices counting back from the
+	// last element read and 0 for a missing one
+	const char* parseCorner(const char* p, const char* end, long long (&indices)[3])
+	{
+		indices[0] = indices[1] = indices[2] = 0;
+		auto result = std::from_chars(p, end, indices[0]);
+		if (result.ec != std::errc() || indices[0] == 0)
+			return nullptr;
+		p = result.ptr;
+		if (p < end && *p == '/')
+		{
+			++p;
+			if (p < end && *p != '/')
+			{
+				result = std::from_chars(p, end, indices[1]);
+				if (result.ec != std::errc())
+					return nullptr;
+				p = result.ptr;
+			}
+			if (p < end && *p == '/')
+			{
+				result = std::from_chars(p + 1, end, indices[2]);
+				if (result.ec != std::errc())
+					return nullptr;
+				p = result.ptr;
+			}
+		}
+		return p;
+	}
+
+	// Makes an index 0 based, absolute ones keep their value and relative ones become an offset
+	// from the start of the chunk that the caller fixes up
+	int resolve(long long index, size_t count, unsigned char& relative, unsigned char bit)
+	{
+		if (index > 0)
+			return static_cast<int>(std::min<long long>(index - 1, INT_MAX));
+		if (index < 0)
+		{
+			relative |= bit;
+			return static_cast<int>(std::max<long long>(static_cast<long long>(count) + index, INT_MIN));
+		}
+		return -1;
+	}
+
+	void parseChunk(const char* p, const char* end, Chunk& chunk)
+	{
+		std::vector<Corner> polygon;
+		std::vector<unsigned char> polygonRelative;
+		for (size_t line = 1; p < end; ++line)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if (lineEnd == nullptr)
+				lineEnd = end;
+
+			bool parsed = true;
+			const char* q = skipSpaces(p, lineEnd);
+			if (lineEnd - q >= 2 && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t'))
+			{
+				float values[3];
+				parsed = parseFloats(q + 2, lineEnd, values, 3);
+				chunk.positions.emplace_back(values[0], values[1], values[2]);
+			}
+			else if (lineEnd - q >= 3 && q[0] == 'v' && q[1] == 'n')
+			{
+				float values[3];
+				parsed = parseFloats(q + 2, lineEnd, values, 3);
+				chunk.normals.emplace_back(values[0], values[1], values[2]);
+			}
+			else if (lineEnd - q >= 3 && q[0] == 'v' && q[1] == 't')
+			{
+				float values[2] = { 0.f, 0.f };
+				parsed = parseFloats(q + 2, lineEnd, values, 1);
+				chunk.textureCoords.emplace_back(values[0], values[1]);
+			}
+			else if (lineEnd - q >= 2 && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t'))
+			{
+				polygon.clear();
+				polygonRelative.clear();
+				for (q = skipSpaces(q + 2, lineEnd); q < lineEnd && parsed; q = skipSpaces(q, lineEnd))
+				{
+					long long indices[3];
+					q = parseCorner(q, lineEnd, indices);
+					parsed = q != nullptr;
+					if (!parsed)
+						break;
+
+					Corner corner;
+					unsigned char relative = 0;
+					corner.v = resolve(indices[0], chunk.positions.size(), relative, 1);
+					corner.t = resolve(indices[1], chunk.textureCoords.size(), relative, 2);
+					corner.n = resolve(indices[2], chunk.normals.size(), relative, 4);
+					polygon.push_back(corner);
+					polygonRelative.push_back(relative);
+				}
+
+				parsed = parsed && polygon.size() >= 3;
+				for (size_t k = 1; parsed && k + 1 < polygon.size(); ++k)
+				{
+					for (size_t j : { size_t(0), k, k + 1 })
+					{
+						chunk.corners.push_back(polygon[j]);
+						chunk.relative.push_back(polygonRelative[j]);
+					}
+				}
+				if (parsed)
+					chunk.faceCount++;
+			}
+
+			if (!parsed && chunk.badLine == 0)
+				chunk.badLine = line;
+			p = lineEnd < end ? lineEnd + 1 : end;
+		}
+	}
+}
+
+bool ObjModel::loadModel(std::string filename)
+{
+	loaded = false;
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cout << "Can't load model: " << filename << std::endl;
+		return false;
+	}
+
+	const char* data = file.data();
+	const std::vector<const char*> chunkStarts = Utils::splitLines(data, data + file.size(), 1 << 20);
+	const size_t chunkCount = chunkStarts.size() - 1;
+	std::vector<Chunk> chunks(chunkCount);
+	auto forEachChunk = [&](auto func)
+	{
+		ThreadPool::shared().parallelFor(chunkCount, func);
+	};
+	forEachChunk([&](size_t i) { parseChunk(chunkStarts[i], chunkStarts[i + 1], chunks[i]); });
+
+	// Where each chunk's elements go, the counts of the earlier chunks also turn chunk relative
+	// indices into file ones
+	struct Offsets
+	{
+		size_t positions = 0, normals = 0, textureCoords = 0, corners = 0;
+	};
+	std::vector<Offsets> offsets(chunkCount + 1);
+	faceCount_ = 0;
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		const Chunk& chunk = chunks[i];
+		if (chunk.badLine != 0)
+		{
+			const size_t line = std::count(data, chunkStarts[i], '\n') + chunk.badLine;
+			std::cout << "Can't parse line " << line << " of model: " << filename << std::endl;
+			return false;
+		}
+
+		offsets[i + 1].positions = offsets[i].positions + chunk.positions.size();
+		offsets[i + 1].normals = offsets[i].normals + chunk.normals.size();
+		offsets[i + 1].textureCoords = offsets[i].textureCoords + chunk.textureCoords.size();
+		offsets[i + 1].corners = offsets[i].corners + chunk.corners.size();
+		faceCount_ += chunk.faceCount;
+	}
+
+	std::vector<Vec3> parsedPositions(offsets[chunkCount].positions), parsedNormals(offsets[chunkCount].normals);
+	std::vector<Vec2> parsedTextureCoords(offsets[chunkCount].textureCoords);
+	std::vector<Corner> corners(offsets[chunkCount].corners);
+	forEachChunk([&](size_t i) {
+		Chunk& chunk = chunks[i];
+		const Offsets& offset = offsets[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), parsedPositions.begin() + offset.positions);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), parsedNormals.begin() + offset.normals);
+		std::copy(chunk.textureCoords.begin(), chunk.textureCoords.end(), parsedTextureCoords.begin() + offset.textureCoords);
+		for (size_t j = 0; j < chunk.corners.size(); ++j)
+		{
+			Corner corner = chunk.corners[j];
+			if (chunk.relative[j] & 1)
+				corner.v += static_cast<int>(offset.positions);
+			if (chunk.relative[j] & 2)
+				corner.t += static_cast<int>(offset.textureCoords);
+			if (chunk.relative[j] & 4)
+				corner.n += static_cast<int>(offset.normals);
+			corners[offset.corners + j] = corner;
+		}
+		chunk = Chunk();
+	});
+
+	// Number the positions faces use in file order
+	bool hasNormals = false, hasTextureCoords = false;
+	std::vector<unsigned> remap(parsedPositions.size(), 0);
+	for (const Corner& corner : corners)
+	{
+		if (corner.v < 0 || static_cast<size_t>(corner.v) >= parsedPositions.size() ||
+			(corner.t >= 0 && static_cast<size_t>(corner.t) >= parsedTextureCoords.size()) ||
+			(corner.n >= 0 && static_cast<size_t>(corner.n) >= parsedNormals.size()))
+		{
+			std::cout << "Face index out of range in model: " << filename << std::endl;
+			return false;
+		}
+		remap[corner.v] = 1;
+		hasTextureCoords = hasTextureCoords || corner.t >= 0;
+		hasNormals = hasNormals || corner.n >= 0;
+	}
+
+	unsigned vertexCount = 0;
+	for (unsigned& index : remap)
+		index = index ? vertexCount++ : UINT_MAX;
+
+	positions_.assign(vertexCount, Vec3());
+	normals_.assign(hasNormals ? vertexCount : 0, Vec3());
+	textureCoords_.assign(hasTextureCoords ? vertexCount : 0, Vec2());
+	for (size_t i = 0; i < parsedPositions.size(); ++i)
+		if (remap[i] != UINT_MAX)
+			positions_[remap[i]] = parsedPositions[i];
+
+	indices_.resize(corners.size());
+	for (size_t i = 0; i < corners.size(); ++i)
+	{
+		const Corner& corner = corners[i];
+		const unsigned index = remap[corner.v];
+		indices_[i] = index;
+		if (corner.n >= 0)
+			normals_[index] = parsedNormals[corner.n];
+		if (corner.t >= 0)
+			textureCoords_[index] = parsedTextureCoords[corner.t];
+	}
+
+	if (textureCoords_.size() == 0)
+		std::cout << "Warning: No texture coordinates associated with model.\n";
+	loaded = true;
+	return true;
+}
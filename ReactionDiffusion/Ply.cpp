@@ -0,0 +1,530 @@
+#include "Ply.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <sstream>
+
+
+namespace
+{
+	enum class Role { None, X, Y, Z, NX, NY, NZ, S, T, Red, Green, Blue, Alpha };
+
+	Role roleOf(const std::string& name)
+	{
+		if (name == "x") return Role::X;
+		if (name == "y") return Role::Y;
+		if (name == "z") return Role::Z;
+		if (name == "nx") return Role::NX;
+		if (name == "ny") return Role::NY;
+		if (name == "nz") return Role::NZ;
+		if (name == "s" || name == "u") return Role::S;
+		if (name == "t" || name == "v") return Role::T;
+		if (name == "red") return Role::Red;
+		if (name == "green") return Role::Green;
+		if (name == "blue") return Role::Blue;
+		if (name == "alpha") return Role::Alpha;
+		return Role::None;
+	}
+
+	Ply::Type typeOf(const std::string& name)
+	{
+		if (name == "char" || name == "int8") return Ply::Type::Int8;
+		if (name == "uchar" || name == "uint8") return Ply::Type::UInt8;
+		if (name == "short" || name == "int16") return Ply::Type::Int16;
+		if (name == "ushort" || name == "uint16") return Ply::Type::UInt16;
+		if (name == "int" || name == "int32") return Ply::Type::Int32;
+		if (name == "uint" || name == "uint32") return Ply::Type::UInt32;
+		if (name == "float" || name == "float32") return Ply::Type::Float32;
+		if (name == "double" || name == "float64") return Ply::Type::Float64;
+		return Ply::Type::Invalid;
+	}
+
+	size_t sizeOf(Ply::Type type)
+	{
+		switch (type)
+		{
+		case Ply::Type::Int8:
+		case Ply::Type::UInt8:   return 1;
+		case Ply::Type::Int16:
+		case Ply::Type::UInt16:  return 2;
+		case Ply::Type::Int32:
+		case Ply::Type::UInt32:
+		case Ply::Type::Float32: return 4;
+		case Ply::Type::Float64: return 8;
+		default:                 return 0;
+		}
+	}
+
+	bool isFloat(Ply::Type type)
+	{
+		return type == Ply::Type::Float32 || type == Ply::Type::Float64;
+	}
+
+	template<typename T>
+	T load(const char* data, bool swap)
+	{
+		char bytes[sizeof(T)];
+		std::memcpy(bytes, data, sizeof(T));
+		if (swap)
+			std::reverse(bytes, bytes + sizeof(T));
+		T value;
+		std::memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+
+	double loadValue(const char* data, Ply::Type type, bool swap)
+	{
+		switch (type)
+		{
+		case Ply::Type::Int8:    return load<int8_t>(data, swap);
+		case Ply::Type::UInt8:   return load<uint8_t>(data, swap);
+		case Ply::Type::Int16:   return load<int16_t>(data, swap);
+		case Ply::Type::UInt16:  return load<uint16_t>(data, swap);
+		case Ply::Type::Int32:   return load<int32_t>(data, swap);
+		case Ply::Type::UInt32:  return load<uint32_t>(data, swap);
+		case Ply::Type::Float32: return load<float>(data, swap);
+		case Ply::Type::Float64: return load<double>(data, swap);
+		default:                 return 0.0;
+		}
+	}
+
+	// One vertex is gathered here property by property, then stored
+	struct Vertex
+	{
+		Vec3 position, normal;
+		Vec2 uv;
+		Color color;
+
+		void set(Role role, double value, bool floatValue)
+		{
+			// Float colours are in [0, 1]
+			unsigned char channel = static_cast<unsigned char>(std::min(std::max(floatValue ? value * 255.0 + 0.5 : value, 0.0), 255.0));
+			switch (role)
+			{
+			case Role::X:     position.x = static_cast<float>(value); break;
+			case Role::Y:     position.y = static_cast<float>(value); break;
+			case Role::Z:     position.z = static_cast<float>(value); break;
+			case Role::NX:    normal.x = static_cast<float>(value); break;
+			case Role::NY:    normal.y = static_cast<float>(value); break;
+			case Role::NZ:    normal.z = static_cast<float>(value); break;
+			case Role::S:     uv.u_ = static_cast<float>(value); break;
+			case Role::T:     uv.v_ = static_cast<float>(value); break;
+			case Role::Red:   color.r = channel; break;
+			case Role::Green: color.g = channel; break;
+			case Role::Blue:  color.b = channel; break;
+			case Role::Alpha: color.a = channel; break;
+			default: break;
+			}
+		}
+	};
+
+	// Splits a polygon's corners into a fan of triangles
+	void appendPolygon(std::vector<unsigned>& indices, const unsigned* corners, size_t count)
+	{
+		for (size_t k = 1; k + 1 < count; ++k)
+		{
+			indices.push_back(corners[0]);
+			indices.push_back(corners[k]);
+			indices.push_back(corners[k + 1]);
+		}
+	}
+
+	const char* skipSpaces(const char* data, const char* end)
+	{
+		while (data < end && (*data == ' ' || *data == '\t' || *data == '\r'))
+			++data;
+		return data;
+	}
+}
+
+Ply::Ply(const std::string& filename)
+{
+	valid_ = loadPly(filename);
+}
+
+bool Ply::isLoaded() const
+{
+	return valid_;
+}
+
+bool Ply::setValidState(bool validSate, const std::string& message)
+{
+	LOG(message);
+	errorMessage_ = message;
+	valid_ = validSate;
+	return valid_;
+}
+
+bool Ply::loadPly(const std::string& filename)
+{
+	valid_ = false;
+	errorMessage_ = "No Error";
+	elements_.clear();
+
+	MappedFile plyFile;
+	if (!plyFile.open(filename))
+		return setValidState(false, "Failed to open: " + filename);
+
+	const char* data = plyFile.data();
+	const char* end = data + plyFile.size();
+	if (!readHeader(data, end))
+		return false;
+
+	positions_.clear();
+	normals_.clear();
+	colors_.clear();
+	textureCoords_.clear();
+	indices_.clear();
+
+	bool read = formatType_ == Format::Ascii ? readAscii(data, end) : readBinary(data, end);
+	if (!read)
+		return false;
+
+	for (unsigned index : indices_)
+		if (index >= positions_.size())
+			return setValidState(false, "Face index " + std::to_string(index) + " is out of range in: " + filename);
+
+	valid_ = true;
+	destroyVBOs();
+	initVBOs();
+	return valid_;
+}
+
+bool Ply::readHeader(const char*& data, const char* end)
+{
+	auto nextLine = [&](std::string& line)
+	{
+		if (data >= end)
+			return false;
+		const char* lineEnd = static_cast<const char*>(std::memchr(data, '\n', end - data));
+		if (lineEnd == nullptr)
+			lineEnd = end;
+		line.assign(data, lineEnd);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		data = lineEnd < end ? lineEnd + 1 : end;
+		return true;
+	};
+
+	// Test for ply str at start of file
+	std::string line;
+	if (!nextLine(line) || line != "ply")
+		return setValidState(false, "Ply file is invalid");
+
+	// Read header
+	std::string temp;
+	bool formatSeen = false;
+	while (nextLine(line))
+	{
+		std::stringstream lineStream(line);
+		std::vector<std::string> splitLine;
+		while (lineStream >> temp)
+			splitLine.push_back(temp);
+
+		// Skip empty lines and comments
+		if (splitLine.size() == 0 || splitLine[0] == "comment" || splitLine[0] == "obj_info")
+			continue;
+
+		// End of header seen
+		std::string heading = splitLine[0];
+		if (heading == "end_header")
+		{
+			if (!formatSeen)
+				return setValidState(false, "No format in ply header");
+			return true;
+		}
+
+		// Parse format line
+		else if (heading == "format")
+		{
+			if (splitLine.size() < 3)
+				return setValidState(false, "Invalid format: [" + line + "]");
+
+			std::get<0>(format_) = splitLine[1];
+			std::get<1>(format_) = std::atoi(splitLine[2].c_str());
+
+			if (splitLine[1] == "ascii")
+				formatType_ = Format::Ascii;
+			else if (splitLine[1] == "binary_little_endian")
+				formatType_ = Format::BinaryLittleEndian;
+			else if (splitLine[1] == "binary_big_endian")
+				formatType_ = Format::BinaryBigEndian;
+			else
+				return setValidState(false, "Unknown ply format: [" + line + "]");
+			formatSeen = true;
+		}
+
+		// Parse element line
+		else if (heading == "element")
+		{
+			if (splitLine.size() < 3)
+				return setValidState(false, "Invalid element: [" + line + "]");
+
+			PlyElement element;
+			element.typeStr_ = splitLine[1];
+			element.count_ = std::strtoull(splitLine[2].c_str(), nullptr, 10);
+			elements_.push_back(element);
+		}
+
+		// Parse property line
+		else if (heading == "property")
+		{
+			if (splitLine.size() < 3)
+				return setValidState(false, "Invalid property: [" + line + "]");
+			else if (elements_.size() == 0)
+				return setValidState(false, "No element specified: [" + line + "]");
+
+			PlyProperty property;
+			property.name_ = splitLine[splitLine.size() - 1];
+			property.typeStr_ = line.substr(heading.size() + 1, line.size() - (heading.size() + 1 + property.name_.size() + 1));
+			if (splitLine[1] == "list" && splitLine.size() == 5)
+			{
+				property.countType_ = typeOf(splitLine[2]);
+				property.type_ = typeOf(splitLine[3]);
+				if (property.countType_ == Type::Invalid || isFloat(property.countType_))
+					return setValidState(false, "Invalid list length type: [" + line + "]");
+			}
+			else
+				property.type_ = typeOf(splitLine[1]);
+
+			if (property.type_ == Type::Invalid)
+				return setValidState(false, "Unknown property type: [" + line + "]");
+			elements_[elements_.size()-1].properties_.push_back(property);
+		}
+	}
+
+	return setValidState(false, "Ply header has no end_header");
+}
+
+// Lines are counted per chunk first, which gives every chunk the element and row its first line
+// belongs to, then the chunks are parsed independently
+bool Ply::readAscii(const char* data, const char* end)
+{
+	ThreadPool& pool = ThreadPool::shared();
+	const std::vector<const char*> chunkStarts = Utils::splitLines(data, end, 1 << 20);
+	const size_t chunkCount = chunkStarts.size() - 1;
+
+	std::vector<size_t> firstLines(chunkCount + 1, 0);
+	pool.parallelFor(chunkCount, [&](size_t chunk) {
+		const char* from = chunkStarts[chunk];
+		const char* to = chunkStarts[chunk + 1];
+		size_t lines = std::count(from, to, '\n');
+		if (to > from && to[-1] != '\n')
+			lines++;
+		firstLines[chunk + 1] = lines;
+	});
+	for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		firstLines[chunk + 1] += firstLines[chunk];
+
+	// Elements take up consecutive lines
+	std::vector<size_t> elementStarts(elements_.size() + 1, 0);
+	size_t vertexElement = elements_.size(), faceElement = elements_.size();
+	for (size_t e = 0; e < elements_.size(); ++e)
+	{
+		elementStarts[e + 1] = elementStarts[e] + elements_[e].count_;
+		if (elements_[e].typeStr_ == "vertex" && vertexElement == elements_.size())
+			vertexElement = e;
+		else if (elements_[e].typeStr_ == "face" && faceElement == elements_.size())
+			faceElement = e;
+	}
+	if (firstLines[chunkCount] < elementStarts[elements_.size()])
+		return setValidState(false, "Invalid amount of data in Ply");
+
+	std::vector<Role> roles;
+	std::vector<char> floats;
+	if (vertexElement < elements_.size())
+	{
+		for (PlyProperty& property : elements_[vertexElement].properties_)
+		{
+			roles.push_back(property.countType_ == Type::Invalid ? roleOf(property.name_) : Role::None);
+			floats.push_back(isFloat(property.type_));
+		}
+
+		const size_t count = elements_[vertexElement].count_;
+		positions_.resize(count);
+		normals_.resize(count);
+		colors_.assign(count, Color().vec4());
+		textureCoords_.resize(count);
+	}
+
+	std::vector<std::vector<unsigned>> chunkIndices(chunkCount);
+	std::vector<size_t> badLines(chunkCount, 0);
+	pool.parallelFor(chunkCount, [&](size_t chunk) {
+		std::vector<unsigned>& indices = chunkIndices[chunk];
+		std::vector<unsigned> corners;
+		size_t lineIndex = firstLines[chunk];
+		size_t e = std::upper_bound(elementStarts.begin(), elementStarts.end(), lineIndex) - elementStarts.begin() - 1;
+		for (const char* line = chunkStarts[chunk]; line < chunkStarts[chunk + 1] && e < elements_.size(); ++lineIndex)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', chunkStarts[chunk + 1] - line));
+			if (lineEnd == nullptr)
+				lineEnd = chunkStarts[chunk + 1];
+			while (e < elements_.size() && lineIndex >= elementStarts[e + 1])
+				e++;
+
+			bool parsed = true;
+			const char* p = line;
+			if (e == vertexElement)
+			{
+				Vertex vertex;
+				for (size_t j = 0; j < roles.size() && parsed; ++j)
+				{
+					double value = 0.0;
+					auto result = std::from_chars(skipSpaces(p, lineEnd), lineEnd, value);
+					parsed = result.ec == std::errc();
+					p = result.ptr;
+					vertex.set(roles[j], value, floats[j] != 0);
+				}
+
+				const size_t i = lineIndex - elementStarts[e];
+				positions_[i] = vertex.position;
+				normals_[i] = vertex.normal;
+				colors_[i] = vertex.color.vec4();
+				textureCoords_[i] = vertex.uv;
+			}
+			else if (e == faceElement)
+			{
+				// The first list holds the corners
+				size_t count = 0;
+				auto result = std::from_chars(skipSpaces(p, lineEnd), lineEnd, count);
+				parsed = result.ec == std::errc();
+				p = result.ptr;
+				corners.resize(parsed ? count : 0);
+				for (size_t k = 0; k < corners.size() && parsed; ++k)
+				{
+					result = std::from_chars(skipSpaces(p, lineEnd), lineEnd, corners[k]);
+					parsed = result.ec == std::errc();
+					p = result.ptr;
+				}
+				if (parsed)
+					appendPolygon(indices, corners.data(), corners.size());
+			}
+
+			if (!parsed && badLines[chunk] == 0)
+				badLines[chunk] = lineIndex + 1;
+			line = lineEnd < chunkStarts[chunk + 1] ? lineEnd + 1 : lineEnd;
+		}
+	});
+
+	for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		if (badLines[chunk] != 0)
+			return setValidState(false, "Invalid ply data on line " + std::to_string(badLines[chunk]) + " after the header");
+
+	size_t indexCount = 0;
+	for (auto& indices : chunkIndices)
+		indexCount += indices.size();
+	indices_.reserve(indexCount);
+	for (auto& indices : chunkIndices)
+		indices_.insert(indices_.end(), indices.begin(), indices.end());
+	return true;
+}
+
+bool Ply::readBinary(const char* data, const char* end)
+{
+	const bool swap = (formatType_ == Format::BinaryBigEndian) != Utils::isBigEndian();
+	ThreadPool& pool = ThreadPool::shared();
+
+	for (PlyElement& element : elements_)
+	{
+		// Elements made of single values have a fixed stride, so their rows can be decoded in parallel
+		size_t stride = 0;
+		bool fixed = true;
+		for (PlyProperty& property : element.properties_)
+		{
+			fixed = fixed && property.countType_ == Type::Invalid;
+			stride += sizeOf(property.type_);
+		}
+
+		if (element.typeStr_ == "vertex" && fixed)
+		{
+			if (stride == 0 || static_cast<size_t>(end - data) / stride < element.count_)
+				return setValidState(false, "Invalid amount of data in Ply");
+
+			std::vector<Role> roles;
+			std::vector<size_t> offsets;
+			size_t offset = 0;
+			for (PlyProperty& property : element.properties_)
+			{
+				roles.push_back(roleOf(property.name_));
+				offsets.push_back(offset);
+				offset += sizeOf(property.type_);
+			}
+
+			const size_t count = element.count_;
+			positions_.resize(count);
+			normals_.resize(count);
+			colors_.assign(count, Color().vec4());
+			textureCoords_.resize(count);
+
+			const size_t rowsPerChunk = std::max<size_t>(1, (count + pool.getNumThreads() - 1) / pool.getNumThreads());
+			pool.parallelFor((count + rowsPerChunk - 1) / rowsPerChunk, [&](size_t chunk) {
+				const size_t last = std::min(count, (chunk + 1) * rowsPerChunk);
+				for (size_t i = chunk * rowsPerChunk; i < last; ++i)
+				{
+					const char* row = data + i * stride;
+					Vertex vertex;
+					for (size_t j = 0; j < roles.size(); ++j)
+					{
+						const Type type = element.properties_[j].type_;
+						if (roles[j] != Role::None)
+							vertex.set(roles[j], loadValue(row + offsets[j], type, swap), isFloat(type));
+					}
+
+					positions_[i] = vertex.position;
+					normals_[i] = vertex.normal;
+					colors_[i] = vertex.color.vec4();
+					textureCoords_[i] = vertex.uv;
+				}
+			});
+			data += count * stride;
+		}
+		else if (fixed)
+		{
+			if (stride > 0 && static_cast<size_t>(end - data) / stride < element.count_)
+				return setValidState(false, "Invalid amount of data in Ply");
+			data += element.count_ * stride;
+		}
+		else
+		{
+			// Rows with lists are walked one after the other, the first list of a face holds its corners
+			const bool face = element.typeStr_ == "face";
+			if (face)
+				indices_.reserve(indices_.size() + element.count_ * 3);
+			std::vector<unsigned> corners;
+			for (size_t i = 0; i < element.count_; ++i)
+			{
+				bool cornersRead = false;
+				for (PlyProperty& property : element.properties_)
+				{
+					size_t count = 1;
+					if (property.countType_ != Type::Invalid)
+					{
+						if (static_cast<size_t>(end - data) < sizeOf(property.countType_))
+							return setValidState(false, "Invalid amount of data in Ply");
+						count = static_cast<size_t>(loadValue(data, property.countType_, swap));
+						data += sizeOf(property.countType_);
+					}
+
+					const size_t size = sizeOf(property.type_);
+					if (static_cast<size_t>(end - data) / size < count)
+						return setValidState(false, "Invalid amount of data in Ply");
+
+					if (face && !cornersRead && property.countType_ != Type::Invalid)
+					{
+						corners.resize(count);
+						for (size_t k = 0; k < count; ++k)
+							corners[k] = static_cast<unsigned>(loadValue(data + k * size, property.type_, swap));
+						appendPolygon(indices_, corners.data(), count);
+						cornersRead = true;
+					}
+					data += count * size;
+				}
+			}
+		}
+	}
+	return true;
+}
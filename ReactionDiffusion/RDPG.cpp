@@ -97,6 +97,14 @@ int RDPG::run()
             window_.getGUI()->exitProgram_ = true;
         }
 
+        // Pattern settled, went flat or blew up, or a batch run can't recover from a bad step
+        if (modelLoaded_ && ((simulation_->convergence.finished() && simulation_->convergence.info.action == ConvergenceMonitor::Action::Stop) ||
+            (simulation_->health.failed() && simulation_->exitAt)))
+        {
+            window_.setShouldExit(true);
+            window_.getGUI()->exitProgram_ = true;
+        }
+
         // Render
         if (!disableRendering_)
         {
@@ -129,6 +137,9 @@ int RDPG::run()
         // Update events 
         window_.waitEvents(!scene_.isPaused());
     }
+
+    // Let the writers catch up with the recorded frames
+    exporter_.finish();
     
     // Perform final actions
     if (screenShot_) { 
@@ -189,6 +200,7 @@ int RDPG::load(const std::string& filename)
     domain_ = newDomain;
 
     scene_.removeDrawables();
+    exporter_.start(simulation_->exportInfo);
 
     window_.getGUI()->saveTextureCallback_ = [&](const std::string& textureName) {
         saveTexture(textureName, simulation_, texSize_[0], texSize_[1]);
@@ -289,18 +301,52 @@ int RDPG::shutdown()
     return errorCode_;
 }
 
-void RDPG::record() const 
+// Only copies the frame, the exporter's writers rasterize, encode and save it
+void RDPG::record()
 {
     if (modelLoaded_ && simulation_->recording() && !simulation_->isPaused() && simulation_->stepCount % (renderCounter_.getDuration() + 1) == 0)
     {
-        std::string stepCountStr = "/" + std::to_string(simulation_->stepCount);
-        LOG("screenshot taken: " + std::string(simulation_->videoPath) + stepCountStr);
+        std::string fileName = std::string(simulation_->videoPath) + "/" + std::to_string(simulation_->stepCount);
+        ExportPipeline::Frame* frame = exporter_.acquire();
+        if (frame == nullptr)
+            return;
+
+        LOG("screenshot taken: " + fileName);
+        frame->fileName = fileName;
         if (simulation_->outputScreens)
-            window_.screenshot(std::string(simulation_->videoPath) + stepCountStr + ".png");
+        {
+            frame->screenshot = true;
+            window_.readPixels(frame->screenPixels, frame->screenWidth, frame->screenHeight);
+        }
+
+        if ((simulation_->outputTextures || simulation_->outputPlys || simulation_->outputSeries) && simulation_->isGPUEnabled && !simulation_->ramUpToDate())
+            simulation_->updateRAM();
+
         if (simulation_->outputTextures)
-            saveTexture(std::string(simulation_->videoPath) + stepCountStr + ".png", simulation_, texSize_[0], texSize_[1]);
+        {
+            frame->texture = true;
+            frame->textureWidth = texSize_[0];
+            frame->textureHeight = texSize_[1];
+            domain_->snapshotTexture(frame->textureSnapshot);
+            frame->textureSnapshot.dilation = simulation_->exportInfo.textureDilation;
+        }
+
         if (simulation_->outputPlys)
-            savePly(std::string(simulation_->videoPath) + stepCountStr, simulation_);
+        {
+            HalfEdgeMesh* hem = dynamic_cast<HalfEdgeMesh*>(domain_);
+            if (hem)
+            {
+                frame->ply = true;
+                hem->snapshotPly(frame->plySnapshot);
+            }
+            else
+                LOG("Domain is not a mesh, cannot save ply");
+        }
+
+        // Every recorded step goes to one file, see TimeSeries
+        if (simulation_->outputSeries)
+            exporter_.snapshotSeries(*frame, *domain_, simulation_->MORPH_COUNT, simulation_->stepCount, std::string(simulation_->videoPath) + "/series.rdts");
+        exporter_.submit(frame);
     }
 }
 
@@ -341,6 +387,8 @@ void RDPG::loadEditorSettings()
             }
             else if (header == "normcoef:")
                 editorSettingsFile >> domain_->normCoef;
+            else if (header == "autonormalize:")
+                editorSettingsFile >> domain_->autoNormalize;
             else if (header == "visiblemorph:")
             { 
                 editorSettingsFile >> visibleMorphIndex;
@@ -495,7 +543,7 @@ void saveTexture(const std::string& textureName, Simulation* simulation, int tex
         simulation->updateRAM();
 
     std::vector<unsigned char> pixels(texSizeX * texSizeY * 3);
-    simulation->domain->exportTexture(pixels.data(), texSizeX, texSizeY);
+    simulation->domain->exportTexture(pixels.data(), texSizeX, texSizeY, simulation->exportInfo.textureDilation);
     Utils::saveImage(textureName.c_str(), texSizeX, texSizeY, pixels.data());
 }
 
@@ -506,7 +554,7 @@ void savePly(const std::string& plyName, Simulation* simulation)
 
     HalfEdgeMesh* hem = dynamic_cast<HalfEdgeMesh*>(simulation->domain);
     if (hem)
-        hem->saveToPly((plyName + ".ply").c_str());
+        hem->saveToPly((plyName + ".ply").c_str(), false, simulation->exportInfo.binaryPly);
     else
         LOG("Domain is not a mesh, cannot save ply");
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include "Counter.h"
 #include "CmdArgsParser.h"
 #include "BSplinePatch.h"
+#include "ExportPipeline.h"
 
 
 class RDPG : 
@@ -21,7 +22,7 @@ class RDPG :
     void createWindow();
     void loadAnimation();
     void createAnimationPatch();
-    void record() const;
+    void record();
     void loadEditorSettings();
 
     Scene scene_;
@@ -42,6 +43,7 @@ class RDPG :
     Camera camera_;
     CmdArgsParser cmdArgsParser_;
     Counter renderCounter_;
+    ExportPipeline exporter_;
     Color backgroundColor_;
     std::vector<Drawable*> patchDrawable_;
     int texSize_[2] = { 2000, 2000 };
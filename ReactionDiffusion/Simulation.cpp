@@ -5,12 +5,18 @@
 #include "SimulationLoader.h"
 #include "Ply.h"
 #include "Nran.h"
+#include "Checkpoint.h"
+#include "HalfEdgeMesh.h"
+#include "Mesh.h"
 
 #include <fstream>
 #include <iostream>
 #include <cfloat>
+#include <cstring>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
+#include <filesystem>
 
 
 Simulation::Simulation(
@@ -36,6 +42,8 @@ Simulation::Simulation(
     growthCounter.setDuration(100);
     stepCount = 0;
     outMorphIndex = 0;
+    std::random_device randomDevice;
+    rngSeed = (static_cast<uint64_t>(randomDevice()) << 32) | randomDevice();
 
     // Parse initial conditions
     initConditions_ = initConditions;
@@ -79,54 +87,167 @@ void Simulation::simulate()
     if (!paused && isGPUEnabled && !gpuUpToDate())
         updateGPU();
 
+    // Gather the field's statistics on the steps something reads them
+    if (!isGPUEnabled)
+    {
+        bool display = (statsRequested || domain->autoNormalize) && statsInterval > 0 && stepCount % statsInterval == 0;
+        bool converge = convergence.begin(stepCount);
+        bool checkHealth = health.begin(stepCount, MORPH_COUNT, health.due(stepCount) ? topologyKey() : 0, domain->getReadFromCells());
+        if (display || converge || checkHealth)
+            fieldStats.begin(threadWork_.size(), MORPH_COUNT);
+    }
+
     doSimulate();
 
+    if (fieldStats.gathering() && !fieldStats.gathered())
+        measureStep();
+
+    if (fieldStats.finish())
+    {
+        // A bad step is thrown away, both buffers are overwritten by the snapshot
+        if (!health.finish(stepCount, fieldStats, domain->getWriteToCells()))
+        {
+            recoverHealth();
+            return;
+        }
+        if (convergence.finish(stepCount, fieldStats))
+            handleConvergence();
+        if (domain->autoNormalize)
+            autoNormalize();
+    }
+
     if (domain->growing && growthCounter.countElapsedAndReset())
         growAndSubdivide();
+    else if (domain->growthPending())
+        continueGrowth();
 
     domain->swap();
     stepCount++;
 
     if (isGPUEnabled)
         ramUpToDate(false);
+
+    if (autoCheckpointInfo.interval > 0 || autoCheckpointInfo.seconds > 0.f)
+        autoCheckpoint();
 }
 
 void Simulation::growAndSubdivide()
 {
+    // Finish the previous tick and follow its renumbering first, so the cells
+    // added by this tick are keyed in the same numbering as paramsMap
+    if (domain->growthPending())
+    {
+        domain->continueGrowth(0.f);
+        updateNewCells();
+    }
     domain->growAndSubdivide(growth, maxFaceArea, subdivisionEnabled_, stepCount);
+    updateNewCells();
+    snapshotGrownTopology();
+}
+
+void Simulation::continueGrowth()
+{
+    domain->continueGrowth(domain->growthTimeBudget);
+    updateNewCells();
+    snapshotGrownTopology();
+}
+
+// Snapshots taken before a growth tick that changed the cells can't be rolled back to,
+// so the health monitor gets one of the grown state as soon as the tick is done
+void Simulation::snapshotGrownTopology()
+{
+    if (isGPUEnabled || domain->growthPending() || !health.info.enabled)
+        return;
 
-    if (domain->cellsToUpdate.size() > 0)
+    const uint64_t key = topologyKey();
+    if (key != health.topology())
+        health.snapshot(stepCount + 1, MORPH_COUNT, key, domain->getWriteToCells());
+}
+
+uint64_t Simulation::topologyKey()
+{
+    if (topologyKeyDirty_)
     {
-        // TODO: add to StochasticCustomReactionDiffusion lap_noise.resize(domain->getCellCount() * MORPH_COUNT);
-        lap.resize(domain->getCellCount() * MORPH_COUNT);
+        topologyKey_ = Checkpoint::checksum(domain->indices_.data(), domain->indices_.size() * sizeof(unsigned)) * 31 + domain->getCellCount();
+        topologyKeyDirty_ = false;
+    }
+    return topologyKey_;
+}
 
-        // For each new cell, get neighbouring params and calc param for new cell
-        for (auto& cellToUpdate : domain->cellsToUpdate)
-        {
-            unsigned i = cellToUpdate.second.neighbours[0];
-            for (auto& p : paramsMap)
-                if (p.contains(cellToUpdate.first))
-                    p.indices_.erase(cellToUpdate.first);
+void Simulation::updateNewCells()
+{
+    if (domain->cellsToUpdate.size() == 0 && domain->cellRemap.size() == 0)
+        return;
+
+    // TODO: add to StochasticCustomReactionDiffusion lap_noise.resize(domain->getCellCount() * MORPH_COUNT);
+    lap.resize(domain->getCellCount() * MORPH_COUNT);
+    topologyKeyDirty_ = true;
 
-            for (auto& p : paramsMap)
+    // For each new cell, get neighbouring params and calc param for new cell.
+    // A neighbour may be new itself, those cells are retried once it has its params
+    std::vector<unsigned> pending;
+    for (auto& cellToUpdate : domain->cellsToUpdate)
+    {
+        for (auto& p : paramsMap)
+            p.indices_.erase(cellToUpdate.first);
+        pending.push_back(cellToUpdate.first);
+    }
+
+    while (!pending.empty())
+    {
+        std::vector<unsigned> deferred;
+        for (unsigned cell : pending)
+        {
+            ParamIndexPair* found = nullptr;
+            for (unsigned i : domain->cellsToUpdate[cell].neighbours)
             {
-                if (p.contains(i))
+                for (auto& p : paramsMap)
                 {
-                    p.indices_.insert(cellToUpdate.first);
-                    break;
+                    if (p.contains(i))
+                    {
+                        found = &p;
+                        break;
+                    }
                 }
+                if (found)
+                    break;
             }
+
+            if (found)
+                found->indices_.insert(cell);
+            else
+                deferred.push_back(cell);
         }
-        domain->cellsToUpdate.clear();
 
-        if (!isGPUEnabled)
-            computeThreadWork();
+        if (deferred.size() == pending.size())
+            break;
+        pending.swap(deferred);
+    }
+    domain->cellsToUpdate.clear();
+
+    // Follow cells renumbered or removed by coarsening
+    if (domain->cellRemap.size() > 0)
+    {
+        for (auto& p : paramsMap)
+        {
+            std::set<unsigned> indices;
+            for (unsigned i : p.indices_)
+                if (i < domain->cellRemap.size() && domain->cellRemap[i] != -1)
+                    indices.insert(static_cast<unsigned>(domain->cellRemap[i]));
+            p.indices_ = indices;
+        }
+        domain->cellRemap.clear();
     }
+
+    if (!isGPUEnabled)
+        computeThreadWork();
+    requestFullSweep();
 }
 
 void Simulation::updateDiffusionCoefs()
 {
     domain->updateDiffusionCoefs();
+    requestFullSweep();
 }
 
 void Simulation::initSim()
@@ -148,7 +269,6 @@ void Simulation::populateCells(std::vector<Simulation::InitConditions> initCondi
     // Noise and randomness
     std::vector<Cell>& cells1 = domain->getReadFromCells();
     std::vector<Cell>& cells2 = domain->getWriteToCells();
-    std::mt19937 gen(4);
 
     // Default initial conditions gray-scott
     if (initConditions.size() == 0)
@@ -167,19 +287,37 @@ void Simulation::populateCells(std::vector<Simulation::InitConditions> initCondi
     }
 
     // For each initial condition
-    for (auto& cond : initConditions)
+    for (size_t condIndex = 0; condIndex < initConditions.size(); ++condIndex)
     {
+        auto& cond = initConditions[condIndex];
+
         // Find indices to set
         std::vector<int> indices = parseIndices(cond.indices, cond.radius);
         for (auto& morphPair : cond.morpMap)
         {
+            const int morphIndex = initMorphIndexMap[morphPair.first];
+            const ValueGenerator generator = compileVal(morphPair.second);
+            const uint64_t stream = (static_cast<uint64_t>(condIndex) << 32) | static_cast<uint32_t>(morphIndex);
+
             // Set initial morphogen value
-            for (auto i : indices)
+            std::vector<std::future<void>> futures;
+            size_t indicesPerThread = (size_t)std::ceil((float)indices.size() / threadPool_.getNumThreads());
+            for (size_t start = 0; start < indices.size(); start += indicesPerThread)
             {
-                float val = parseVal(morphPair.second, gen);
-                cells1[i].vals[initMorphIndexMap[morphPair.first]] = val;
-                cells2[i].vals[initMorphIndexMap[morphPair.first]] = val;
+                size_t end = std::min(start + indicesPerThread, indices.size());
+                futures.emplace_back(threadPool_.enqueue([&, start, end]() {
+                    for (size_t k = start; k < end; ++k)
+                    {
+                        int i = indices[k];
+                        float val = generator.sample(stream, i);
+                        cells1[i].vals[morphIndex] = val;
+                        cells2[i].vals[morphIndex] = val;
+                    }
+                    }));
             }
+
+            for (auto& task : futures)
+                task.wait();
         }
     }
 }
@@ -339,6 +477,9 @@ bool Simulation::updateParams(Parameters params)
 
     // update thread work
     computeThreadWork();
+    requestFullSweep();
+    convergence.reset();
+    health.reset();
 
     return anyNewParamCreated;
 }
@@ -378,6 +519,12 @@ void Simulation::computeThreadWork()
         threadWork_.push_back(threadWorks);
     }
 
+    // The active set keeps each work item's parameters, only its indices are refiltered every step
+    activeWork_.assign(threadWork_.size(), {});
+    for (size_t threadID = 0; threadID < threadWork_.size(); ++threadID)
+        for (const ThreadWork& work : threadWork_[threadID])
+            activeWork_[threadID].emplace_back(std::get<0>(work), std::vector<unsigned>());
+
 #ifdef DEBUG
     ASSERT(threadWork_.size() == threadPool_.getNumThreads(), "Invalid number of thread work array elements");
     std::set<unsigned> indices;
@@ -399,6 +546,220 @@ void Simulation::computeThreadWork()
 #endif
 }
 
+void Simulation::requestFullSweep()
+{
+    fullSweepRequested_ = true;
+}
+
+float Simulation::activeFraction() const
+{
+    return activeFraction_;
+}
+
+void Simulation::beginActiveStep()
+{
+    if (!activeSetInfo.enabled)
+        return;
+
+    const size_t cellCount = domain->getCellCount();
+    bool fullSweep = fullSweepRequested_ || activeCells_.size() != cellCount;
+    if (activeSetInfo.sweepInterval > 0 && stepCount % activeSetInfo.sweepInterval == 0)
+        fullSweep = true;
+
+    if (activeCells_.size() != cellCount)
+    {
+        steppedCells_.assign(cellCount, 1);
+        changedCells_.assign(cellCount, 0);
+        lastChanges_.assign(cellCount, 0.f);
+        drifts_.assign(cellCount, 0.f);
+    }
+
+    if (fullSweep)
+        activeCells_.assign(cellCount, 1);
+
+    fullSweepRequested_ = false;
+    activeCount_ = 0;
+}
+
+// Filters a thread's cells down to the active ones. A quiescent cell still has to carry its
+// value into the write buffer, but only on the first step it sits out, after that both agree.
+Simulation::ThreadWorks& Simulation::activeThreadWork(size_t threadID, const std::vector<Cell>& readFrom, std::vector<Cell>& writeTo)
+{
+    if (!activeSetInfo.enabled)
+        return threadWork_[threadID];
+
+    ThreadWorks& active = activeWork_[threadID];
+    size_t count = 0;
+    for (size_t w = 0; w < threadWork_[threadID].size(); ++w)
+    {
+        const ThreadWork& work = threadWork_[threadID][w];
+        std::vector<unsigned>& indices = std::get<1>(active[w]);
+        indices.clear();
+
+        for (unsigned i : std::get<1>(work))
+        {
+            if (activeCells_[i])
+                indices.push_back(i);
+            else if (steppedCells_[i])
+                writeTo[i].vals = readFrom[i].vals;
+
+            steppedCells_[i] = activeCells_[i];
+            changedCells_[i] = 0;
+        }
+        count += indices.size();
+    }
+
+    activeCount_ += count;
+    return active;
+}
+
+void Simulation::recordChanges(const ThreadWorks& threadWork, const std::vector<Cell>& readFrom, const std::vector<Cell>& writeTo)
+{
+    if (!activeSetInfo.enabled)
+        return;
+
+    const float tolerance = activeSetInfo.tolerance;
+    for (auto& work : threadWork)
+    {
+        for (unsigned i : std::get<1>(work))
+        {
+            const float* before = readFrom[i].vals.data();
+            const float* after = writeTo[i].vals.data();
+            float change = 0.f;
+            for (int m = 0; m < MORPH_COUNT; ++m)
+                change = std::max(change, std::abs(after[m] - before[m]));
+
+            // NaN compares false, so it keeps the cell and its neighbours active
+            changedCells_[i] = !(change <= tolerance);
+            lastChanges_[i] = change;
+            drifts_[i] = 0.f;
+        }
+    }
+}
+
+// Next step's active set is every cell whose stencil touches a cell that changed
+void Simulation::endActiveStep()
+{
+    if (!activeSetInfo.enabled)
+    {
+        activeFraction_ = 1.f;
+        return;
+    }
+
+    const size_t cellCount = changedCells_.size();
+    activeFraction_ = cellCount > 0 ? static_cast<float>(activeCount_) / static_cast<float>(cellCount) : 1.f;
+
+    std::vector<unsigned> seeds;
+    for (unsigned i = 0; i < cellCount; ++i)
+        if (changedCells_[i])
+            seeds.push_back(i);
+
+    activeCells_.assign(cellCount, 0);
+    if (!seeds.empty())
+        domain->markNeighbours(seeds, 1, activeCells_);
+
+    // A skipped cell still drifts by about its last change every step, it is stepped
+    // again once that adds up to more than the tolerance
+    for (unsigned i = 0; i < cellCount; ++i)
+    {
+        if (steppedCells_[i])
+            continue;
+        drifts_[i] += lastChanges_[i];
+        if (!(drifts_[i] <= activeSetInfo.tolerance))
+            activeCells_[i] = 1;
+    }
+}
+
+void Simulation::measureStep(size_t threadID, const std::vector<Cell>& readFrom, const std::vector<Cell>& writeTo)
+{
+    if (!fieldStats.gathering())
+        return;
+
+    // Every cell the thread owns, quiescent ones included so the extremes cover the whole domain
+    for (auto& work : threadWork_[threadID])
+        fieldStats.accumulate(threadID, std::get<1>(work), readFrom, writeTo, *domain);
+}
+
+// Separate pass for models that don't measure inside their own tasks
+void Simulation::measureStep()
+{
+    const std::vector<Cell>& readFrom = domain->getReadFromCells();
+    const std::vector<Cell>& writeTo = domain->getWriteToCells();
+
+    std::vector<std::future<void>> futures;
+    for (size_t threadID = 0; threadID < threadWork_.size(); ++threadID)
+    {
+        futures.emplace_back(threadPool_.enqueue([&, threadID]() {
+            measureStep(threadID, readFrom, writeTo);
+            }));
+    }
+
+    for (auto& task : futures)
+        task.wait();
+}
+
+// Scales the colour map to the shown morphogen's maximum
+void Simulation::autoNormalize()
+{
+    const std::vector<FieldStats::Morphogen>& morphogens = fieldStats.morphogens();
+    for (size_t i = 0; i < domain->showingMorph.size() && i < morphogens.size(); ++i)
+    {
+        if (domain->showingMorph[i])
+        {
+            if (std::isfinite(morphogens[i].max) && morphogens[i].max > 0.f)
+                domain->normCoef = morphogens[i].max;
+            break;
+        }
+    }
+}
+
+void Simulation::handleConvergence()
+{
+    LOG(convergence.report());
+    if (!convergence.finished())
+        return;
+
+    if (convergence.info.action == ConvergenceMonitor::Action::Checkpoint)
+    {
+        // The write buffer holds the step that was just measured
+        std::string checkpointName = std::filesystem::path(filename).stem().string() + "_" + std::to_string(stepCount + 1) + ".rdc";
+        if (writeCheckpoint(checkpointName, domain->getWriteToCells(), stepCount + 1))
+            LOG("Saved " << checkpointName);
+        else
+            LOG("Failed to save " << checkpointName);
+    }
+}
+
+void Simulation::recoverHealth()
+{
+    LOG(health.report());
+    if (!health.rollback(domain->getReadFromCells(), domain->getWriteToCells(), stepCount))
+    {
+        LOG("No healthy snapshot left to roll back to, pausing");
+        pause(true);
+        return;
+    }
+    LOG("Rolled back to step " << stepCount);
+
+    if (health.info.halveDt)
+    {
+        for (auto& p : paramsMap)
+        {
+            auto dt = p.params_.find("dt");
+            if (dt != p.params_.end())
+            {
+                dt->second *= .5f;
+                LOG("dt is now " << dt->second);
+            }
+        }
+        computeThreadWork();
+    }
+
+    requestFullSweep();
+    convergence.reset();
+    updateColorsFromRam = true;
+}
+
 void Simulation::updateGPU()
 {
     std::cout << " updating gpu" << std::endl;
@@ -440,6 +801,7 @@ bool Simulation::saveEditorSettings(const std::string& path)
     if (editorSettingsFile.is_open())
     {
         editorSettingsFile << "normCoef: " << domain->normCoef << "\n";
+        editorSettingsFile << "autoNormalize: " << domain->autoNormalize << "\n";
 
         int visibleMorph = -1;
         for (size_t i = 0; i < domain->showingMorph.size(); ++i)
@@ -457,7 +819,7 @@ bool Simulation::saveEditorSettings(const std::string& path)
 
 bool Simulation::recording() const
 {
-    return outputScreens || outputTextures || outputPlys;
+    return outputScreens || outputTextures || outputPlys || outputSeries;
 }
 
 bool Simulation::saveConcentrations(const std::string& path, const std::string& fileName)
@@ -503,6 +865,9 @@ bool Simulation::saveConcentrations(const std::string& path, const std::string&
 bool Simulation::loadSim(const std::string& fileName)
 {
     this->initalFilename = fileName;
+    if (Checkpoint::isCheckpoint(fileName))
+        return loadCheckpoint(fileName);
+
     std::ifstream file(fileName);
     if (file.is_open())
     {
@@ -564,29 +929,350 @@ bool Simulation::loadSim(const std::string& fileName)
         }
         file.close();
 
-        domain->destroyVBOs();
-        domain->initVBOs();
-        domain->recalculateParameters();
+        stateLoaded();
+        return true;
+    }
+    else
+        return false;
+}
 
-        if (isGPUEnabled)
+// Refreshes everything derived from the cells after they were replaced by a load
+void Simulation::stateLoaded()
+{
+    domain->destroyVBOs();
+    domain->initVBOs();
+    domain->recalculateParameters();
+    requestFullSweep();
+    convergence.reset();
+    health.reset();
+
+    if (isGPUEnabled)
+    {
+        for (unsigned i = 0; i < domain->getCellCount(); ++i)
+        {
+            domain->dirtyAttributes[domain->CELL1_ATTRIB].indices.insert(i);
+            domain->dirtyAttributes[domain->CELL2_ATTRIB].indices.insert(i);
+        }
+
+        for(unsigned i = 0; i < domain->tangents.size(); ++i)
+            domain->dirtyAttributes[domain->TANGENT_ATTRIB].indices.insert(i);
+
+        updateGPU();
+        domain->update();
+        updateColorsFromRam = true;
+    }
+}
+
+namespace
+{
+    template<typename T>
+    void appendValue(std::vector<char>& bytes, const T& value)
+    {
+        const char* p = reinterpret_cast<const char*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    // Bounds checked reads from a mapped section, a short section makes every later read fail
+    struct SectionReader
+    {
+        const char* data;
+        size_t size;
+        size_t offset = 0;
+
+        template<typename T>
+        bool read(T& value)
+        {
+            if (size - offset < sizeof(T))
+                return false;
+            std::memcpy(&value, data + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+
+        bool read(std::string& value, size_t length)
+        {
+            if (size - offset < length)
+                return false;
+            value.assign(data + offset, length);
+            offset += length;
+            return true;
+        }
+    };
+}
+
+bool Simulation::saveCheckpoint(const std::string& path, const std::string& fileName)
+{
+    if (isGPUEnabled)
+        updateRAM();
+    return writeCheckpoint(path + fileName, domain->getReadFromCells(), stepCount);
+}
+
+// Packs the state into flat arrays and hands them to Checkpoint in one go,
+// cells is the buffer holding the state of step
+bool Simulation::writeCheckpoint(const std::string& fileName, const std::vector<Cell>& cells, int step)
+{
+    const size_t morphCount = MORPH_COUNT;
+    const size_t tangentCount = domain->tangents.empty() ? 0 : domain->tangents[0].size();
+
+    Checkpoint::State state;
+    state.cellCount = cells.size();
+    state.tangentCount = tangentCount;
+    state.morphCount = static_cast<uint32_t>(morphCount);
+    state.stepCount = step;
+    state.growthCount = growthCounter.getCount();
+    state.rngSeed = rngSeed;
+
+    std::vector<float> morphogens(cells.size() * morphCount);
+    for (size_t i = 0; i < cells.size(); ++i)
+        std::copy_n(cells[i].vals.begin(), morphCount, morphogens.begin() + i * morphCount);
+
+    std::vector<float> tangents;
+    std::vector<float> tensors;
+    tangents.reserve(morphCount * tangentCount * 3);
+    tensors.reserve(morphCount * tangentCount * 2);
+    for (size_t j = 0; j < morphCount && j < domain->tangents.size(); ++j)
+    {
+        for (size_t i = 0; i < tangentCount; ++i)
+        {
+            const Vec3& t = domain->tangents[j][i];
+            tangents.insert(tangents.end(), { t.x, t.y, t.z });
+            tensors.push_back(domain->diffusionTensors[j].t0_[i]);
+            tensors.push_back(domain->diffusionTensors[j].t1_[i]);
+        }
+    }
+
+    // Regions: count, then per region its parameters by name and its cell indices
+    std::vector<char> params;
+    appendValue(params, static_cast<uint32_t>(paramsMap.size()));
+    for (auto& pair : paramsMap)
+    {
+        appendValue(params, static_cast<uint32_t>(pair.params_.size()));
+        for (auto& param : pair.params_)
+        {
+            appendValue(params, static_cast<uint32_t>(param.first.size()));
+            params.insert(params.end(), param.first.begin(), param.first.end());
+            appendValue(params, param.second);
+        }
+        appendValue(params, static_cast<uint32_t>(pair.indices_.size()));
+        for (unsigned i : pair.indices_)
+            appendValue(params, static_cast<uint32_t>(i));
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.add(Checkpoint::Section::State, &state, sizeof(state));
+    checkpoint.add(Checkpoint::Section::Morphogens, morphogens.data(), morphogens.size() * sizeof(float));
+    checkpoint.add(Checkpoint::Section::Tangents, tangents.data(), tangents.size() * sizeof(float));
+    checkpoint.add(Checkpoint::Section::Tensors, tensors.data(), tensors.size() * sizeof(float));
+    checkpoint.add(Checkpoint::Section::Params, params.data(), params.size());
+    if (domain->isDomainType(SimulationDomain::DomainType::MESH))
+    {
+        static_assert(sizeof(Vec3) == 3 * sizeof(float), "positions are written as packed floats");
+        checkpoint.add(Checkpoint::Section::Positions, domain->positions_.data(), domain->positions_.size() * sizeof(Vec3));
+        checkpoint.add(Checkpoint::Section::Indices, domain->indices_.data(), domain->indices_.size() * sizeof(unsigned));
+        if (domain->textureCoords_.size() == domain->positions_.size())
+        {
+            static_assert(sizeof(Vec2) == 2 * sizeof(float), "texture coordinates are written as packed floats");
+            checkpoint.add(Checkpoint::Section::TextureCoords, domain->textureCoords_.data(), domain->textureCoords_.size() * sizeof(Vec2));
+        }
+    }
+
+    if (!checkpoint.write(fileName))
+    {
+        LOG(checkpoint.error());
+        return false;
+    }
+    return true;
+}
+
+bool Simulation::loadCheckpoint(const std::string& fileName)
+{
+    Checkpoint checkpoint;
+    if (!checkpoint.open(fileName))
+    {
+        LOG(checkpoint.error());
+        return false;
+    }
+
+    Checkpoint::State state;
+    if (checkpoint.size(Checkpoint::Section::State) != sizeof(state))
+    {
+        LOG(fileName << " has no state section");
+        return false;
+    }
+    std::memcpy(&state, checkpoint.data(Checkpoint::Section::State), sizeof(state));
+
+    const size_t morphCount = state.morphCount;
+    const size_t tangentCount = state.tangentCount;
+    if (morphCount != static_cast<size_t>(MORPH_COUNT))
+    {
+        LOG(fileName << " holds " << morphCount << " morphogens, the simulation has " << MORPH_COUNT);
+        return false;
+    }
+    if (checkpoint.size(Checkpoint::Section::Morphogens) != state.cellCount * morphCount * sizeof(float) ||
+        checkpoint.size(Checkpoint::Section::Tangents) != morphCount * tangentCount * 3 * sizeof(float) ||
+        checkpoint.size(Checkpoint::Section::Tensors) != morphCount * tangentCount * 2 * sizeof(float))
+    {
+        LOG(fileName << " has sections of the wrong size");
+        return false;
+    }
+
+    // Parse the regions before touching any state so a bad section leaves the simulation as it was
+    std::vector<ParamIndexPair> regions;
+    if (checkpoint.has(Checkpoint::Section::Params))
+    {
+        SectionReader reader{ static_cast<const char*>(checkpoint.data(Checkpoint::Section::Params)), checkpoint.size(Checkpoint::Section::Params) };
+        uint32_t regionCount = 0;
+        bool ok = reader.read(regionCount);
+        for (uint32_t r = 0; ok && r < regionCount; ++r)
         {
-            for (unsigned i = 0; i < domain->getCellCount(); ++i)
+            ParamIndexPair region;
+            uint32_t paramCount = 0, indexCount = 0;
+            ok = reader.read(paramCount);
+            for (uint32_t p = 0; ok && p < paramCount; ++p)
+            {
+                uint32_t length = 0;
+                std::string name;
+                float value = 0.f;
+                ok = reader.read(length) && reader.read(name, length) && reader.read(value);
+                region.params_[name] = value;
+            }
+            ok = ok && reader.read(indexCount);
+            for (uint32_t k = 0; ok && k < indexCount; ++k)
             {
-                domain->dirtyAttributes[domain->CELL1_ATTRIB].indices.insert(i);
-                domain->dirtyAttributes[domain->CELL2_ATTRIB].indices.insert(i);
+                uint32_t index = 0;
+                ok = reader.read(index) && index < state.cellCount;
+                region.indices_.insert(region.indices_.end(), index);
             }
+            regions.push_back(std::move(region));
+        }
+        if (!ok || regions.empty())
+        {
+            LOG(fileName << " has a malformed parameter section");
+            return false;
+        }
+    }
 
-            for(unsigned i = 0; i < domain->tangents.size(); ++i)
-                domain->dirtyAttributes[domain->TANGENT_ATTRIB].indices.insert(i);
+    // A grown mesh is rebuilt from the saved topology before its cells are filled in. Coarsening
+    // can reconnect cells without changing any count so the indices are compared by content
+    const size_t indicesSize = checkpoint.size(Checkpoint::Section::Indices);
+    bool topologyChanged = state.cellCount != domain->getCellCount() ||
+        (checkpoint.has(Checkpoint::Section::Indices) && (indicesSize != domain->indices_.size() * sizeof(unsigned) ||
+            Checkpoint::checksum(checkpoint.data(Checkpoint::Section::Indices), indicesSize) != Checkpoint::checksum(domain->indices_.data(), indicesSize)));
+    if (topologyChanged && !restoreTopology(checkpoint, state.cellCount))
+    {
+        LOG(fileName << " holds " << state.cellCount << " cells, the domain has " << domain->getCellCount());
+        return false;
+    }
+
+    // Growth moves the vertices every tick, the saved ones replace them along with what depends on them
+    HalfEdgeMesh* meshDomain = dynamic_cast<HalfEdgeMesh*>(domain);
+    if (!topologyChanged && meshDomain != nullptr && checkpoint.size(Checkpoint::Section::Positions) == state.cellCount * 3 * sizeof(float))
+        meshDomain->restorePositions(static_cast<const float*>(checkpoint.data(Checkpoint::Section::Positions)));
+    const size_t currentTangents = domain->tangents.empty() ? 0 : domain->tangents[0].size();
+    if (state.cellCount != domain->getCellCount() || tangentCount != currentTangents)
+    {
+        LOG(fileName << " holds " << state.cellCount << " cells and " << tangentCount << " tangents, the domain has " 
+            << domain->getCellCount() << " and " << currentTangents);
+        return false;
+    }
+
+    // Sections are read straight out of the mapping
+    std::vector<Cell>& writeToCells = domain->getWriteToCells();
+    std::vector<Cell>& readFromCells = domain->getReadFromCells();
+    const float* morphogens = static_cast<const float*>(checkpoint.data(Checkpoint::Section::Morphogens));
+    for (size_t i = 0; i < state.cellCount; ++i)
+    {
+        std::copy_n(morphogens + i * morphCount, morphCount, readFromCells[i].vals.begin());
+        std::copy_n(morphogens + i * morphCount, morphCount, writeToCells[i].vals.begin());
+    }
 
-            updateGPU();
-            domain->update();
-            updateColorsFromRam = true;
+    const float* tangents = static_cast<const float*>(checkpoint.data(Checkpoint::Section::Tangents));
+    const float* tensors = static_cast<const float*>(checkpoint.data(Checkpoint::Section::Tensors));
+    for (size_t j = 0; j < morphCount; ++j)
+    {
+        for (size_t i = 0; i < tangentCount; ++i, tangents += 3, tensors += 2)
+        {
+            domain->tangents[j][i].set(tangents[0], tangents[1], tangents[2]);
+            domain->diffusionTensors[j].t0_[i] = tensors[0];
+            domain->diffusionTensors[j].t1_[i] = tensors[1];
         }
-        return true;
     }
-    else
+
+    if (!regions.empty())
+    {
+        paramsMap = std::move(regions);
+        computeThreadWork();
+    }
+    stepCount = state.stepCount;
+    growthCounter.setCount(state.growthCount);
+    rngSeed = state.rngSeed;
+
+    stateLoaded();
+    return true;
+}
+
+// Replaces a mesh domain's topology with the one saved in checkpoint, returns false for other domains
+bool Simulation::restoreTopology(const Checkpoint& checkpoint, size_t cellCount)
+{
+    HalfEdgeMesh* meshDomain = dynamic_cast<HalfEdgeMesh*>(domain);
+    const size_t positionsSize = checkpoint.size(Checkpoint::Section::Positions);
+    const size_t indicesSize = checkpoint.size(Checkpoint::Section::Indices);
+    if (meshDomain == nullptr || positionsSize != cellCount * 3 * sizeof(float) || indicesSize == 0 || indicesSize % (3 * sizeof(unsigned)) != 0)
         return false;
+
+    Mesh mesh;
+    const float* positions = static_cast<const float*>(checkpoint.data(Checkpoint::Section::Positions));
+    mesh.positions_.reserve(cellCount);
+    for (size_t i = 0; i < cellCount; ++i, positions += 3)
+        mesh.positions_.emplace_back(positions[0], positions[1], positions[2]);
+
+    const unsigned* indices = static_cast<const unsigned*>(checkpoint.data(Checkpoint::Section::Indices));
+    mesh.indices_.assign(indices, indices + indicesSize / sizeof(unsigned));
+    for (unsigned index : mesh.indices_)
+        if (index >= cellCount)
+            return false;
+
+    mesh.normals_.resize(cellCount, Vec3(0.f, 1.f, 0.f));
+    mesh.textureCoords_.resize(cellCount, Vec2(0.f, 0.f));
+    if (checkpoint.size(Checkpoint::Section::TextureCoords) == cellCount * 2 * sizeof(float))
+    {
+        const float* textureCoords = static_cast<const float*>(checkpoint.data(Checkpoint::Section::TextureCoords));
+        for (size_t i = 0; i < cellCount; ++i, textureCoords += 2)
+            mesh.textureCoords_[i].set(textureCoords[0], textureCoords[1]);
+    }
+
+    // init adds a gradient line per face on top of whatever is there
+    domain->gradientLines.clearBuffers();
+    meshDomain->init(mesh);
+    domain->init(MORPH_COUNT);
+    domain->gradientLines.destroyVBOs();
+    domain->gradientLines.initVBOs();
+    lap.resize(domain->getCellCount() * MORPH_COUNT);
+    setBoundaryConditions(boundaryConditions_, morphIndexMap);
+    topologyKeyDirty_ = true;
+    return domain->getCellCount() == cellCount;
+}
+
+std::string Simulation::autoCheckpointName() const
+{
+    if (!autoCheckpointInfo.fileName.empty())
+        return autoCheckpointInfo.fileName;
+    return std::filesystem::path(filename).stem().string() + ".rdc";
+}
+
+// Skipped while a growth pass is still spread over steps, so the saved topology is always complete
+void Simulation::autoCheckpoint()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool due = autoCheckpointInfo.interval > 0 && stepCount % autoCheckpointInfo.interval == 0;
+    if (autoCheckpointInfo.seconds > 0.f && std::chrono::duration<float>(now - lastCheckpoint_).count() >= autoCheckpointInfo.seconds)
+        due = true;
+    if (!due || domain->growthPending())
+        return;
+
+    lastCheckpoint_ = now;
+    if (!saveCheckpoint("", autoCheckpointName()))
+        LOG("Failed to save checkpoint " << autoCheckpointName());
 }
 
 void Simulation::shouldReloadSim(bool value)
@@ -631,19 +1317,46 @@ bool Simulation::reloadSim()
         updateGPU();
     }
     stepCount = 0;
+    requestFullSweep();
+    convergence.reset();
+    health.reset();
     return true;
 }
 
 bool Simulation::reloadPDEs()
 {
     doReloadPDEs();
+    requestFullSweep();
+    convergence.reset();
+    health.reset();
     return true;
 }
 
 std::vector<int> Simulation::parseIndices(std::string indicesStr, int radius)
 {
-    std::set<int> indicesSet;
-    auto parseHyphen = [&](std::string& indicesStr, int radius, std::set<int>& indices)
+    // Entries are marked in a per cell mask, ranges and random picks are also
+    // collected as seeds and grown by radius in one pass at the end
+    const unsigned cellCount = domain->getCellCount();
+    std::vector<char> selected(cellCount, 0);
+    std::vector<unsigned> seeds;
+
+    auto select = [&](int i)
+    {
+        if (i >= 0 && static_cast<unsigned>(i) < cellCount)
+            selected[i] = 1;
+    };
+
+    auto addSeed = [&](int i)
+    {
+        if (i < 0 || static_cast<unsigned>(i) >= cellCount)
+            return;
+
+        selected[i] = 1;
+        if (radius > 0)
+            seeds.push_back(i);
+    };
+
+    auto parseHyphen = [&](std::string& indicesStr)
     {
         size_t pos;
         if ((pos = static_cast<int>(indicesStr.find("-"))) != std::string::npos)
@@ -652,18 +1365,11 @@ std::vector<int> Simulation::parseIndices(std::string indicesStr, int radius)
             int end = std::atoi(indicesStr.substr(pos + 1, indicesStr.size() - pos - 1).c_str());
 
             for (int i = start; i <= end; ++i)
-            {
-                if (radius > 0)
-                {
-                    auto neighbours = domain->getNeighbours(i, radius);
-                    indices.insert(neighbours.begin(), neighbours.end());
-                }
-                indices.insert(i);
-            }
+                addSeed(i);
         }
     };
 
-    auto parseRand = [&](std::string& indicesStr, int radius, std::set<int>& indices)
+    auto parseRand = [&](std::string& indicesStr)
     {
         size_t pos;
         if ((pos = indicesStr.find("rand(")) != std::string::npos)
@@ -682,29 +1388,20 @@ std::vector<int> Simulation::parseIndices(std::string indicesStr, int radius)
             std::uniform_int_distribution<> dist(0, domain->getCellCount() - 1);
 
             for (int i = 0; i < count; ++i)
-            {
-                int j = dist(gen);
-                if (radius > 0)
-                {
-                    auto neighbours = domain->getNeighbours(j, radius);
-                    indices.insert(neighbours.begin(), neighbours.end());
-                }
-                indices.insert(j);
-            }
+                addSeed(dist(gen));
         }
     };
 
-    auto parseAll = [&](std::set<int>& indices)
+    auto parseAll = [&]()
     {
-        for (unsigned i = 0; i < domain->getCellCount(); ++i)
-            indices.insert(i);
+        std::fill(selected.begin(), selected.end(), 1);
     };
 
-    auto parseBoundary = [&](std::set<int>& indices)
+    auto parseBoundary = [&]()
     {
         auto boundary = domain->getBoundaryCellsIndices();
         for (auto i : boundary)
-            indices.insert(i);
+            select(i);
     };
 
     auto parsedIndices = Utils::split(indicesStr, ",");
@@ -713,26 +1410,33 @@ std::vector<int> Simulation::parseIndices(std::string indicesStr, int radius)
         size_t pos;
         entry = Utils::trim(entry);
         if ((pos = entry.find("-")) != std::string::npos)
-            parseHyphen(entry, radius, indicesSet);
+            parseHyphen(entry);
         else if ((pos = entry.find("rand(")) != std::string::npos)
-            parseRand(entry, radius, indicesSet);
+            parseRand(entry);
         else if ((pos = entry.find("all")) != std::string::npos)
-            parseAll(indicesSet);
+            parseAll();
         else if ((pos = entry.find("boundary")) != std::string::npos)
-            parseBoundary(indicesSet);
+            parseBoundary();
         else
-            indicesSet.insert(std::atoi(entry.c_str()));
+            select(std::atoi(entry.c_str()));
     }
 
-    std::vector<int> indices(indicesSet.begin(), indicesSet.end());
+    if (!seeds.empty())
+        domain->markNeighbours(seeds, radius, selected);
+
+    std::vector<int> indices;
+    for (unsigned i = 0; i < cellCount; ++i)
+        if (selected[i])
+            indices.push_back(i);
     return indices;
 }
 
-float Simulation::parseVal(std::string valStr, std::mt19937& gen)
+// Parses "a", "rand(lo, hi)" or a sum of two of them
+Simulation::ValueGenerator Simulation::compileVal(const std::string& valStr)
 {
+    ValueGenerator generator;
     std::vector<std::string> terms;
     size_t pos;
-    float result = 0.f;
     if ((pos = valStr.find("+")) != std::string::npos)
     {
         std::string substring = valStr.substr(0, pos);
@@ -758,16 +1462,39 @@ float Simulation::parseVal(std::string valStr, std::mt19937& gen)
             {
                 float lower = static_cast<float>(std::atof(term.substr(0, commaPos).c_str()));
                 float upper = static_cast<float>(std::atof(term.substr(commaPos + 1, term.size() - commaPos).c_str()));
-                std::uniform_real_distribution<float> dist(lower, upper);
-                result += dist(gen);
+                generator.randRanges.emplace_back(lower, upper);
             }
         }
         else
         {
-            result += static_cast<float>(std::atof(term.c_str()));
+            generator.constant += static_cast<float>(std::atof(term.c_str()));
         }
     }
 
+    return generator;
+}
+
+// Counter based sampling, a cell's value only depends on the stream and the cell index
+// so it does not matter which thread fills it or in which order
+float Simulation::ValueGenerator::sample(uint64_t stream, uint64_t cell) const
+{
+    auto mix = [](uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    };
+
+    float result = constant;
+    for (size_t term = 0; term < randRanges.size(); ++term)
+    {
+        uint64_t bits = mix(mix(stream * 0x9e3779b97f4a7c15ull + term) ^ cell);
+        float u = static_cast<float>(bits >> 40) / 16777216.f; // top 24 bits in [0, 1)
+        result += randRanges[term].first + (randRanges[term].second - randRanges[term].first) * u;
+    }
     return result;
 }
 
@@ -938,6 +1665,7 @@ void CustomReactionDiffusion::doSimulate()
     size_t start = 0;
     size_t end = 0;
 
+    beginActiveStep();
     for (size_t threadID = 0; threadID < threadPool_.getNumThreads(); ++threadID)
     {
         start = threadID * indicesPerThread;
@@ -946,7 +1674,7 @@ void CustomReactionDiffusion::doSimulate()
         size_t numSteps = stepCount;
 
         futures.emplace_back(threadPool_.enqueue([&, start, end, numMorphs, numSteps, threadID]() {
-            ThreadWorks& threadWork = threadWork_[threadID];
+            ThreadWorks& threadWork = activeThreadWork(threadID, readFromVec, writeToVec);
             for (auto& workTuple : threadWork)
             {
                 // Compute laplacian
@@ -956,12 +1684,15 @@ void CustomReactionDiffusion::doSimulate()
 
             // Compute PDEs
             customSimFunc(readFromVec, writeToVec, lap, threadWork, numMorphs, numSteps);
+            recordChanges(threadWork, readFromVec, writeToVec);
+            measureStep(threadID, readFromVec, writeToVec);
 
             }));
     }
 
     for (auto& task : futures)
         task.wait();
+    endActiveStep();
 }
 
 //================================================================================
@@ -1074,6 +1805,18 @@ void StochasticCustomReactionDiffusion::doReloadPDEs()
 	customSimFunc = dynamicLibLoader.loadFunc<Simulate>("simulate");
 }
 
+// Seeds follow the run's seed, the step and the thread, so a run resumed from a checkpoint draws the same noise
+static unsigned int noiseSeed(uint64_t rngSeed, size_t stepCount, size_t threadID, uint64_t pass)
+{
+	uint64_t x = rngSeed ^ (stepCount * 0x9e3779b97f4a7c15ull) ^ (threadID << 48) ^ (pass << 56);
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return static_cast<unsigned int>(x);
+}
+
 void StochasticCustomReactionDiffusion::doSimulate()
 {
 	const size_t CELL_COUNT = static_cast<int>(domain->getCellCount());
@@ -1092,12 +1835,8 @@ void StochasticCustomReactionDiffusion::doSimulate()
 		end = std::min(start + indicesPerThread, CELL_COUNT);
 
 		futures.emplace_back(threadPool_.enqueue([&, start, end, threadID]() {
-			// thread_local necessary?
-			thread_local std::random_device randomDevice;
-			thread_local std::mt19937 randomGen(randomDevice());
-			thread_local std::uniform_int_distribution<unsigned int> uIntRan;
-			seed_nran(uIntRan(randomDevice));
-			//thread_local NormalDist normalRandom(uIntRan(randomDevice));
+			seed_nran(noiseSeed(rngSeed, stepCount, threadID, 0));
+			//thread_local NormalDist normalRandom(noiseSeed(rngSeed, stepCount, threadID, 0));
 			for (size_t i = start; i < end; ++i)
 			{
 				// generate N(0,1) for each half edge, but this should be changed to compute mass flow rate...
@@ -1128,13 +1867,11 @@ void StochasticCustomReactionDiffusion::doSimulate()
 			}
 
 			// Compute PDEs
-			thread_local std::random_device randomDevice;
-			thread_local std::mt19937 randomGen(randomDevice());
-			thread_local std::uniform_int_distribution<unsigned int> uIntRan;
-			//thread_local NormalDist normalRandom(uIntRan(randomDevice));
-			seed_nran(uIntRan(randomDevice));
+			//thread_local NormalDist normalRandom(noiseSeed(rngSeed, stepCount, threadID, 1));
+			seed_nran(noiseSeed(rngSeed, stepCount, threadID, 1));
 			//customSimFunc(readFromVec, writeToVec, lap, lap_noise, threadWork, numMorphs, numSteps, normalRandom);
 			customSimFunc(readFromVec, writeToVec, lap, lap_noise, threadWork, numMorphs, numSteps, nran);
+			measureStep(threadID, readFromVec, writeToVec);
 		}));
 	}
 
@@ -1,8 +1,14 @@
 #pragma once
 #include "SimulationDomain.h"
+#include "FieldStats.h"
+#include "ConvergenceMonitor.h"
+#include "HealthMonitor.h"
 #include "Counter.h"
 #include "ThreadPool.h"
+#include "TimeSeries.h"
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <random>
 
@@ -37,7 +43,37 @@ struct ParamIndexPair
     Parameters params_;
 };
 
+// Optional scheduling that only steps cells whose neighbourhood changed in the previous step
+struct ActiveSetInfo
+{
+    float tolerance = 1e-6f;  // a cell whose morphogens all change less than this per step is quiescent
+    int sweepInterval = 100;  // steps between full sweeps that step every cell, 0 never forces one
+    bool enabled = false;
+};
+
+// Periodic checkpoints a long run can be resumed from, off while both intervals are 0
+struct AutoCheckpointInfo
+{
+    int interval = 0;       // steps between checkpoints
+    float seconds = 0.f;    // wall clock seconds between checkpoints
+    std::string fileName;   // overwritten each time, <config name>.rdc when empty
+};
+
+// How recorded frames are handed to the background writers, see ExportPipeline
+struct ExportInfo
+{
+    enum class Backpressure { Block, Drop, Degrade };
+
+    int writers = 2;        // threads rasterizing, encoding and writing frames
+    int queueSize = 4;      // frames waiting for a writer before backpressure applies
+    Backpressure backpressure = Backpressure::Block;
+    bool binaryPly = false;     // recorded and saved plys are binary instead of ascii
+    int textureDilation = 10;   // texels of background around a mesh's texture islands given the surface's colour, hides seams
+    TimeSeries::Info series;    // encoding of the recorded series, see TimeSeries
+};
+
 class GUI;
+class Checkpoint;
 class Simulation
 {
 public:
@@ -93,13 +129,17 @@ public:
     virtual void initSim();
     virtual void updateColors();
     virtual void growAndSubdivide();
+    void continueGrowth();
     virtual void updateDiffusionCoefs();
 
     //bool saveSim(const std::string& path, const std::string& fileName);
     bool saveConcentrations(const std::string& path, const std::string& fileName);
     bool saveEditorSettings(const std::string& path);
+    bool saveCheckpoint(const std::string& path, const std::string& fileName);
     bool recording() const;
     bool loadSim(const std::string& fileName);
+    bool loadCheckpoint(const std::string& fileName);
+    std::string autoCheckpointName() const;
     bool reloadSim();
     bool reloadPDEs();
 
@@ -121,6 +161,8 @@ public:
     void setGrowthTickLimit(unsigned long long growthTickLimit);
     unsigned long long getGrowthTickLimit() const;
     void computeThreadWork();
+    void requestFullSweep();
+    float activeFraction() const;
 
     SimulationDomain* domain;
     Counter growthCounter;
@@ -143,8 +185,16 @@ public:
     std::string rawRDModel;
     std::vector<Simulation::InitConditions> initConditions_;
     std::vector<Simulation::BoundaryConditions> boundaryConditions_;
-
-    bool createTextureOnExit = false, createModelOnExit = false, outputTextures = false, outputPlys = false, outputScreens = false;
+    ActiveSetInfo activeSetInfo;
+    AutoCheckpointInfo autoCheckpointInfo;
+    ExportInfo exportInfo;
+    FieldStats fieldStats;
+    int statsInterval = 10;         // steps between gathers for the Stats window and auto normalization
+    bool statsRequested = false;    // set while the Stats window is open
+    ConvergenceMonitor convergence;
+    HealthMonitor health;
+
+    bool createTextureOnExit = false, createModelOnExit = false, outputTextures = false, outputPlys = false, outputScreens = false, outputSeries = false;
     int pauseStepCount = 0;
     int exitStepCount = 0;
     int screenshotsPerSim = 0;
@@ -153,15 +203,32 @@ public:
     char videoPath[256] = ".";
     bool updateColorsFromRam = false;
     int stepCount = 0;
+    uint64_t rngSeed = 0;           // noise of step n on thread t is seeded from (rngSeed, n, t)
     bool shouldReloadSim_ = false;
     bool shouldReloadPDEs_ = false;
     ThreadPool threadPool_;
 
 protected:
+    // Initial value expression, a constant plus any number of uniform random terms
+    struct ValueGenerator
+    {
+        float constant = 0.f;
+        std::vector<std::pair<float, float>> randRanges;
+
+        float sample(uint64_t stream, uint64_t cell) const;
+    };
+
     std::vector<int> parseIndices(std::string indicesStr, int radius = 0);
-    float parseVal(std::string valStr, std::mt19937& mt);
+    ValueGenerator compileVal(const std::string& valStr);
 
     virtual void doSimulate() = 0;
+    void updateNewCells();
+    void snapshotGrownTopology();
+    uint64_t topologyKey();
+    bool writeCheckpoint(const std::string& fileName, const std::vector<Cell>& cells, int step);
+    bool restoreTopology(const Checkpoint& checkpoint, size_t cellCount);
+    void autoCheckpoint();
+    void stateLoaded();
 
     ParamIndexPair& getParamIndexPair(const Parameters& params, bool& newPairCreated);
 
@@ -172,6 +239,32 @@ protected:
     using ThreadWorks = std::vector<ThreadWork>;
     std::vector<ThreadWorks> threadWork_;
 
+    // Active set scheduling, a no-op unless activeSetInfo.enabled
+    void beginActiveStep();
+    ThreadWorks& activeThreadWork(size_t threadID, const std::vector<Cell>& readFrom, std::vector<Cell>& writeTo);
+    void recordChanges(const ThreadWorks& threadWork, const std::vector<Cell>& readFrom, const std::vector<Cell>& writeTo);
+    void endActiveStep();
+
+    // Field statistics for the monitors and the display, models fold measureStep into their step tasks where they can
+    void measureStep(size_t threadID, const std::vector<Cell>& readFrom, const std::vector<Cell>& writeTo);
+    void measureStep();
+    void autoNormalize();
+    void handleConvergence();
+    void recoverHealth();
+
+    std::vector<ThreadWorks> activeWork_;
+    std::vector<char> activeCells_;  // cells to step this step
+    std::vector<char> steppedCells_; // cells stepped in the previous step, their buffers may differ
+    std::vector<char> changedCells_; // cells that changed by more than the tolerance this step
+    std::vector<float> lastChanges_; // largest change of each cell the last time it was stepped
+    std::vector<float> drifts_;      // lastChanges_ summed over the steps a cell was skipped since
+    std::atomic<size_t> activeCount_{ 0 };
+    float activeFraction_ = 1.f;
+    bool fullSweepRequested_ = true;
+    uint64_t topologyKey_ = 0;      // checksum of the domain's indices and cell count, for the health snapshots
+    bool topologyKeyDirty_ = true;
+    std::chrono::steady_clock::time_point lastCheckpoint_ = std::chrono::steady_clock::now();
+
 private:
     bool gpuUpToDateFlag = false;
     bool ramUpToDateFlag = false;
@@ -192,6 +192,16 @@ void SimulationDomain::selectBoundary()
         selectedCells.erase(c);
 }
 
+void SimulationDomain::markNeighbours(const std::vector<unsigned>& seeds, unsigned order, std::vector<char>& marked)
+{
+    for (unsigned i : seeds)
+    {
+        marked[i] = 1;
+        for (unsigned j : getNeighbours(i, order))
+            marked[j] = 1;
+    }
+}
+
 void SimulationDomain::selectNeighbours()
 {
     std::set<unsigned int> newCells;
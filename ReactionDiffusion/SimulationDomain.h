@@ -25,6 +25,14 @@ struct PrepatternInfo
     bool squared = false;
 };
 
+struct AdaptivityInfo
+{
+    float refineError = 1.f;   // split faces whose solution changes more than this across them
+    float coarsenError = .1f;  // collapse edges whose surrounding faces all change less than this
+    float minFaceArea = 0.f;   // faces at or below this area are never split for error
+    bool enabled = false;
+};
+
 class SimulationDomain 
     : public Drawable
 {
@@ -100,6 +108,19 @@ public:
         }
     };
 
+    // What exportTexture reads, copied so the texture can be rasterized while the simulation goes on
+    struct TextureSnapshot
+    {
+        DomainType domainType = DomainType::NONE;
+        std::vector<float> values;            // shown value of every cell
+        ColorMap::LookupTable colorMap;       // outside colour map
+        float normCoef = 1.f;
+        int xRes = 0, yRes = 0;               // grid resolution
+        std::vector<unsigned> indices;        // mesh triangles, 3 cells each
+        std::vector<Vec2> textureCoords;      // 3 per mesh triangle
+        int dilation = 10;                    // texels around mesh triangles filled with the closest covered one
+    };
+
     SimulationDomain() = default;
     virtual ~SimulationDomain() = default;
 
@@ -110,7 +131,11 @@ public:
     virtual bool isBoundary(unsigned i) = 0;
     virtual std::set<unsigned> getBoundaryCellsIndices() = 0;
     virtual std::vector<unsigned> getNeighbours(unsigned i, unsigned order) = 0;
+    virtual std::vector<unsigned> getNeighboursByRadius(unsigned i, float radius) = 0; // cells within radius of i measured across the domain, i first
+    virtual void markNeighbours(const std::vector<unsigned>& seeds, unsigned order, std::vector<char>& marked); // seeds and cells within order rings of any seed
     virtual void growAndSubdivide(Vec3& growth, float maxFaceArea, bool subdivisionEnabled, size_t stepCount) = 0;
+    virtual bool continueGrowth(float) { return false; } // returns true while growth work remains
+    virtual bool growthPending() const { return false; }
     virtual Vec3 getPosition(unsigned i) const = 0;
     virtual Vec3 getNormal(unsigned i) const = 0;
     virtual void setDiffTensor(unsigned index, float t0, float t1, int morphIndex);
@@ -119,7 +144,8 @@ public:
     virtual void paint(int faceIndex, Vec3 p, float paintRadius) = 0;
     virtual int raycast(const Vec3& dir, const Vec3& origin, float& t0) const = 0;
     virtual void updateDiffusionCoefs() = 0;
-    virtual void exportTexture(unsigned char* pixels, int width, int height) = 0;
+    virtual void exportTexture(unsigned char* pixels, int width, int height, int dilation) = 0;
+    virtual void snapshotTexture(TextureSnapshot& snapshot) const = 0;
     virtual bool hideAnisoVec(int i) const = 0;
     virtual void updateGradLines() = 0;
     virtual void updateDiffDirLines() = 0;
@@ -190,7 +216,9 @@ public:
     float paintTensorVals[2] = { 1.f, 1.f };
     float maxM[2] = { 1.f, 1.f };
 
+    float growthTimeBudget = 0.f; // ms of growth work per step, 0 grows in one go
     float normCoef = 1.f;
+    bool autoNormalize = false;   // follow the shown morphogen's maximum
     float backgroundThreshold_ = 0.f;
     float backgroundOffset_ = 0.f;
     float vecLength = 0.05f;
@@ -210,6 +238,8 @@ public:
 
     PrepatternInfo prepatternInfo0{};
     PrepatternInfo prepatternInfo1{};
+    AdaptivityInfo adaptivityInfo{};
+    std::vector<int> cellRemap; // old to new cell index after cells are removed, -1 if removed
 
     enum MeshAttributeNames
     {
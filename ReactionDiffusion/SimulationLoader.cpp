@@ -11,6 +11,7 @@
 #include <iostream>
 #include <sstream>
 #include <tuple>
+#include <filesystem>
 
 
 std::string SimulationLoader::createModelSubroutine(const std::vector<std::string>& morphogens, std::string customModel, const std::string& domainstr, bool stochastic, bool veins, const Parameters& params)
@@ -207,6 +208,15 @@ bool SimulationLoader::loadSim(std::string filename, SimulationDomain*& d, Simul
     unsigned long long growthTickLimit = 0;
     long long pauseAt = 0, exitAt = 0;
     float maxFaceArea = 1.f;
+    float growthTimeBudget = 0.f;
+    float remeshEdgeLength = 0.f;
+    unsigned remeshIterations = 5;
+    AdaptivityInfo adaptivityInfo;
+    ActiveSetInfo activeSetInfo;
+    AutoCheckpointInfo autoCheckpointInfo;
+    ExportInfo exportInfo;
+    ConvergenceMonitor::Info convergenceInfo;
+    HealthMonitor::Info healthInfo;
 
     bool hasParams = false;
     bool hasInitialConditions = false;
@@ -366,6 +376,110 @@ bool SimulationLoader::loadSim(std::string filename, SimulationDomain*& d, Simul
         }
         else if (label == "growthMode")
             growthMode = Utils::sToLower(value);
+        else if (label == "growthTimeBudget")
+            growthTimeBudget = strtof(value.data(), nullptr);
+        else if (label == "remeshEdgeLength")
+            remeshEdgeLength = strtof(value.data(), nullptr);
+        else if (label == "remeshIterations")
+            remeshIterations = strtoul(value.data(), nullptr, 10);
+        else if (label == "adaptive")
+            adaptivityInfo.enabled = Utils::sToLower(value) == "true";
+        else if (label == "refineError")
+            adaptivityInfo.refineError = strtof(value.data(), nullptr);
+        else if (label == "coarsenError")
+            adaptivityInfo.coarsenError = strtof(value.data(), nullptr);
+        else if (label == "minFaceArea")
+            adaptivityInfo.minFaceArea = strtof(value.data(), nullptr);
+        else if (label == "activeSet")
+            activeSetInfo.enabled = Utils::sToLower(value) == "true";
+        else if (label == "activeSetTolerance")
+            activeSetInfo.tolerance = strtof(value.data(), nullptr);
+        else if (label == "activeSetSweepInterval")
+            activeSetInfo.sweepInterval = strtol(value.data(), nullptr, 10);
+        else if (label == "convergence")
+            convergenceInfo.enabled = Utils::sToLower(value) == "true";
+        else if (label == "convergenceInterval")
+            convergenceInfo.interval = strtol(value.data(), nullptr, 10);
+        else if (label == "convergenceAbsTolerance")
+            convergenceInfo.absTolerance = strtof(value.data(), nullptr);
+        else if (label == "convergenceRelTolerance")
+            convergenceInfo.relTolerance = strtof(value.data(), nullptr);
+        else if (label == "convergencePatience")
+            convergenceInfo.patience = strtol(value.data(), nullptr, 10);
+        else if (label == "convergenceHomogeneousTolerance")
+            convergenceInfo.homogeneousTolerance = strtof(value.data(), nullptr);
+        else if (label == "convergenceBlowUpLimit")
+            convergenceInfo.blowUpLimit = strtof(value.data(), nullptr);
+        else if (label == "convergenceAction")
+        {
+            std::string action = Utils::sToLower(value);
+            if (action == "report")
+                convergenceInfo.action = ConvergenceMonitor::Action::Report;
+            else if (action == "checkpoint")
+                convergenceInfo.action = ConvergenceMonitor::Action::Checkpoint;
+            else if (action == "stop")
+                convergenceInfo.action = ConvergenceMonitor::Action::Stop;
+            else
+                LOG("Unknown convergenceAction [" + value + "], using stop");
+        }
+        else if (label == "checkpointInterval")
+            autoCheckpointInfo.interval = strtol(value.data(), nullptr, 10);
+        else if (label == "checkpointSeconds")
+            autoCheckpointInfo.seconds = strtof(value.data(), nullptr);
+        else if (label == "checkpointFile")
+            autoCheckpointInfo.fileName = value;
+        else if (label == "exportWriters")
+            exportInfo.writers = strtol(value.data(), nullptr, 10);
+        else if (label == "exportQueueSize")
+            exportInfo.queueSize = strtol(value.data(), nullptr, 10);
+        else if (label == "exportBackpressure")
+        {
+            std::string backpressure = Utils::sToLower(value);
+            if (backpressure == "block")
+                exportInfo.backpressure = ExportInfo::Backpressure::Block;
+            else if (backpressure == "drop")
+                exportInfo.backpressure = ExportInfo::Backpressure::Drop;
+            else if (backpressure == "degrade")
+                exportInfo.backpressure = ExportInfo::Backpressure::Degrade;
+            else
+                LOG("Unknown exportBackpressure [" + value + "], using block");
+        }
+        else if (label == "exportBinaryPly")
+            exportInfo.binaryPly = Utils::sToLower(value) == "true";
+        else if (label == "textureDilation")
+            exportInfo.textureDilation = strtol(value.data(), nullptr, 10);
+        else if (label == "seriesEncoding")
+        {
+            std::string encoding = Utils::sToLower(value);
+            if (encoding == "raw")
+                exportInfo.series.encoding = TimeSeries::Encoding::Raw;
+            else if (encoding == "delta")
+                exportInfo.series.encoding = TimeSeries::Encoding::Delta;
+            else if (encoding == "quantized")
+                exportInfo.series.encoding = TimeSeries::Encoding::Quantized;
+            else
+                LOG("Unknown seriesEncoding [" + value + "], using delta");
+        }
+        else if (label == "seriesKeyInterval")
+            exportInfo.series.keyInterval = strtol(value.data(), nullptr, 10);
+        else if (label == "health")
+            healthInfo.enabled = Utils::sToLower(value) == "true";
+        else if (label == "healthInterval")
+            healthInfo.interval = strtol(value.data(), nullptr, 10);
+        else if (label == "healthMinValue")
+            healthInfo.minValue = strtof(value.data(), nullptr);
+        else if (label == "healthMaxValue")
+            healthInfo.maxValue = strtof(value.data(), nullptr);
+        else if (label == "healthMassTolerance")
+            healthInfo.massTolerance = strtof(value.data(), nullptr);
+        else if (label == "healthSnapshots")
+            healthInfo.snapshotCount = strtol(value.data(), nullptr, 10);
+        else if (label == "healthSnapshotInterval")
+            healthInfo.snapshotInterval = strtol(value.data(), nullptr, 10);
+        else if (label == "healthMaxRollbacks")
+            healthInfo.maxRollbacks = strtol(value.data(), nullptr, 10);
+        else if (label == "healthHalveDt")
+            healthInfo.halveDt = Utils::sToLower(value) == "true";
         else if (label == "pauseAt")
             pauseAt = strtol(value.data(), nullptr, 10);
         else if (label == "exitAt")
@@ -553,7 +667,7 @@ bool SimulationLoader::loadSim(std::string filename, SimulationDomain*& d, Simul
         }
     }
 
-    if (!parseDomain(domainStr, d, globalParamMap, colorMaps))
+    if (!parseDomain(domainStr, d, globalParamMap, colorMaps, remeshEdgeLength, remeshIterations))
     {
         std::cout << "Failed to load [" + domainStr + "]\n";
         return false;
@@ -573,6 +687,13 @@ bool SimulationLoader::loadSim(std::string filename, SimulationDomain*& d, Simul
 
     
     d->growing = growing;
+    d->growthTimeBudget = growthTimeBudget;
+    d->adaptivityInfo = adaptivityInfo;
+    s->activeSetInfo = activeSetInfo;
+    s->autoCheckpointInfo = autoCheckpointInfo;
+    s->exportInfo = exportInfo;
+    s->convergence.info = convergenceInfo;
+    s->health.info = healthInfo;
     s->setGrowthTickLimit(growthTickLimit);
     
     if (!maxFaceAreaFound) 
@@ -673,12 +794,38 @@ bool SimulationLoader::loadSim(std::string filename, SimulationDomain*& d, Simul
     s->rawBCs = rawBCs;
     s->rawRDModel = rawRDModel;
 
+    // Continue an interrupted run, last so the checkpoint wins over everything set up above
+    if (cmdArgsParser.flagSet("Resume") || cmdArgsParser.hasOption("Resume"))
+    {
+        std::string resumeFile = cmdArgsParser.hasOption("Resume") ? cmdArgsParser.getOption("Resume") : s->autoCheckpointName();
+        if (!std::filesystem::exists(resumeFile))
+            LOG("No checkpoint to resume from at [" + resumeFile + "], starting from the beginning");
+        else if (!s->loadCheckpoint(resumeFile))
+        {
+            LOG("Failed to resume from [" + resumeFile + "]");
+            return false;
+        }
+        else
+        {
+            LOG("Resumed from [" << resumeFile << "] at step " << s->stepCount);
+            s->exportInfo.series.append = true;
+        }
+    }
+
     return true;
 }
 
-bool SimulationLoader::parseDomain(const std::string& domName, SimulationDomain*& d, Parameters globalParamMap, const std::vector<std::string>& colorMaps)
+bool SimulationLoader::parseDomain(const std::string& domName, SimulationDomain*& d, Parameters globalParamMap, const std::vector<std::string>& colorMaps, float remeshEdgeLength, unsigned remeshIterations)
 {
     std::string name = Utils::sToLower(domName);
+
+    // optionally rebuild imported models as uniform isotropic triangles
+    auto remesh = [remeshEdgeLength, remeshIterations](Mesh& model)
+    {
+        if (remeshEdgeLength > 0.f)
+            model.remesh(remeshEdgeLength, remeshIterations);
+    };
+
     if (name == "mesh")
         d = new HalfEdgeMesh(Mesh((int)globalParamMap["xRes"], (int)globalParamMap["yRes"], globalParamMap["width"], globalParamMap["height"]));
     else if (name.find(".obj") != std::string::npos)
@@ -688,6 +835,7 @@ bool SimulationLoader::parseDomain(const std::string& domName, SimulationDomain*
         if (!model.isLoaded())
             return false;
 
+        remesh(model);
         d = new HalfEdgeMesh(model);
     }
     else if (name.find(".ply") != std::string::npos)
@@ -697,6 +845,7 @@ bool SimulationLoader::parseDomain(const std::string& domName, SimulationDomain*
         if (!model.isLoaded())
             return false;
 
+        remesh(model);
         d = new HalfEdgeMesh(model);
     }
     else if (name == "grid")
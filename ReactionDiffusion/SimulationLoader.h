@@ -42,7 +42,9 @@ private:
         const std::string& domName,
         SimulationDomain*& d,
         Parameters globalParamMap,
-        const std::vector<std::string>& colorMaps);
+        const std::vector<std::string>& colorMaps,
+        float remeshEdgeLength,             // 0 loads models as they are
+        unsigned remeshIterations);
 
     std::string rawInitConds = "";
     std::string rawRDModel = "";
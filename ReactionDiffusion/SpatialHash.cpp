@@ -0,0 +1,161 @@
+#include "SpatialHash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+void SpatialHash::build(const std::vector<Vec3>& points, float cellSize)
+{
+    clear();
+    if (points.empty())
+        return;
+
+    cellSize_ = cellSize > 0.f ? cellSize : 1.f;
+
+    size_t numBuckets = 1;
+    while (numBuckets < points.size())
+        numBuckets <<= 1;
+    bucketMask_ = numBuckets - 1;
+
+    // Counting sort of the points into their buckets
+    buckets_.resize(points.size());
+    bucketStart_.assign(numBuckets + 1, 0);
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        int x, y, z;
+        cellOf(points[i], x, y, z);
+        buckets_[i] = static_cast<unsigned>(bucketOf(x, y, z));
+        bucketStart_[buckets_[i] + 1]++;
+    }
+
+    for (size_t b = 0; b < numBuckets; ++b)
+        bucketStart_[b + 1] += bucketStart_[b];
+
+    std::vector<unsigned> next(bucketStart_.begin(), bucketStart_.end() - 1);
+    indices_.resize(points.size());
+    points_.resize(points.size());
+    slots_.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        unsigned slot = next[buckets_[i]]++;
+        indices_[slot] = static_cast<unsigned>(i);
+        points_[slot] = points[i];
+        slots_[i] = slot;
+    }
+}
+
+bool SpatialHash::refit(const std::vector<Vec3>& points)
+{
+    const size_t count = points.size();
+    if (count == 0 || count != slots_.size())
+        return false;
+
+    // Every query scans the overflow, past this a rebuild is cheaper
+    const size_t maxOverflow = std::max<size_t>(32, count / 64);
+    for (size_t i = 0; i < count; ++i)
+    {
+        int x, y, z;
+        cellOf(points[i], x, y, z);
+        const unsigned slot = slots_[i];
+        if (slot >= count)
+            overflowPoints_[slot - count] = points[i];
+        else if (bucketOf(x, y, z) == buckets_[i])
+            points_[slot] = points[i];
+        else
+        {
+            // An infinite point is never within the radius, which retires the slot
+            points_[slot] = Vec3(std::numeric_limits<float>::infinity());
+            slots_[i] = static_cast<unsigned>(count + overflow_.size());
+            overflow_.push_back(static_cast<unsigned>(i));
+            overflowPoints_.push_back(points[i]);
+            if (overflow_.size() > maxOverflow)
+                return false;
+        }
+    }
+    return true;
+}
+
+void SpatialHash::query(const Vec3& p, float radius, std::vector<unsigned>& found) const
+{
+    found.clear();
+    if (empty())
+        return;
+
+    int x0, y0, z0, x1, y1, z1;
+    cellOf(p - radius, x0, y0, z0);
+    cellOf(p + radius, x1, y1, z1);
+
+    // Different cells can share a bucket, so collect the distinct buckets first.
+    // A box spanning more cells than there are buckets reads everything instead.
+    double numCells = double(x1 - x0 + 1) * double(y1 - y0 + 1) * double(z1 - z0 + 1);
+    std::vector<size_t> buckets;
+    if (numCells < double(bucketMask_ + 1))
+    {
+        for (int x = x0; x <= x1; ++x)
+            for (int y = y0; y <= y1; ++y)
+                for (int z = z0; z <= z1; ++z)
+                    buckets.push_back(bucketOf(x, y, z));
+        std::sort(buckets.begin(), buckets.end());
+        buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+    }
+    else
+    {
+        buckets.resize(bucketMask_ + 1);
+        for (size_t b = 0; b < buckets.size(); ++b)
+            buckets[b] = b;
+    }
+
+    const float radius2 = radius * radius;
+    for (size_t b : buckets)
+    {
+        for (unsigned slot = bucketStart_[b]; slot < bucketStart_[b + 1]; ++slot)
+        {
+            Vec3 d = points_[slot] - p;
+            if (d.x * d.x + d.y * d.y + d.z * d.z <= radius2)
+                found.push_back(indices_[slot]);
+        }
+    }
+
+    for (size_t k = 0; k < overflow_.size(); ++k)
+    {
+        Vec3 d = overflowPoints_[k] - p;
+        if (d.x * d.x + d.y * d.y + d.z * d.z <= radius2)
+            found.push_back(overflow_[k]);
+    }
+}
+
+void SpatialHash::clear()
+{
+    bucketStart_.clear();
+    indices_.clear();
+    points_.clear();
+    buckets_.clear();
+    slots_.clear();
+    overflow_.clear();
+    overflowPoints_.clear();
+    bucketMask_ = 0;
+}
+
+bool SpatialHash::empty() const
+{
+    return indices_.empty();
+}
+
+float SpatialHash::cellSize() const
+{
+    return cellSize_;
+}
+
+void SpatialHash::cellOf(const Vec3& p, int& x, int& y, int& z) const
+{
+    x = static_cast<int>(std::floor(p.x / cellSize_));
+    y = static_cast<int>(std::floor(p.y / cellSize_));
+    z = static_cast<int>(std::floor(p.z / cellSize_));
+}
+
+size_t SpatialHash::bucketOf(int x, int y, int z) const
+{
+    size_t h = (static_cast<size_t>(x) * 73856093u) ^ (static_cast<size_t>(y) * 19349663u) ^ (static_cast<size_t>(z) * 83492791u);
+    return h & bucketMask_;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "Vec3.h"
+
+#include <vector>
+
+
+// Uniform grid over a point set with the cells hashed into a fixed number of buckets.
+// Points are stored bucket by bucket so a radius query only reads the buckets its box overlaps.
+// Moved points are refitted in place, the few that leave their bucket go to a short overflow list.
+class SpatialHash
+{
+public:
+    SpatialHash() = default;
+
+    void build(const std::vector<Vec3>& points, float cellSize);
+    // Follows points that moved, returns false if the hash has to be rebuilt instead
+    bool refit(const std::vector<Vec3>& points);
+    void query(const Vec3& p, float radius, std::vector<unsigned>& found) const;
+    void clear();
+    bool empty() const;
+    float cellSize() const;
+
+private:
+    void cellOf(const Vec3& p, int& x, int& y, int& z) const;
+    size_t bucketOf(int x, int y, int z) const;
+
+    float cellSize_ = 1.f;
+    size_t bucketMask_ = 0;
+    std::vector<unsigned> bucketStart_; // bucket b owns [bucketStart_[b], bucketStart_[b + 1])
+    std::vector<unsigned> indices_;
+    std::vector<Vec3> points_;
+    std::vector<unsigned> buckets_;       // bucket of each point when it was placed
+    std::vector<unsigned> slots_;         // slot of each point, or the point count plus its overflow index
+    std::vector<unsigned> overflow_;      // points that left their bucket since the last build
+    std::vector<Vec3> overflowPoints_;
+};
@@ -17,6 +17,12 @@ size_t ThreadPool::getNumThreads() const
     return maxNumThreads_;
 }
 
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
 void ThreadPool::start(size_t numThreads)
 {
     for (auto i = 0; i < numThreads; ++i)
@@ -1,7 +1,13 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <future>
+#include <mutex>
 #include <queue>
+#include <thread>
+#include <vector>
 
 
 class ThreadPool
@@ -14,6 +20,9 @@ public:
 
     size_t getNumThreads() const;
 
+    // Pool shared by the parallel helpers, one thread per core, started on first use
+    static ThreadPool& shared();
+
     template<class T>
     auto enqueue(T task) -> std::future<decltype(task())>
     {
@@ -29,6 +38,52 @@ public:
         return wrapper->get_future();
     }
 
+    // Runs func(i) for every i in [0, count), split into one contiguous range per thread, and
+    // returns when all of them are done. The calling thread and the pool's threads claim ranges
+    // of this batch only, so a caller never picks up other work queued on the pool, and it only
+    // ever waits for ranges already being run, so calls may nest.
+    template<class Func>
+    void parallelFor(size_t count, Func func)
+    {
+        const size_t indicesPerRange = std::max<size_t>(1, (count + maxNumThreads_ - 1) / maxNumThreads_);
+        const size_t rangeCount = (count + indicesPerRange - 1) / indicesPerRange;
+        if (rangeCount <= 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+                func(i);
+            return;
+        }
+
+        struct Batch
+        {
+            std::atomic<size_t> next = 0;
+            size_t done = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto batch = std::make_shared<Batch>();
+
+        // A helper that starts after every range was claimed leaves without touching func
+        auto runRanges = [batch, &func, count, indicesPerRange, rangeCount]() {
+            for (size_t range = batch->next++; range < rangeCount; range = batch->next++)
+            {
+                const size_t end = std::min((range + 1) * indicesPerRange, count);
+                for (size_t i = range * indicesPerRange; i < end; ++i)
+                    func(i);
+
+                std::unique_lock<std::mutex> lock(batch->mutex);
+                if (++batch->done == rangeCount)
+                    batch->finished.notify_all();
+            }
+        };
+
+        for (size_t helper = 1; helper < rangeCount; ++helper)
+            enqueue(runRanges);
+        runRanges();
+
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->finished.wait(lock, [&]() { return batch->done == rangeCount; });
+    }
 
 private:
     void start(size_t numThreads);
@@ -0,0 +1,632 @@
+#include "TimeSeries.h"
+#include "Checkpoint.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+
+const char TimeSeries::Magic[8] = { 'R', 'D', 'P', 'G', 'T', 'S', 'E', 'R' };
+const char TimeSeries::IndexMagic[8] = { 'R', 'D', 'P', 'G', 'T', 'I', 'D', 'X' };
+
+namespace
+{
+    struct IndexEntry
+    {
+        int32_t stepCount;
+        uint32_t topology;
+        uint32_t keyDistance;
+        uint32_t reserved;
+        uint64_t cellCount;
+        uint64_t offset;
+    };
+
+    const uint32_t QuantizedMax = 65535;
+
+    // Groups the first bytes of every value, then the second bytes and so on, which deflates
+    // far better than the values do
+    void shuffle(const unsigned char* in, size_t count, size_t width, unsigned char* out)
+    {
+        for (size_t b = 0; b < width; ++b)
+            for (size_t i = 0; i < count; ++i)
+                out[b * count + i] = in[i * width + b];
+    }
+
+    void unshuffle(const unsigned char* in, size_t count, size_t width, unsigned char* out)
+    {
+        for (size_t b = 0; b < width; ++b)
+            for (size_t i = 0; i < count; ++i)
+                out[i * width + b] = in[b * count + i];
+    }
+
+    template<class T>
+    void append(std::vector<unsigned char>& bytes, const T& value)
+    {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(&value);
+        bytes.insert(bytes.end(), data, data + sizeof(T));
+    }
+
+    void append(std::vector<unsigned char>& bytes, const void* data, size_t size)
+    {
+        const unsigned char* begin = static_cast<const unsigned char*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+}
+
+const char* TimeSeries::encodingName(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Encoding::Raw:       return "raw";
+    case Encoding::Quantized: return "quantized";
+    default:                  return "delta";
+    }
+}
+
+// ------- Writer ------------
+
+TimeSeriesWriter::~TimeSeriesWriter()
+{
+    close();
+}
+
+bool TimeSeriesWriter::open(const std::string& fileName, uint32_t morphCount, const Info& info, int firstStep)
+{
+    close();
+    error_.clear();
+    fileName_ = fileName;
+    info_ = info;
+    info_.keyInterval = std::max(info_.keyInterval, 1);
+    morphCount_ = morphCount;
+    bytesWritten_ = 0;
+    topologies_.clear();
+    frames_.clear();
+    previous_.clear();
+    framesSinceKey_ = 0;
+    keyNeeded_ = true;
+
+    // Keep the whole records a resumed run wrote before the step it carries on from, a missing
+    // index is rebuilt on close
+    uint64_t kept = 0;
+    std::error_code error;
+    if (info.append && std::filesystem::exists(fileName, error))
+    {
+        TimeSeriesReader reader;
+        if (reader.open(fileName) && reader.morphCount() == morphCount)
+        {
+            const size_t frameCount = reader.findFrame(firstStep);
+            kept = frameCount < reader.frameCount() ? reader.frame(frameCount).offset : reader.dataEnd();
+            frames_.assign(reader.frames_.begin(), reader.frames_.begin() + frameCount);
+            for (uint64_t offset : reader.topologies_)
+                if (offset < kept)
+                    topologies_.push_back(offset);
+        }
+        reader.close();
+        if (kept > 0)
+            std::filesystem::resize_file(fileName, kept, error);
+        if (error)
+            kept = 0;
+    }
+
+    if (kept > 0)
+    {
+        file_.open(fileName, std::ios::binary | std::ios::app);
+        offset_ = kept;
+    }
+    else
+    {
+        topologies_.clear();
+        frames_.clear();
+        file_.open(fileName, std::ios::binary | std::ios::trunc);
+        FileHeader header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.morphCount = morphCount;
+        file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        offset_ = sizeof(header);
+    }
+
+    if (!file_)
+        return fail("Cannot open " + fileName);
+    return true;
+}
+
+bool TimeSeriesWriter::isOpen() const
+{
+    return file_.is_open();
+}
+
+const std::string& TimeSeriesWriter::fileName() const
+{
+    return fileName_;
+}
+
+bool TimeSeriesWriter::appendTopology(const Topology& topology)
+{
+    if (!isOpen())
+        return false;
+
+    TopologyHeader header;
+    header.xRes = topology.xRes;
+    header.yRes = topology.yRes;
+    header.positionCount = topology.positions.size();
+    header.indexCount = topology.indices.size();
+    header.textureCoordCount = topology.textureCoords.size();
+
+    packed_.clear();
+    append(packed_, header);
+    append(packed_, topology.positions.data(), topology.positions.size() * sizeof(float));
+    append(packed_, topology.indices.data(), topology.indices.size() * sizeof(uint32_t));
+    append(packed_, topology.textureCoords.data(), topology.textureCoords.size() * sizeof(float));
+
+    const uint64_t offset = offset_;
+    if (!writeRecord(RecordType::Topology, packed_))
+        return false;
+
+    topologies_.push_back(offset);
+    keyNeeded_ = true;
+    return true;
+}
+
+bool TimeSeriesWriter::appendFrame(int stepCount, const float* values, size_t cellCount)
+{
+    if (!isOpen())
+        return false;
+    if (topologies_.empty())
+        return fail("A topology has to be written before the first frame");
+
+    const size_t count = cellCount * morphCount_;
+    const bool key = keyNeeded_ || info_.encoding == Encoding::Raw || framesSinceKey_ >= static_cast<size_t>(info_.keyInterval) || previous_.size() != count;
+
+    FrameHeader header;
+    header.stepCount = stepCount;
+    header.topology = static_cast<uint32_t>(topologies_.size() - 1);
+    header.encoding = static_cast<uint32_t>(info_.encoding);
+    header.key = key ? 1 : 0;
+    header.cellCount = cellCount;
+
+    packed_.clear();
+    append(packed_, header);
+    if (info_.encoding == Encoding::Raw)
+        append(packed_, values, count * sizeof(float));
+    else if (info_.encoding == Encoding::Delta)
+    {
+        std::vector<uint32_t> bits(count);
+        std::memcpy(bits.data(), values, count * sizeof(float));
+        if (!key)
+            for (size_t i = 0; i < count; ++i)
+                previous_[i] ^= bits[i];
+        else
+            previous_ = bits;
+
+        shuffled_.resize(count * sizeof(uint32_t));
+        shuffle(reinterpret_cast<const unsigned char*>(previous_.data()), count, sizeof(uint32_t), shuffled_.data());
+        previous_.swap(bits);
+        std::vector<unsigned char> deflated = Utils::deflate(shuffled_.data(), shuffled_.size());
+        append(packed_, deflated.data(), deflated.size());
+    }
+    else
+    {
+        std::vector<uint32_t> codes(count);
+        std::vector<uint16_t> deltas(count);
+        for (size_t m = 0; m < morphCount_; ++m)
+        {
+            const float* morph = values + m * cellCount;
+            float minValue = 0.f, maxValue = 0.f;
+            bool found = false;
+            for (size_t i = 0; i < cellCount; ++i)
+            {
+                if (!std::isfinite(morph[i]))
+                    continue;
+                minValue = found ? std::min(minValue, morph[i]) : morph[i];
+                maxValue = found ? std::max(maxValue, morph[i]) : morph[i];
+                found = true;
+            }
+
+            const float scale = (maxValue - minValue) / QuantizedMax;
+            append(packed_, minValue);
+            append(packed_, scale);
+            for (size_t i = 0; i < cellCount; ++i)
+            {
+                const size_t j = m * cellCount + i;
+                float code = scale > 0.f && std::isfinite(morph[i]) ? std::round((morph[i] - minValue) / scale) : 0.f;
+                codes[j] = static_cast<uint32_t>(std::min(std::max(code, 0.f), static_cast<float>(QuantizedMax)));
+                deltas[j] = static_cast<uint16_t>(key ? codes[j] : codes[j] - previous_[j]);
+            }
+        }
+        previous_.swap(codes);
+
+        shuffled_.resize(count * sizeof(uint16_t));
+        shuffle(reinterpret_cast<const unsigned char*>(deltas.data()), count, sizeof(uint16_t), shuffled_.data());
+        std::vector<unsigned char> deflated = Utils::deflate(shuffled_.data(), shuffled_.size());
+        append(packed_, deflated.data(), deflated.size());
+    }
+
+    Frame frame;
+    frame.stepCount = stepCount;
+    frame.topology = header.topology;
+    frame.keyDistance = key || frames_.empty() ? 0 : frames_.back().keyDistance + 1;
+    frame.cellCount = cellCount;
+    frame.offset = offset_;
+    if (!writeRecord(RecordType::Frame, packed_))
+        return false;
+
+    frames_.push_back(frame);
+    framesSinceKey_ = key ? 1 : framesSinceKey_ + 1;
+    keyNeeded_ = false;
+    return true;
+}
+
+bool TimeSeriesWriter::close()
+{
+    if (!isOpen())
+        return true;
+
+    packed_.clear();
+    append(packed_, static_cast<uint64_t>(topologies_.size()));
+    append(packed_, static_cast<uint64_t>(frames_.size()));
+    append(packed_, topologies_.data(), topologies_.size() * sizeof(uint64_t));
+    for (auto& frame : frames_)
+        append(packed_, IndexEntry{ frame.stepCount, frame.topology, frame.keyDistance, 0, frame.cellCount, frame.offset });
+
+    Trailer trailer;
+    trailer.indexOffset = offset_;
+    std::memcpy(trailer.magic, IndexMagic, sizeof(IndexMagic));
+    bool written = writeRecord(RecordType::Index, packed_);
+    if (written)
+    {
+        file_.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+        written = static_cast<bool>(file_);
+    }
+
+    file_.close();
+    return written && !file_.fail();
+}
+
+uint64_t TimeSeriesWriter::bytesWritten() const
+{
+    return bytesWritten_;
+}
+
+const std::string& TimeSeriesWriter::error() const
+{
+    return error_;
+}
+
+bool TimeSeriesWriter::writeRecord(RecordType type, const std::vector<unsigned char>& payload)
+{
+    RecordHeader header;
+    header.type = static_cast<uint32_t>(type);
+    header.reserved = 0;
+    header.size = payload.size();
+    header.checksum = Checkpoint::checksum(payload.data(), payload.size());
+
+    // Flushed record by record, a crash loses at most the record being written
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    file_.flush();
+    if (!file_)
+        return fail("Failed writing " + fileName_);
+
+    offset_ += sizeof(header) + payload.size();
+    bytesWritten_ += sizeof(header) + payload.size();
+    return true;
+}
+
+bool TimeSeriesWriter::fail(const std::string& error)
+{
+    error_ = error;
+    return false;
+}
+
+// ------- Reader ------------
+
+bool TimeSeriesReader::open(const std::string& fileName)
+{
+    close();
+
+    file_.open(fileName, std::ios::binary);
+    if (!file_)
+        return fail("Cannot open " + fileName);
+
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(fileName, error);
+    FileHeader header;
+    if (error || fileSize < sizeof(header) || !file_.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return fail(fileName + " is too small to be a time series");
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        return fail(fileName + " is not a time series");
+    if (header.version == 0 || header.version > Version)
+        return fail(fileName + " is time series version " + std::to_string(header.version) + ", this build reads up to " + std::to_string(Version));
+    morphCount_ = header.morphCount;
+
+    if (!loadIndex(fileSize))
+    {
+        topologies_.clear();
+        frames_.clear();
+        if (!scan(fileSize))
+            return false;
+    }
+    return true;
+}
+
+void TimeSeriesReader::close()
+{
+    if (file_.is_open())
+        file_.close();
+    file_.clear();
+    morphCount_ = 0;
+    topologies_.clear();
+    frames_.clear();
+    dataEnd_ = 0;
+    decoded_ = SIZE_MAX;
+}
+
+uint32_t TimeSeriesReader::morphCount() const
+{
+    return morphCount_;
+}
+
+size_t TimeSeriesReader::topologyCount() const
+{
+    return topologies_.size();
+}
+
+size_t TimeSeriesReader::frameCount() const
+{
+    return frames_.size();
+}
+
+const TimeSeries::Frame& TimeSeriesReader::frame(size_t i) const
+{
+    return frames_[i];
+}
+
+size_t TimeSeriesReader::findFrame(int stepCount) const
+{
+    for (size_t i = 0; i < frames_.size(); ++i)
+        if (frames_[i].stepCount >= stepCount)
+            return i;
+    return frames_.size();
+}
+
+uint64_t TimeSeriesReader::dataEnd() const
+{
+    return dataEnd_;
+}
+
+const std::string& TimeSeriesReader::error() const
+{
+    return error_;
+}
+
+bool TimeSeriesReader::readRecord(uint64_t offset, RecordHeader& header, std::vector<unsigned char>& payload)
+{
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(offset));
+    if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+
+    payload.resize(static_cast<size_t>(header.size));
+    if (!file_.read(reinterpret_cast<char*>(payload.data()), payload.size()))
+        return false;
+    return Checkpoint::checksum(payload.data(), payload.size()) == header.checksum;
+}
+
+bool TimeSeriesReader::loadIndex(uint64_t fileSize)
+{
+    Trailer trailer;
+    if (fileSize < sizeof(FileHeader) + sizeof(RecordHeader) + sizeof(trailer))
+        return false;
+
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(fileSize - sizeof(trailer)));
+    if (!file_.read(reinterpret_cast<char*>(&trailer), sizeof(trailer)) || std::memcmp(trailer.magic, IndexMagic, sizeof(IndexMagic)) != 0)
+        return false;
+    if (trailer.indexOffset < sizeof(FileHeader) || trailer.indexOffset + sizeof(RecordHeader) > fileSize - sizeof(trailer))
+        return false;
+
+    RecordHeader header;
+    if (!readRecord(trailer.indexOffset, header, payload_) || header.type != static_cast<uint32_t>(RecordType::Index) || payload_.size() < 2 * sizeof(uint64_t))
+        return false;
+
+    uint64_t counts[2];
+    std::memcpy(counts, payload_.data(), sizeof(counts));
+    if (payload_.size() != sizeof(counts) + counts[0] * sizeof(uint64_t) + counts[1] * sizeof(IndexEntry))
+        return false;
+
+    const unsigned char* data = payload_.data() + sizeof(counts);
+    topologies_.resize(static_cast<size_t>(counts[0]));
+    std::memcpy(topologies_.data(), data, topologies_.size() * sizeof(uint64_t));
+    data += topologies_.size() * sizeof(uint64_t);
+
+    frames_.resize(static_cast<size_t>(counts[1]));
+    for (auto& frame : frames_)
+    {
+        IndexEntry entry;
+        std::memcpy(&entry, data, sizeof(entry));
+        data += sizeof(entry);
+        frame.stepCount = entry.stepCount;
+        frame.topology = entry.topology;
+        frame.keyDistance = entry.keyDistance;
+        frame.cellCount = entry.cellCount;
+        frame.offset = entry.offset;
+    }
+
+    dataEnd_ = trailer.indexOffset;
+    return true;
+}
+
+// Walks the records of a series whose writer never got to append the index, stopping at the
+// first one that is cut short or damaged
+bool TimeSeriesReader::scan(uint64_t fileSize)
+{
+    uint64_t offset = sizeof(FileHeader);
+    RecordHeader header;
+    while (offset + sizeof(header) <= fileSize)
+    {
+        file_.clear();
+        file_.seekg(static_cast<std::streamoff>(offset));
+        if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.size > fileSize - offset - sizeof(header))
+            break;
+        if (header.type == static_cast<uint32_t>(RecordType::Index) || !readRecord(offset, header, payload_))
+            break;
+
+        if (header.type == static_cast<uint32_t>(RecordType::Topology))
+            topologies_.push_back(offset);
+        else if (header.type == static_cast<uint32_t>(RecordType::Frame))
+        {
+            FrameHeader frameHeader;
+            if (payload_.size() < sizeof(frameHeader) || topologies_.empty())
+                break;
+            std::memcpy(&frameHeader, payload_.data(), sizeof(frameHeader));
+            if (!frameHeader.key && frames_.empty())
+                break;
+
+            Frame frame;
+            frame.stepCount = frameHeader.stepCount;
+            frame.topology = frameHeader.topology;
+            frame.keyDistance = frameHeader.key ? 0 : frames_.back().keyDistance + 1;
+            frame.cellCount = frameHeader.cellCount;
+            frame.offset = offset;
+            frames_.push_back(frame);
+        }
+        else
+            break;
+
+        offset += sizeof(header) + header.size;
+    }
+
+    dataEnd_ = offset;
+    return true;
+}
+
+bool TimeSeriesReader::readTopology(size_t i, Topology& topology)
+{
+    if (i >= topologies_.size())
+        return fail("No topology " + std::to_string(i));
+
+    RecordHeader header;
+    TopologyHeader topologyHeader;
+    if (!readRecord(topologies_[i], header, payload_) || header.type != static_cast<uint32_t>(RecordType::Topology) || payload_.size() < sizeof(topologyHeader))
+        return fail("Topology " + std::to_string(i) + " is damaged");
+
+    std::memcpy(&topologyHeader, payload_.data(), sizeof(topologyHeader));
+    const uint64_t size = sizeof(topologyHeader) + (topologyHeader.positionCount + topologyHeader.textureCoordCount) * sizeof(float) + topologyHeader.indexCount * sizeof(uint32_t);
+    if (payload_.size() != size)
+        return fail("Topology " + std::to_string(i) + " is damaged");
+
+    const unsigned char* data = payload_.data() + sizeof(topologyHeader);
+    topology.xRes = topologyHeader.xRes;
+    topology.yRes = topologyHeader.yRes;
+    topology.positions.resize(static_cast<size_t>(topologyHeader.positionCount));
+    std::memcpy(topology.positions.data(), data, topology.positions.size() * sizeof(float));
+    data += topology.positions.size() * sizeof(float);
+    topology.indices.resize(static_cast<size_t>(topologyHeader.indexCount));
+    std::memcpy(topology.indices.data(), data, topology.indices.size() * sizeof(uint32_t));
+    data += topology.indices.size() * sizeof(uint32_t);
+    topology.textureCoords.resize(static_cast<size_t>(topologyHeader.textureCoordCount));
+    std::memcpy(topology.textureCoords.data(), data, topology.textureCoords.size() * sizeof(float));
+    return true;
+}
+
+bool TimeSeriesReader::readFrame(size_t i, std::vector<float>& values)
+{
+    if (i >= frames_.size())
+        return fail("No frame " + std::to_string(i));
+
+    // Decoding starts from the frame's key frame, or carries on from the frame decoded last
+    const size_t key = i - frames_[i].keyDistance;
+    const size_t first = decoded_ != SIZE_MAX && decoded_ >= key && decoded_ <= i ? decoded_ + 1 : key;
+    for (size_t j = first; j <= i; ++j)
+    {
+        if (!decode(j))
+        {
+            decoded_ = SIZE_MAX;
+            return fail("Frame " + std::to_string(j) + " is damaged");
+        }
+    }
+
+    values = currentValues_;
+    return true;
+}
+
+bool TimeSeriesReader::decode(size_t i)
+{
+    RecordHeader header;
+    FrameHeader frameHeader;
+    if (!readRecord(frames_[i].offset, header, payload_) || header.type != static_cast<uint32_t>(RecordType::Frame) || payload_.size() < sizeof(frameHeader))
+        return false;
+    std::memcpy(&frameHeader, payload_.data(), sizeof(frameHeader));
+
+    const size_t cellCount = static_cast<size_t>(frameHeader.cellCount);
+    const size_t count = cellCount * morphCount_;
+    if (!frameHeader.key && (decoded_ != i - 1 || current_.size() != count))
+        return false;
+
+    const unsigned char* data = payload_.data() + sizeof(frameHeader);
+    size_t size = payload_.size() - sizeof(frameHeader);
+    const Encoding encoding = static_cast<Encoding>(frameHeader.encoding);
+    currentValues_.resize(count);
+    if (encoding == Encoding::Raw)
+    {
+        if (size != count * sizeof(float))
+            return false;
+        std::memcpy(currentValues_.data(), data, size);
+        current_.clear();
+    }
+    else if (encoding == Encoding::Delta)
+    {
+        unpacked_.resize(count * sizeof(uint32_t));
+        if (count > 0 && !Utils::inflate(data, size, unpacked_.data(), unpacked_.size()))
+            return false;
+
+        std::vector<uint32_t> bits(count);
+        unshuffle(unpacked_.data(), count, sizeof(uint32_t), reinterpret_cast<unsigned char*>(bits.data()));
+        if (!frameHeader.key)
+            for (size_t j = 0; j < count; ++j)
+                bits[j] ^= current_[j];
+        current_.swap(bits);
+        std::memcpy(currentValues_.data(), current_.data(), count * sizeof(float));
+    }
+    else if (encoding == Encoding::Quantized)
+    {
+        const size_t rangesSize = morphCount_ * 2 * sizeof(float);
+        if (size < rangesSize)
+            return false;
+        std::vector<float> ranges(morphCount_ * 2);
+        std::memcpy(ranges.data(), data, rangesSize);
+        data += rangesSize;
+        size -= rangesSize;
+
+        unpacked_.resize(count * sizeof(uint16_t));
+        if (count > 0 && !Utils::inflate(data, size, unpacked_.data(), unpacked_.size()))
+            return false;
+
+        std::vector<uint16_t> deltas(count);
+        unshuffle(unpacked_.data(), count, sizeof(uint16_t), reinterpret_cast<unsigned char*>(deltas.data()));
+        current_.resize(count);
+        for (size_t m = 0; m < morphCount_; ++m)
+        {
+            for (size_t c = 0; c < cellCount; ++c)
+            {
+                const size_t j = m * cellCount + c;
+                current_[j] = frameHeader.key ? deltas[j] : (current_[j] + deltas[j]) & QuantizedMax;
+                currentValues_[j] = ranges[m * 2] + current_[j] * ranges[m * 2 + 1];
+            }
+        }
+    }
+    else
+        return false;
+
+    decoded_ = i;
+    return true;
+}
+
+bool TimeSeriesReader::fail(const std::string& error)
+{
+    error_ = error;
+    return false;
+}
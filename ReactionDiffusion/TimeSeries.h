@@ -0,0 +1,180 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// Single file, append only recording of a run. A topology record (vertex positions, triangles and
+// texture coordinates of a mesh, or a grid's resolution) is written whenever the domain changes
+// shape, and every frame after it stores only the morphogens. Closing the writer appends an
+// index so a reader can go straight to any frame, a file that was never closed is indexed by
+// walking its records instead. Values are stored in the machine's byte order.
+class TimeSeries
+{
+public:
+    enum class Encoding : uint32_t
+    {
+        Raw,        // floats as they are
+        Delta,      // lossless, the bits of each float xor the previous frame's, deflated
+        Quantized,  // 16 bits between each morphogen's min and max, as a difference to the previous frame, deflated
+    };
+
+    struct Info
+    {
+        Encoding encoding = Encoding::Delta;
+        int keyInterval = 30;   // frames between frames stored without the previous one, bounds random access
+        bool append = false;    // carry on in an existing series instead of replacing it, for resumed runs
+    };
+
+    struct Topology
+    {
+        int xRes = 0, yRes = 0;             // grid resolution, 0 for a mesh
+        std::vector<float> positions;       // 3 per vertex
+        std::vector<uint32_t> indices;      // 3 per triangle
+        std::vector<float> textureCoords;   // 2 per vertex, or none
+    };
+
+    struct Frame
+    {
+        int stepCount = 0;
+        uint32_t topology = 0;      // the topology record the frame's cells belong to
+        uint32_t keyDistance = 0;   // frames back to the one decoding starts from
+        uint64_t cellCount = 0;
+        uint64_t offset = 0;
+    };
+
+    static constexpr uint32_t Version = 1;
+    static const char* encodingName(Encoding encoding);
+
+protected:
+    enum class RecordType : uint32_t { Topology = 1, Frame, Index };
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t morphCount;
+    };
+
+    struct RecordHeader
+    {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    struct TopologyHeader
+    {
+        int32_t xRes;
+        int32_t yRes;
+        uint64_t positionCount;
+        uint64_t indexCount;
+        uint64_t textureCoordCount;
+    };
+
+    struct FrameHeader
+    {
+        int32_t stepCount;
+        uint32_t topology;
+        uint32_t encoding;
+        uint32_t key;
+        uint64_t cellCount;
+    };
+
+    struct Trailer
+    {
+        uint64_t indexOffset;
+        char magic[8];
+    };
+
+    static const char Magic[8];
+    static const char IndexMagic[8];
+};
+
+class TimeSeriesWriter :
+    public TimeSeries
+{
+public:
+    TimeSeriesWriter() = default;
+    ~TimeSeriesWriter();
+
+    TimeSeriesWriter(const TimeSeriesWriter&) = delete;
+    TimeSeriesWriter& operator=(const TimeSeriesWriter&) = delete;
+
+    // Replaces anything at fileName. With info.append an existing series with the same morphogens
+    // is kept instead, up to its last whole frame before firstStep, and carried on from there.
+    bool open(const std::string& fileName, uint32_t morphCount, const Info& info, int firstStep);
+    bool isOpen() const;
+    const std::string& fileName() const;
+    // Starts a new topology record, the frames appended after it use its cells
+    bool appendTopology(const Topology& topology);
+    // values holds cellCount floats of every morphogen, one morphogen after the other
+    bool appendFrame(int stepCount, const float* values, size_t cellCount);
+    // Appends the index, returns false if the file couldn't be completed
+    bool close();
+    uint64_t bytesWritten() const;
+    const std::string& error() const;
+
+private:
+    bool writeRecord(RecordType type, const std::vector<unsigned char>& payload);
+    bool fail(const std::string& error);
+
+    std::ofstream file_;
+    std::string fileName_;
+    Info info_;
+    uint32_t morphCount_ = 0;
+    uint64_t offset_ = 0;
+    uint64_t bytesWritten_ = 0;
+    std::vector<uint64_t> topologies_;
+    std::vector<Frame> frames_;
+    std::vector<uint32_t> previous_;        // last frame's float bits or quantized values
+    std::vector<unsigned char> packed_, shuffled_;
+    size_t framesSinceKey_ = 0;
+    bool keyNeeded_ = true;
+    std::string error_;
+};
+
+class TimeSeriesReader :
+    public TimeSeries
+{
+    friend class TimeSeriesWriter;
+
+public:
+    TimeSeriesReader() = default;
+
+    bool open(const std::string& fileName);
+    void close();
+    uint32_t morphCount() const;
+    size_t topologyCount() const;
+    size_t frameCount() const;
+    const Frame& frame(size_t i) const;
+    // Index of the first frame at or after stepCount, frameCount() if there is none
+    size_t findFrame(int stepCount) const;
+    bool readTopology(size_t i, Topology& topology);
+    // Fills values with the frame's cellCount floats of every morphogen, one morphogen after the
+    // other. Reading frames in order decodes each one once.
+    bool readFrame(size_t i, std::vector<float>& values);
+    // Where the last whole record ends, the writer carries on from here
+    uint64_t dataEnd() const;
+    const std::string& error() const;
+
+private:
+    bool readRecord(uint64_t offset, RecordHeader& header, std::vector<unsigned char>& payload);
+    bool loadIndex(uint64_t fileSize);
+    bool scan(uint64_t fileSize);
+    bool decode(size_t i);
+    bool fail(const std::string& error);
+
+    std::ifstream file_;
+    uint32_t morphCount_ = 0;
+    std::vector<uint64_t> topologies_;
+    std::vector<Frame> frames_;
+    uint64_t dataEnd_ = 0;
+    std::vector<unsigned char> payload_, unpacked_;
+    std::vector<uint32_t> current_;         // decoded bits or quantized values of frame decoded_
+    std::vector<float> currentValues_;
+    size_t decoded_ = SIZE_MAX;
+    std::string error_;
+};
@@ -5,6 +5,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
+
 
 std::string loadTextFile(const std::string& filename)
 {
@@ -51,6 +53,50 @@ void Utils::saveImage(const std::string& filename, int width, int height, unsign
         std::cout << "Unable to save image: " << filename << std::endl;
 }
 
+void Utils::flipImage(unsigned char* pixels, int width, int height, int numColorComponents)
+{
+    const size_t rowSize = static_cast<size_t>(width) * numColorComponents;
+    for (int y = 0; y < height / 2; ++y)
+    {
+        unsigned char* top = pixels + y * rowSize;
+        unsigned char* bottom = pixels + (height - 1 - y) * rowSize;
+        std::swap_ranges(top, top + rowSize, bottom);
+    }
+}
+
+// zlib streams from stb's png writer and loader
+std::vector<unsigned char> Utils::deflate(const unsigned char* data, size_t size, int quality)
+{
+    std::vector<unsigned char> deflated;
+    int deflatedSize = 0;
+    unsigned char* compressed = stbi_zlib_compress(const_cast<unsigned char*>(data), static_cast<int>(size), &deflatedSize, quality);
+    if (compressed != nullptr)
+    {
+        deflated.assign(compressed, compressed + deflatedSize);
+        STBIW_FREE(compressed);
+    }
+    return deflated;
+}
+
+bool Utils::inflate(const unsigned char* data, size_t size, unsigned char* out, size_t outSize)
+{
+    return stbi_zlib_decode_buffer(reinterpret_cast<char*>(out), static_cast<int>(outSize), reinterpret_cast<const char*>(data), static_cast<int>(size)) == static_cast<int>(outSize);
+}
+
+std::vector<const char*> Utils::splitLines(const char* begin, const char* end, size_t chunkSize)
+{
+    std::vector<const char*> chunks;
+    for (const char* chunk = begin; chunk < end;)
+    {
+        chunks.push_back(chunk);
+        const char* chunkEnd = chunk + std::min<size_t>(chunkSize, end - chunk);
+        const char* newline = chunkEnd < end ? static_cast<const char*>(std::memchr(chunkEnd, '\n', end - chunkEnd)) : nullptr;
+        chunk = newline != nullptr ? newline + 1 : end;
+    }
+    chunks.push_back(end);
+    return chunks;
+}
+
 void Utils::loadImage(const std::string& filename, int* width, int* height, unsigned char** pixels, int* numColorComponents)
 {
     stbi_set_flip_vertically_on_load(true);
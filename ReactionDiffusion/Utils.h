@@ -14,6 +14,8 @@
 #include <regex> 
 #include <iterator> 
 #include <functional> 
+#include <cstdint>
+#include <cstring>
 
 
 std::string loadTextFile(const std::string& filename);
@@ -125,6 +127,14 @@ DEL %simFileSource%.lib
         return pos;
     }
 
+    inline bool isBigEndian()
+    {
+        const uint16_t one = 1;
+        unsigned char first = 0;
+        std::memcpy(&first, &one, 1);
+        return first == 0;
+    }
+
     inline std::string mkdirSystemCommand(const std::string& command)
     {	
 #ifdef _WIN32	    
@@ -315,6 +325,12 @@ DEL %simFileSource%.lib
     }
 
     void saveImage(const std::string& filename, int width, int height, unsigned char* pixels, int numColorComponents = 3);
+    void flipImage(unsigned char* pixels, int width, int height, int numColorComponents = 3);
+    std::vector<unsigned char> deflate(const unsigned char* data, size_t size, int quality = 8);
+    bool inflate(const unsigned char* data, size_t size, unsigned char* out, size_t outSize);
+    // Splits text into chunks of about chunkSize bytes that start and end on line boundaries,
+    // returns the start of every chunk followed by end
+    std::vector<const char*> splitLines(const char* begin, const char* end, size_t chunkSize);
     void loadImage(const std::string& filename, int* width, int* height, unsigned char** pixels, int* numColorComponents);
     Image loadImage(const std::string& filename);
 }
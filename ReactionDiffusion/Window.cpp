@@ -249,43 +249,20 @@ void Window::getCursorPos(int& x, int& y)
 void Window::screenshot(const std::string& filename) const
 {
     int width, height;
+    std::vector<unsigned char> pixels;
+    readPixels(pixels, width, height);
+    Utils::flipImage(pixels.data(), width, height);
+    Utils::saveImage(filename.c_str(), width, height, pixels.data());
+}
+
+// Rows come bottom first, as OpenGL returns them
+void Window::readPixels(std::vector<unsigned char>& pixels, int& width, int& height) const
+{
     getSize(width, height);
     const unsigned numOfComponents = 3; //RGB
-    unsigned char* pixels = new unsigned char[width * height * numOfComponents];
-    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-
-    unsigned char r, g, b;
-    unsigned i, j;
-    for (int y = 0; y < height / 2; ++y)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            //get top pixel
-            i = y * width + x;
-            i *= numOfComponents;
-
-            //get bottom pixel
-            j = (height - 1 - y) * width + x;
-            j *= numOfComponents;
-
-            //swap them
-            r = pixels[i];
-            g = pixels[i + 1];
-            b = pixels[i + 2];
-
-            pixels[i] = pixels[j];
-            pixels[i + 1] = pixels[j + 1];
-            pixels[i + 2] = pixels[j + 2];
-
-            pixels[j] = r;
-            pixels[j + 1] = g;
-            pixels[j + 2] = b;
-        }
-    }
-
-    Utils::saveImage(filename.c_str(), width, height, pixels, numOfComponents);
-
-    delete[] pixels;
+    pixels.resize(static_cast<size_t>(width) * height * numOfComponents);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
 }
 
 void Window::setShouldExit(bool shouldClose)
@@ -7,6 +7,7 @@
 #include <unordered_map>
 #include <string>
 #include <functional>
+#include <vector>
 
 
 class GUI;
@@ -29,6 +30,7 @@ public:
     void makeCurrent() const;
     bool shouldClose() const;
     void screenshot(const std::string& filename) const;
+    void readPixels(std::vector<unsigned char>& pixels, int& width, int& height) const;
     void queryMonitors() const;
     void getCursorPos(int& x, int& y);
     void setPos(int x, int y);